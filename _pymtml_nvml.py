@@ -0,0 +1,732 @@
+##
+# nvml compatibility layer of the MTML python bindings
+#
+# Loaded lazily by pymtml on first access to an nvml*/NVML* name; use `import pymtml as pynvml`
+# rather than importing this module directly.
+##
+from __future__ import annotations
+
+from ctypes import *
+from dataclasses import dataclass
+from typing import TYPE_CHECKING as _TYPE_CHECKING
+
+from pymtml import *
+
+if _TYPE_CHECKING:
+    from typing_extensions import TypeAlias as _TypeAlias  # Python 3.10+
+
+# nvml wrapper layer ###########################################################
+# NVML constants and types###########################################
+NVML_SUCCESS = MTML_SUCCESS
+NVML_ERROR_NOT_SUPPORTED = MTML_ERROR_NOT_SUPPORTED
+NVML_ERROR_UNINITIALIZED = MTML_ERROR_UNINITIALIZED
+NVML_ERROR_FUNCTION_NOT_FOUND = MTML_ERROR_FUNCTION_NOT_FOUND
+NVML_ERROR_INSUFFICIENT_SIZE = MTML_ERROR_INSUFFICIENT_SIZE
+NVML_ERROR_GPU_IS_LOST = MTML_ERROR_GPU_IS_LOST
+NVML_ERROR_LIBRARY_NOT_FOUND = MTML_ERROR_LIBRARY_NOT_FOUND
+NVML_ERROR_NO_PERMISSION = MTML_ERROR_NO_PERMISSION
+NVML_ERROR_NOT_FOUND = MTML_ERROR_NOT_FOUND
+NVML_ERROR_UNKNOWN = MTML_ERROR_UNKNOWN
+
+
+_nvmlClockType_t = c_uint
+NVML_CLOCK_GRAPHICS = 0
+NVML_CLOCK_SM = 1
+NVML_CLOCK_MEM = 2
+NVML_CLOCK_VIDEO = 3
+NVML_CLOCK_COUNT = 4
+
+_nvmlTemperatureSensors_t = c_uint
+NVML_TEMPERATURE_GPU = 0
+NVML_TEMPERATURE_COUNT = 1
+
+_nvmlDriverModel_t = c_uint
+NVML_DRIVER_WDDM = 0
+NVML_DRIVER_WDM = 1
+NVML_DRIVER_MCDM = 2
+
+_nvmlMemoryErrorType_t = c_uint
+NVML_MEMORY_ERROR_TYPE_CORRECTED = 0
+NVML_MEMORY_ERROR_TYPE_UNCORRECTED = 1
+NVML_MEMORY_ERROR_TYPE_COUNT = 2
+
+_nvmlEccCounterType_t = c_uint
+NVML_VOLATILE_ECC = 0
+NVML_AGGREGATE_ECC = 1
+NVML_ECC_COUNTER_TYPE_COUNT = 2
+
+_nvmlComputeMode_t = c_uint
+NVML_COMPUTEMODE_DEFAULT = 0
+NVML_COMPUTEMODE_EXCLUSIVE_THREAD = 1  ## Support Removed
+NVML_COMPUTEMODE_PROHIBITED = 2
+NVML_COMPUTEMODE_EXCLUSIVE_PROCESS = 3
+NVML_COMPUTEMODE_COUNT = 4
+
+_nvmlPcieUtilCounter_t = c_uint
+NVML_PCIE_UTIL_TX_BYTES = 0
+NVML_PCIE_UTIL_RX_BYTES = 1
+NVML_PCIE_UTIL_COUNT = 2
+
+NVML_NVLINK_MAX_LINKS = 18
+# NVLink Link Count
+NVML_FI_DEV_NVLINK_LINK_COUNT = 91
+
+# NVLink Throughput Counters
+NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_TX = 138  # NVLink TX Data throughput in KiB
+NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_RX = 139  # NVLink RX Data throughput in KiB
+NVML_FI_DEV_NVLINK_THROUGHPUT_RAW_TX = 140  # NVLink TX Data + protocol overhead in KiB
+NVML_FI_DEV_NVLINK_THROUGHPUT_RAW_RX = 141  # NVLink RX Data + protocol overhead in KiB
+
+# P2P Capability Index (maps to MtLink for MTML)
+_nvmlGpuP2PCapsIndex_t = c_uint
+NVML_P2P_CAPS_INDEX_READ = 0
+NVML_P2P_CAPS_INDEX_WRITE = 1
+NVML_P2P_CAPS_INDEX_NVLINK = 2  # Maps to MtLink for MTML
+NVML_P2P_CAPS_INDEX_ATOMICS = 3
+NVML_P2P_CAPS_INDEX_PROP = 4
+NVML_P2P_CAPS_INDEX_PCI = 4
+NVML_P2P_CAPS_INDEX_UNKNOWN = 5
+
+# P2P Status
+_nvmlGpuP2PStatus_t = c_uint
+NVML_P2P_STATUS_OK = 0
+NVML_P2P_STATUS_CHIPSET_NOT_SUPPORED = 1
+NVML_P2P_STATUS_CHIPSET_NOT_SUPPORTED = NVML_P2P_STATUS_CHIPSET_NOT_SUPPORED
+NVML_P2P_STATUS_GPU_NOT_SUPPORTED = 2
+NVML_P2P_STATUS_IOH_TOPOLOGY_NOT_SUPPORTED = 3
+NVML_P2P_STATUS_DISABLED_BY_REGKEY = 4
+NVML_P2P_STATUS_NOT_SUPPORTED = 5
+NVML_P2P_STATUS_UNKNOWN = 6
+
+# GPU Topology Level
+_nvmlGpuTopologyLevel_t = c_uint
+NVML_TOPOLOGY_INTERNAL = 0
+NVML_TOPOLOGY_SINGLE = 10
+NVML_TOPOLOGY_MULTIPLE = 20
+NVML_TOPOLOGY_HOSTBRIDGE = 30
+NVML_TOPOLOGY_NODE = 40  # NVML calls this NODE
+NVML_TOPOLOGY_SYSTEM = 50
+
+_nvmlValueType_t = c_uint
+NVML_VALUE_TYPE_DOUBLE = 0
+NVML_VALUE_TYPE_UNSIGNED_INT = 1
+NVML_VALUE_TYPE_UNSIGNED_LONG = 2
+NVML_VALUE_TYPE_UNSIGNED_LONG_LONG = 3
+NVML_VALUE_TYPE_SIGNED_LONG_LONG = 4
+NVML_VALUE_TYPE_SIGNED_INT = 5
+NVML_VALUE_TYPE_UNSIGNED_SHORT = 6
+NVML_VALUE_TYPE_COUNT = 7
+
+NVMLError_FunctionNotFound: _TypeAlias = MTMLError_FunctionNotFound
+NVMLError_GpuIsLost: _TypeAlias = MTMLError_GpuIsLost
+NVMLError_InvalidArgument: _TypeAlias = MTMLError_NotFound
+NVMLError_LibraryNotFound: _TypeAlias = MTMLError_LibraryNotFound
+NVMLError_NoPermission: _TypeAlias = MTMLError_NoPermission
+NVMLError_NotFound: _TypeAlias = MTMLError_NotFound
+NVMLError_NotSupported: _TypeAlias = MTMLError_NotSupported
+NVMLError_Unknown: _TypeAlias = MTMLError_Unknown
+
+c_nvmlFieldValue_t = c_mtmlFieldValue_t
+c_nvmlDevice_t = c_mtmlDevice_t
+
+
+@dataclass(frozen=True)
+class NVMLMemoryInfo:
+    total: int
+    free: int
+    used: int
+
+
+@dataclass(frozen=True)
+class NVMLUtilization:
+    gpu: int
+    memory: int
+
+
+class NVMLError(MTMLError):
+    def __new__(typ, value):
+        obj = super().__new__(MTMLError, value)
+
+        if not isinstance(obj, NVMLError):
+            obj.__class__ = NVMLError
+
+        return obj
+
+
+def nvmlStructToFriendlyObject(struct):
+    return mtmlStructToFriendlyObject(struct)
+
+
+def nvmlInit():
+    return nvmlInitWithFlags(0)
+
+
+def nvmlInitWithFlags(flags):
+    return mtmlLibraryInit()
+
+
+def nvmlShutdown():
+    return mtmlLibraryShutDown()
+
+
+def nvmlExceptionClass(nvmlErrorCode):
+    if nvmlErrorCode not in NVMLError._valClassMapping:
+        raise ValueError("nvmlErrorCode %s is not valid" % nvmlErrorCode)
+    return NVMLError._valClassMapping[nvmlErrorCode]
+
+
+def nvmlSystemGetDriverVersion():
+    c_system = mtmlLibraryInitSystem()
+    return mtmlSystemGetDriverVersion(c_system)
+
+
+def nvmlDeviceGetCount():
+    return mtmlLibraryCountDevice()
+
+
+def nvmlDeviceGetHandleByIndex(index):
+    return mtmlLibraryInitDeviceByIndex(index)
+
+
+def nvmlDeviceGetHandleByUuid(uuid):
+    try:
+        return mtmlGetDeviceRegistry().byUuid(uuid).handle
+    except MTMLError:
+        # not a physical device (e.g. a virtual device UUID); ask the library
+        return mtmlLibraryInitDeviceByUuid(uuid)
+
+
+def nvmlDeviceGetHandleByPciBusId(pciBusId):
+    try:
+        return mtmlGetDeviceRegistry().bySbdf(pciBusId).handle
+    except MTMLError:
+        return mtmlLibraryInitDeviceByPciSbdf(pciBusId)
+
+
+def nvmlDeviceGetIndex(device):
+    return mtmlDeviceGetIndex(device)
+
+
+def nvmlDeviceGetName(device):
+    return mtmlDeviceGetName(device)
+
+
+def nvmlDeviceGetUUID(device):
+    return mtmlDeviceGetUUID(device)
+
+
+def nvmlDeviceGetPciInfo(device):
+    return mtmlDeviceGetPciInfo(device)
+
+
+def nvmlDeviceGetSerial(device):
+    return mtmlDeviceGetSerialNumber(device)
+
+
+def nvmlDeviceGetMemoryInfo(device):
+    handle = mtmlDeviceInitMemory(device)
+    total = mtmlMemoryGetTotal(handle)
+    used = mtmlMemoryGetUsed(handle)
+    return NVMLMemoryInfo(total=total, free=(total - used), used=used)
+
+
+def nvmlDeviceGetUtilizationRates(device):
+    gpu = mtmlGpuGetUtilization(device)
+    memory = mtmlMemoryGetUtilization(device)
+    return NVMLUtilization(gpu=gpu, memory=memory)
+
+
+def nvmlDeviceGetClockInfo(device, type):
+    if type == NVML_CLOCK_GRAPHICS or type == NVML_CLOCK_SM:
+        return mtmlGpuGetClock(device)
+    elif type == NVML_CLOCK_VIDEO:
+        return mtmlVpuGetClock(device)
+    elif type == NVML_CLOCK_MEM:
+        return mtmlMemoryGetClock(device)
+    else:
+        return 0
+
+
+def nvmlDeviceGetMaxClockInfo(device, type):
+    if type == NVML_CLOCK_GRAPHICS or type == NVML_CLOCK_SM:
+        return mtmlGpuGetMaxClock(device)
+    elif type == NVML_CLOCK_VIDEO:
+        return mtmlVpuGetMaxClock(device)
+    elif type == NVML_CLOCK_MEM:
+        return mtmlMemoryGetMaxClock(device)
+    else:
+        return 0
+
+
+def nvmlDeviceGetTemperature(device, type):
+    return mtmlGpuGetTemperature(device)
+
+
+def nvmlDeviceGetPowerUsage(device):
+    return mtmlDeviceGetPowerUsage(device)
+
+
+# cannot expose this function directly since _nvmlGetFunctionPointer will retrive the function pointer from the mtml library directly.
+# it will cause a MTMLError_FunctionNotFound exception when we get nvml function pointer from the mtml library.
+# def _nvmlGetFunctionPointer(name):
+#     return _mtmlGetFunctionPointer(name)
+
+
+def nvmlDeviceGetFanSpeed(device):
+    try:
+        return mtmlDeviceGetFanSpeed(device, 0)
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetFanSpeed_v2(device, fan):
+    try:
+        return mtmlDeviceGetFanSpeed(device, fan)
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetBAR1MemoryInfo(device):
+    # Not Support
+    return "N/A"
+
+
+def nvmlDeviceGetEncoderUtilization(device):
+    try:
+        vpu = mtmlDeviceInitVpu(device)
+        util = mtmlVpuGetUtilization(vpu)
+        return [util.encodeUtil, 0]  # samplingPeriodUs not available
+    except MTMLError:
+        return [0, 0]
+
+
+def nvmlDeviceGetDecoderUtilization(device):
+    try:
+        vpu = mtmlDeviceInitVpu(device)
+        util = mtmlVpuGetUtilization(vpu)
+        return [util.decodeUtil, 0]  # samplingPeriodUs not available
+    except MTMLError:
+        return [0, 0]
+
+
+def nvmlSystemGetCudaDriverVersion():
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetDisplayMode(device):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetCurrentDriverModel(device):
+    # Not Support
+    return 3
+
+
+def nvmlDeviceGetPersistenceMode(device):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetPerformanceState(device):
+    # Not Support
+    return "N/A"
+
+
+def nvmlDeviceGetTotalEccErrors(device, errorType, counterType):
+    try:
+        memory = mtmlDeviceInitMemory(device)
+        return mtmlMemoryGetEccErrorCounter(
+            memory, errorType, counterType, MTML_MEMORY_LOCATION_DRAM
+        )
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetPowerManagementLimit(device):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetPcieThroughput(device, type):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetFieldValues(handle, fieldIds):
+    # Not Support
+    return []
+
+
+def nvmlDeviceGetDisplayActive(device):
+    # not support
+    return 0
+
+
+def nvmlDeviceGetComputeMode(device):
+    # not support
+    return 5
+
+
+# MUSA compute capability per GPU architecture. Moore Threads PCI device IDs carry the
+# architecture generation in their high byte (0x01xx SUDI, 0x02xx CHUNXIAO, 0x03xx QUYUAN,
+# 0x04xx PINGHU); product names are matched first since they are exact.
+_MUSA_CAPABILITY_BY_NAME = {
+    "MTT S10": (1, 0),
+    "MTT S30": (1, 0),
+    "MTT S50": (1, 0),
+    "MTT S2000": (1, 0),
+    "MTT S70": (2, 1),
+    "MTT S80": (2, 1),
+    "MTT S3000": (2, 1),
+    "MTT X300": (2, 1),
+    "MTT S4000": (2, 2),
+    "MTT S5000": (3, 1),
+}
+_MUSA_CAPABILITY_BY_PCI_DEVICE_ID_FAMILY = {
+    0x01: (1, 0),
+    0x02: (2, 1),
+    0x03: (2, 2),
+    0x04: (3, 1),
+}
+_MTHREADS_PCI_VENDOR_ID = 0x1ED5
+
+_musaCapabilityCache = dict()  # device UUID -> (major, minor)
+
+
+def _musaCapabilityFromTable(device):
+    try:
+        name = mtmlDeviceGetName(device).strip()
+        if name in _MUSA_CAPABILITY_BY_NAME:
+            return _MUSA_CAPABILITY_BY_NAME[name]
+    except MTMLError:
+        pass
+    try:
+        pci_device_id = mtmlDeviceGetPciInfo(device).pciDeviceId
+    except MTMLError:
+        return None
+    # pciDeviceId is (deviceId << 16) | vendorId like NVML; tolerate a bare device ID too
+    if pci_device_id & 0xFFFF == _MTHREADS_PCI_VENDOR_ID:
+        pci_device_id >>= 16
+    return _MUSA_CAPABILITY_BY_PCI_DEVICE_ID_FAMILY.get((pci_device_id >> 8) & 0xFF)
+
+
+def _musaCapabilityFromTorch(index):
+    try:
+        import torch
+        import torch_musa
+
+        major, minor = torch.musa.get_device_capability(index)
+        return (major, minor)
+    except ImportError:
+        # torch or torch_musa not available
+        return None
+    except Exception:
+        return None
+
+
+def nvmlDeviceGetCudaComputeCapability(device):
+    """
+    Get MUSA (Meta-computing Unified System Architecture) compute capability
+    for Moore Threads GPU. Returns (major, minor) tuple.
+
+    Resolved from a built-in table keyed by device name and PCI device ID and cached per
+    device. torch.musa.get_device_capability (torch + torch_musa) is only imported for
+    devices the table does not know. Returns (0, 0) if neither source knows the device.
+    """
+    try:
+        entry = mtmlGetDeviceRegistry().byHandle(device)
+    except MTMLError:
+        entry = None
+
+    if entry is not None and entry.uuid in _musaCapabilityCache:
+        return _musaCapabilityCache[entry.uuid]
+
+    capability = _musaCapabilityFromTable(device)
+    if capability is None:
+        # unknown to the table: ask torch_musa, by registry index (0 if not registered)
+        capability = _musaCapabilityFromTorch(entry.index if entry else 0)
+    if capability is None:
+        return (0, 0)
+
+    if entry is not None:
+        _musaCapabilityCache[entry.uuid] = capability
+    return capability
+
+
+def nvmlDeviceIsMigDeviceHandle(device):
+    # not support
+    return 0
+
+
+def nvmlDeviceGetMigMode(device):
+    # Not Support
+    # [currentMode, pendingMode]
+    return [0, 0]
+
+
+def nvmlDeviceGetComputeRunningProcesses(device):
+    # Not Support
+    return []
+
+
+def nvmlDeviceGetGraphicsRunningProcesses(device):
+    # Not Support
+    return []
+
+
+def nvmlDeviceGetProcessUtilization(device, timeStamp):
+    # Not Support
+    return []
+
+
+def nvmlDeviceGetMaxMigDeviceCount(device):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetMigDeviceHandleByIndex(device, index):
+    # Not Support
+    return "N/A"
+
+
+def nvmlDeviceGetDeviceHandleFromMigDeviceHandle(device):
+    # Not Support
+    return "N/A"
+
+
+def nvmlDeviceGetGpuInstanceId(device):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetComputeInstanceId(device):
+    # Not Support
+    return 0
+
+
+def nvmlDeviceGetP2PStatus(device1, device2, p2pIndex):
+    """
+    Get P2P status between two devices.
+    Maps NVML P2P caps to MTML P2P caps.
+
+    For NVML_P2P_CAPS_INDEX_NVLINK, this performs detailed MtLink detection
+    to check if two devices are connected via MtLink (1 hop).
+    """
+    try:
+        # Map NVML P2P index to MTML P2P caps
+        if p2pIndex == NVML_P2P_CAPS_INDEX_READ:
+            mtml_cap = MTML_P2P_CAPS_READ
+        elif p2pIndex == NVML_P2P_CAPS_INDEX_WRITE:
+            mtml_cap = MTML_P2P_CAPS_WRITE
+        elif p2pIndex == NVML_P2P_CAPS_INDEX_NVLINK:
+            # One-hop MtLink connectivity, the check sglang's MUSA branch makes. The
+            # adjacency is built once from every device's links and answers all pairs.
+            if mtmlGetMtLinkAdjacency().connected(device1, device2):
+                return NVML_P2P_STATUS_OK
+            return NVML_P2P_STATUS_NOT_SUPPORTED
+        else:
+            # For other P2P caps, use MTML P2P status
+            mtml_cap = MTML_P2P_CAPS_READ
+
+        status = mtmlDeviceGetP2PStatus(device1, device2, mtml_cap)
+        # Map MTML status to NVML status
+        if status == MTML_P2P_STATUS_OK:
+            return NVML_P2P_STATUS_OK
+        elif status == MTML_P2P_STATUS_CHIPSET_NOT_SUPPORTED:
+            return NVML_P2P_STATUS_CHIPSET_NOT_SUPPORTED
+        elif status == MTML_P2P_STATUS_GPU_NOT_SUPPORTED:
+            return NVML_P2P_STATUS_GPU_NOT_SUPPORTED
+        else:
+            return NVML_P2P_STATUS_UNKNOWN
+    except MTMLError:
+        return NVML_P2P_STATUS_NOT_SUPPORTED
+
+
+def nvmlDeviceGetTopologyCommonAncestor(device1, device2):
+    """
+    Get the common ancestor topology level between two devices.
+    Maps MTML topology levels to NVML topology levels.
+    """
+    try:
+        level = mtmlDeviceGetTopologyLevel(device1, device2)
+        # Map MTML topology level to NVML topology level
+        if level == MTML_TOPOLOGY_INTERNAL:
+            return NVML_TOPOLOGY_INTERNAL
+        elif level == MTML_TOPOLOGY_SINGLE:
+            return NVML_TOPOLOGY_SINGLE
+        elif level == MTML_TOPOLOGY_MULTIPLE:
+            return NVML_TOPOLOGY_MULTIPLE
+        elif level == MTML_TOPOLOGY_HOSTBRIDGE:
+            return NVML_TOPOLOGY_HOSTBRIDGE
+        elif level == MTML_TOPOLOGY_NODE:
+            return NVML_TOPOLOGY_NODE
+        elif level == MTML_TOPOLOGY_SYSTEM:
+            return NVML_TOPOLOGY_SYSTEM
+        else:
+            return NVML_TOPOLOGY_SYSTEM
+    except MTMLError:
+        return NVML_TOPOLOGY_SYSTEM
+
+
+def nvmlDeviceGetTopologyNearestGpus(device, level):
+    """
+    Get GPUs at or nearer than the given topology level.
+    """
+    try:
+        # Map NVML level to MTML level
+        if level >= NVML_TOPOLOGY_SYSTEM:
+            mtml_level = MTML_TOPOLOGY_SYSTEM
+        elif level >= NVML_TOPOLOGY_NODE:
+            mtml_level = MTML_TOPOLOGY_NODE
+        elif level >= NVML_TOPOLOGY_HOSTBRIDGE:
+            mtml_level = MTML_TOPOLOGY_HOSTBRIDGE
+        elif level >= NVML_TOPOLOGY_MULTIPLE:
+            mtml_level = MTML_TOPOLOGY_MULTIPLE
+        elif level >= NVML_TOPOLOGY_SINGLE:
+            mtml_level = MTML_TOPOLOGY_SINGLE
+        else:
+            mtml_level = MTML_TOPOLOGY_INTERNAL
+
+        count = mtmlDeviceCountDeviceByTopologyLevel(device, mtml_level)
+        if count > 0:
+            return mtmlDeviceGetDeviceByTopologyLevel(device, mtml_level, count)
+        return []
+    except MTMLError:
+        return []
+
+
+def nvmlDeviceGetNvLinkState(device, link):
+    """
+    Get NVLink state - maps to MtLink state for MTML.
+    """
+    try:
+        state = mtmlDeviceGetMtLinkState(device, link)
+        return 1 if state else 0
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetNvLinkCapability(device, link, capability):
+    """
+    Get NVLink capability - maps to MtLink cap status for MTML.
+    """
+    try:
+        return mtmlDeviceGetMtLinkCapStatus(device, link, capability)
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetNvLinkRemotePciInfo(device, link):
+    """
+    Get NVLink remote PCI info - maps to MtLink for MTML.
+    """
+    try:
+        remote_device = mtmlDeviceGetMtLinkRemoteDevice(device, link)
+        return mtmlDeviceGetPciInfo(remote_device)
+    except MTMLError:
+        return None
+
+
+def nvmlDeviceGetNumGpuCores(device):
+    """Get number of GPU cores."""
+    try:
+        return mtmlDeviceCountGpuCores(device)
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetMemoryBusWidth(device):
+    """Get memory bus width in bits."""
+    try:
+        memory = mtmlDeviceInitMemory(device)
+        return mtmlMemoryGetBusWidth(memory)
+    except MTMLError:
+        return 0
+
+
+def nvmlDeviceGetVbiosVersion(device):
+    """Get VBIOS version."""
+    try:
+        return mtmlDeviceGetVbiosVersion(device)
+    except MTMLError:
+        return ""
+
+
+def nvmlDeviceGetBrand(device):
+    """Get device brand."""
+    try:
+        return mtmlDeviceGetBrand(device)
+    except MTMLError:
+        return MTML_BRAND_UNKNOWN
+
+
+def nvmlDeviceGetMinorNumber(device):
+    """Get device minor number (render node number)."""
+    try:
+        # Parse from render path: /dev/dri/renderD128 -> 128
+        render_path = mtmlDeviceGetRenderPath(device)
+        if isinstance(render_path, bytes):
+            render_path = render_path.decode()
+        # Extract number from path like /dev/dri/renderD128
+        import re
+
+        match = re.search(r"renderD(\d+)", render_path)
+        if match:
+            return int(match.group(1))
+        return 0
+    except (MTMLError, Exception):
+        return 0
+
+
+def nvmlDeviceGetCpuAffinity(device, cpuSetSize):
+    """Get CPU affinity for device."""
+    try:
+        return mtmlDeviceGetCpuAffinityWithinNode(device, cpuSetSize)
+    except MTMLError:
+        return [0] * cpuSetSize
+
+
+def nvmlDeviceGetMemoryAffinity(device, nodeSetSize, scope):
+    """Get memory affinity for device."""
+    try:
+        return mtmlDeviceGetMemoryAffinityWithinNode(device, nodeSetSize)
+    except MTMLError:
+        return [0] * nodeSetSize
+
+
+def nvmlDeviceGetCpuAffinityWithinScope(device, cpuSetSize, scope):
+    """Get CPU affinity within scope for device."""
+    try:
+        return mtmlDeviceGetCpuAffinityWithinNode(device, cpuSetSize)
+    except MTMLError:
+        return [0] * cpuSetSize
+
+
+def nvmlDeviceGetEccMode(device):
+    """Get ECC mode - returns (current, pending)."""
+    try:
+        memory = mtmlDeviceInitMemory(device)
+        return mtmlMemoryGetEccMode(memory)
+    except MTMLError:
+        return (0, 0)
+
+
+def nvmlDeviceGetCurrentEccMode(device):
+    """Get current ECC mode."""
+    return nvmlDeviceGetEccMode(device)[0]
+
+
+def nvmlDeviceGetPendingEccMode(device):
+    """Get pending ECC mode."""
+    return nvmlDeviceGetEccMode(device)[1]
+
+
+def nvmlDeviceGetRetiredPagesPendingStatus(device):
+    """Get retired pages pending status."""
+    try:
+        memory = mtmlDeviceInitMemory(device)
+        return mtmlMemoryGetRetiredPagesPendingStatus(memory)
+    except MTMLError:
+        return 0
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""
+Benchmarks for pymtml.py MTML API bindings
+Run with: python bench_pymtml.py [--duration SECONDS]
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import threading
+import time
+
+from pymtml import *
+
+THREAD_COUNTS = (1, 2, 4, 8, 16)
+
+# Runs in a fresh interpreter so the import is measured cold. Init and first query are only
+# reported when libmtml.so can be loaded.
+_STARTUP_PROBE = """
+import json, sys, time
+t0 = time.perf_counter()
+import pymtml
+t1 = time.perf_counter()
+result = {
+    "import": t1 - t0,
+    "eager": [
+        m
+        for m in ("_pymtml_nvml", "dataclasses", "typing", "fnmatch", "queue", "random")
+        if m in sys.modules
+    ],
+}
+try:
+    pymtml.mtmlLibraryInit()
+    t2 = time.perf_counter()
+    device = pymtml.mtmlLibraryInitDeviceByIndex(0)
+    pymtml.mtmlGpuGetUtilization(device)
+    t3 = time.perf_counter()
+    result.update(init=t2 - t1, first_query=t3 - t2)
+    pymtml.mtmlLibraryShutDown()
+except pymtml.MTMLError:
+    pass
+print(json.dumps(result))
+"""
+
+
+def print_section(title):
+    print(f"\n{'='*60}")
+    print(f" {title}")
+    print(f"{'='*60}")
+
+
+def print_result(name, value, indent=2):
+    prefix = " " * indent
+    print(f"{prefix}{name}: {value}")
+
+
+def measure_startup(repeats=5):
+    """
+    Returns the median seconds for import, mtmlLibraryInit and the first query over `repeats`
+    fresh interpreters, plus the lazily loaded modules that were imported eagerly.
+    """
+    samples = []
+    for _ in range(repeats):
+        out = subprocess.run(
+            [sys.executable, "-c", _STARTUP_PROBE],
+            cwd=os.path.dirname(os.path.abspath(__file__)),
+            check=True,
+            capture_output=True,
+            text=True,
+        ).stdout
+        samples.append(json.loads(out))
+
+    result = {"eager": sorted({m for s in samples for m in s["eager"]})}
+    for key in ("import", "init", "first_query"):
+        values = [s[key] for s in samples if key in s]
+        if values:
+            result[key] = statistics.median(values)
+    return result
+
+
+def bench_startup(repeats):
+    print_section("Import / Init / First Query Latency")
+    result = measure_startup(repeats)
+    for key in ("import", "init", "first_query"):
+        if key in result:
+            print_result(f"{key:12s}", f"{result[key] * 1000:8.2f} ms (median)")
+        else:
+            print_result(f"{key:12s}", "N/A (library not available)")
+    print_result("eager lazy sections", result["eager"] or "none")
+
+
+def poll_device(device):
+    """One sampling pass over the read-only getters a monitoring loop typically uses."""
+    mtmlDeviceGetPowerUsage(device)
+    mtmlGpuGetUtilization(device)
+    mtmlGpuGetTemperature(device)
+    mtmlMemoryGetUtilization(device)
+
+
+def bench_snapshot_poll(devices, duration):
+    """Compares the cost per metric read of mtmlPollInto with the per-call wrappers."""
+    print_section("Snapshot Poll vs Per-call Wrappers")
+    snapshot = MtmlSnapshot(devices)
+
+    for name, poll, reads in (
+        ("per-call wrappers", lambda: [poll_device(d) for d in devices], 4),
+        ("mtmlPollInto", lambda: mtmlPollInto(snapshot), len(MTML_SNAPSHOT_METRICS)),
+    ):
+        n = 0
+        t0 = time.perf_counter()
+        deadline = t0 + duration
+        while time.perf_counter() < deadline:
+            poll()
+            n += 1
+        elapsed = time.perf_counter() - t0
+        per_read = elapsed / (n * reads * len(devices))
+        print_result(f"{name:18s}", f"{per_read * 1e6:8.2f} us per metric read")
+    snapshot.close()
+
+
+def bench_threaded_throughput(devices, duration):
+    """
+    Polls with 1/2/4/8/16 threads, thread i sampling device i % len(devices), and reports
+    aggregate and per-thread polls per second. On a free-threaded build the aggregate should
+    scale with the thread count since the read path takes no global lock.
+    """
+    print_section("Multi-threaded Poll Throughput")
+    gil = getattr(sys, "_is_gil_enabled", lambda: True)()
+    print_result("GIL enabled", gil)
+
+    baseline = None
+    for thread_count in THREAD_COUNTS:
+        counts = [0] * thread_count
+        start = threading.Barrier(thread_count + 1)
+        stop = threading.Event()
+
+        def worker(slot):
+            device = devices[slot % len(devices)]
+            start.wait()
+            n = 0
+            while not stop.is_set():
+                poll_device(device)
+                n += 1
+            counts[slot] = n
+
+        threads = [
+            threading.Thread(target=worker, args=(i,)) for i in range(thread_count)
+        ]
+        for t in threads:
+            t.start()
+        start.wait()
+        t0 = time.perf_counter()
+        time.sleep(duration)
+        stop.set()
+        for t in threads:
+            t.join()
+        elapsed = time.perf_counter() - t0
+
+        rate = sum(counts) / elapsed
+        if baseline is None:
+            baseline = rate
+        print_result(
+            f"{thread_count:2d} thread(s)",
+            f"{rate:10.0f} polls/s  ({rate / thread_count:8.0f} per thread, "
+            f"x{rate / baseline:.2f} vs 1 thread)",
+        )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument(
+        "--duration", type=float, default=2.0, help="seconds per measurement"
+    )
+    parser.add_argument(
+        "--repeats", type=int, default=10, help="interpreters per startup measurement"
+    )
+    args = parser.parse_args()
+
+    bench_startup(args.repeats)
+
+    try:
+        mtmlLibraryInit()
+    except MTMLError as e:
+        print(f"MTML Error: {e}")
+        return 1
+
+    try:
+        device_count = mtmlLibraryCountDevice()
+        if device_count == 0:
+            print("No devices found")
+            return 1
+        devices = [mtmlLibraryInitDeviceByIndex(i) for i in range(device_count)]
+        print(f"\nFound {device_count} device(s)")
+
+        bench_snapshot_poll(devices, args.duration)
+        bench_threaded_throughput(devices, args.duration)
+    finally:
+        mtmlLibraryShutDown()
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
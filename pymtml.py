@@ -3,16 +3,12 @@
 ##
 from __future__ import annotations
 
-import string
 import sys
 import threading
+import time
 from ctypes import *
-from dataclasses import dataclass
 from functools import wraps
-from typing import TYPE_CHECKING as _TYPE_CHECKING
-
-if _TYPE_CHECKING:
-    from typing_extensions import TypeAlias as _TypeAlias  # Python 3.10+
+from types import MappingProxyType
 
 ## C Type mappings ##
 ## Constants
@@ -486,11 +482,25 @@ class c_mtmlPageRetirement_t(_PrintableStructure):
     ]
 
 
+## Lazy module sections ##
+# The nvml compatibility layer and the MTMLError_* subclasses are only built when first used, so
+# importing pymtml for a quick query does not pay for them (see __getattr__ at the end).
+_mtmlLazySectionLock = threading.RLock()
+_mtmlNvmlSectionLoader = None  # ident of the thread importing the nvml section
+_NVML_SECTION_PREFIXES = ("nvml", "NVML", "_nvml", "c_nvml")
+
+
 ## Lib loading ##
 mtmlLib = None
-libLoadLock = threading.Lock()
+libLoadLock = threading.Lock()  # taken to load the library or resolve a new symbol
 libHandle = c_mtmlLibrary_t()
 _mtmlLib_refcount = 0  # Incremented on each mtmlInit and decremented on mtmlShutdown
+_mtmlLib_refcountLock = threading.Lock()  # guards _mtmlLib_refcount only
+
+# Per-device locks serialize the calls MTML documents as unsafe to run concurrently on one
+# device (MPC reconfiguration, reset). Read-only queries never take them.
+_mtmlDeviceLocks = dict()
+_mtmlDeviceLocksLock = threading.Lock()
 
 
 ## Error Checking ##
@@ -515,6 +525,8 @@ class MTMLError(Exception):
         See _extractMTMLErrorsAsClasses function for more details
         """
         if typ == MTMLError:
+            if not MTMLError._valClassMapping:
+                _extractMTMLErrorsAsClasses()
             typ = MTMLError._valClassMapping.get(value, typ)
         obj = Exception.__new__(typ)
         obj.value = value
@@ -543,30 +555,41 @@ def _extractMTMLErrorsAsClasses():
 
     MTMLError is a parent class. Each MTML_ERROR_* gets it's own subclass.
     e.g. MTML_ERROR_ALREADY_INITIALIZED will be turned into MTMLError_AlreadyInitialized
-    """
-    this_module = sys.modules[__name__]
-    mtmlErrorsNames = [x for x in dir(this_module) if x.startswith("MTML_ERROR_")]
-    for err_name in mtmlErrorsNames:
-        # e.g. Turn MTML_ERROR_ALREADY_INITIALIZED into MTMLError_AlreadyInitialized
-        class_name = "MTMLError_" + string.capwords(
-            err_name.replace("MTML_ERROR_", ""), "_"
-        ).replace("_", "")
-        err_val = getattr(this_module, err_name)
-
-        def gen_new(val):
-            def new(typ, *args):
-                obj = MTMLError.__new__(typ, val)
-                return obj
-
-            return new
-
-        new_error_class = type(class_name, (MTMLError,), {"__new__": gen_new(err_val)})
-        new_error_class.__module__ = __name__
-        setattr(this_module, class_name, new_error_class)
-        MTMLError._valClassMapping[err_val] = new_error_class
 
-
-_extractMTMLErrorsAsClasses()
+    Runs on first use (the first raised MTMLError or MTMLError_* attribute access) rather than at
+    import, and only once.
+    """
+    if MTMLError._valClassMapping:
+        return
+    with _mtmlLazySectionLock:
+        if MTMLError._valClassMapping:
+            return
+        this_module = sys.modules[__name__]
+        mtmlErrorsNames = [x for x in dir(this_module) if x.startswith("MTML_ERROR_")]
+        mapping = dict()
+        for err_name in mtmlErrorsNames:
+            # e.g. Turn MTML_ERROR_ALREADY_INITIALIZED into MTMLError_AlreadyInitialized
+            class_name = "MTMLError_" + "".join(
+                word.capitalize()
+                for word in err_name.replace("MTML_ERROR_", "").split("_")
+            )
+            err_val = getattr(this_module, err_name)
+
+            def gen_new(val):
+                def new(typ, *args):
+                    obj = MTMLError.__new__(typ, val)
+                    return obj
+
+                return new
+
+            new_error_class = type(
+                class_name, (MTMLError,), {"__new__": gen_new(err_val)}
+            )
+            new_error_class.__module__ = __name__
+            setattr(this_module, class_name, new_error_class)
+            mapping[err_val] = new_error_class
+        # published last: a non-empty mapping means every subclass exists
+        MTMLError._valClassMapping.update(mapping)
 
 
 def _mtmlCheckReturn(ret):
@@ -576,32 +599,461 @@ def _mtmlCheckReturn(ret):
 
 
 ## Function access ##
-_mtmlGetFunctionPointer_cache = (
-    dict()
-)  # function pointers are cached to prevent unnecessary libLoadLock locking
+# Resolved function pointers. The mapping is never mutated once published: a miss builds a new
+# dict under libLoadLock and swaps the module reference, so the read path is a plain lookup
+# without any lock, which keeps concurrent pollers parallel on free-threaded builds.
+_mtmlGetFunctionPointer_cache = MappingProxyType(dict())
+
+# Return types that differ from the default MtmlReturn; applied once when the symbol is resolved
+# instead of on every call.
+_mtmlFunctionRestypes = {
+    "mtmlErrorString": c_char_p,
+}
 
 
 def _mtmlGetFunctionPointer(name):
-    global mtmlLib
+    global _mtmlGetFunctionPointer_cache
 
-    if name in _mtmlGetFunctionPointer_cache:
-        return _mtmlGetFunctionPointer_cache[name]
+    fn = _mtmlGetFunctionPointer_cache.get(name)
+    if fn is not None:
+        return fn
 
     libLoadLock.acquire()
     try:
+        # another thread may have published the symbol while we waited
+        fn = _mtmlGetFunctionPointer_cache.get(name)
+        if fn is not None:
+            return fn
         # ensure library was loaded
         if mtmlLib == None:
             raise MTMLError(MTML_ERROR_FUNCTION_NOT_FOUND)
         try:
-            _mtmlGetFunctionPointer_cache[name] = getattr(mtmlLib, name)
-            return _mtmlGetFunctionPointer_cache[name]
+            fn = getattr(mtmlLib, name)
         except AttributeError:
             raise MTMLError(MTML_ERROR_FUNCTION_NOT_FOUND)
+        if name in _mtmlFunctionRestypes:
+            fn.restype = _mtmlFunctionRestypes[name]
+        fn = _mtmlDispatchWrap(name, fn)
+        table = dict(_mtmlGetFunctionPointer_cache)
+        table[name] = fn
+        _mtmlGetFunctionPointer_cache = MappingProxyType(table)
+        return fn
     finally:
         # lock is always freed
         libLoadLock.release()
 
 
+def mtmlUseLibrary(library):
+    """
+    Dispatches every MTML call to `library` from now on: a CDLL of another build of
+    libmtml, or any stand-in object whose attributes are the mtml* functions taking the same
+    ctypes arguments. Call it before mtmlLibraryInit. Previously resolved functions, and
+    those bound into existing snapshots, are dropped.
+    """
+    global mtmlLib, _mtmlGetFunctionPointer_cache
+
+    with libLoadLock:
+        mtmlLib = library
+        _mtmlGetFunctionPointer_cache = MappingProxyType(dict())
+
+
+## Fault injection ##
+# With faults installed, _mtmlGetFunctionPointer hands out _MtmlFaultyFunction wrappers for
+# the functions they name; without any, callers get the raw ctypes functions and pay nothing.
+# Installing or clearing faults republishes the function table (_mtmlDispatchRepublish),
+# which is how snapshots notice that the pointers they bound are stale (see mtmlPollInto).
+# random, fnmatch and queue are imported on first use, so importing pymtml does not pay for
+# these opt-in modes
+_mtmlFaults = ()
+_mtmlFaultRandom = None  # random.Random, created by the first mtmlFaultInject
+_mtmlFaultRelease = threading.Event()  # set to wake calls hung by a fault
+
+# sub-handle address (GPU, memory, VPU) -> address of the device it was opened on, so a
+# per-device fault also hits the calls made through its sub-handles
+_mtmlSubHandleOwners = dict()
+
+
+class MtmlFault(object):
+    """
+    A fault for calls to the MTML functions matching `api` (a name or a glob such as
+    "mtmlGpuGet*") on `device` (MtmlDevice, handle or None for every device), injected with
+    `probability` per call and at most `limit` times. An injected fault first sleeps
+    `latency` seconds, then with `hang` blocks until mtmlFaultClear() (or for `hang` seconds
+    if it is a number), then returns `code` without calling the library, or calls through
+    when `code` is None. `injected` counts the faults injected so far.
+    """
+
+    def __init__(
+        self,
+        api="*",
+        device=None,
+        code=None,
+        latency=0.0,
+        hang=False,
+        probability=1.0,
+        limit=None,
+    ):
+        self.api = api
+        if isinstance(device, MtmlDevice):
+            device = device.handle
+        self.address = cast(device, c_void_p).value if device is not None else None
+        self.code = code
+        self.latency = latency
+        self.hang = hang
+        self.probability = probability
+        self.limit = limit
+        self.injected = 0
+
+    def _matches(self, args):
+        if self.limit is not None and self.injected >= self.limit:
+            return False
+        if self.address is not None:
+            if not args:
+                return False
+            try:
+                address = cast(args[0], c_void_p).value
+            except ArgumentError:
+                return False
+            if address != self.address and (
+                _mtmlSubHandleOwners.get(address) != self.address
+            ):
+                return False
+        return self.probability >= 1.0 or _mtmlFaultRandom.random() < self.probability
+
+    def _inject(self, release):
+        self.injected += 1
+        if self.latency:
+            time.sleep(self.latency)
+        if self.hang is True:
+            release.wait()
+        elif self.hang:
+            release.wait(self.hang)
+        return self.code
+
+    def __repr__(self):
+        return "MtmlFault(api=%r, code=%r, latency=%r, hang=%r, injected=%d)" % (
+            self.api,
+            self.code,
+            self.latency,
+            self.hang,
+            self.injected,
+        )
+
+
+class _MtmlFaultyFunction(object):
+    __slots__ = ("name", "fn", "faults", "release")
+
+    def __init__(self, name, fn, faults, release):
+        self.name = name
+        self.fn = fn
+        self.faults = faults
+        self.release = release
+
+    def __call__(self, *args):
+        for fault in self.faults:
+            if fault._matches(args):
+                code = fault._inject(self.release)
+                if code is not None:
+                    return code
+                break
+        return self.fn(*args)
+
+
+def _mtmlFaultWrap(name, fn):
+    # only functions returning an MtmlReturn can carry an injected code
+    if not _mtmlFaults or name in _mtmlFunctionRestypes:
+        return fn
+    from fnmatch import fnmatchcase
+
+    faults = tuple(f for f in _mtmlFaults if fnmatchcase(name, f.api))
+    if not faults:
+        return fn
+    return _MtmlFaultyFunction(name, fn, faults, _mtmlFaultRelease)
+
+
+def mtmlFaultInject(*faults, seed=None):
+    """
+    Installs MtmlFault rules, replacing any installed before, and returns them. For each
+    call the first matching rule whose probability draw succeeds is injected. `seed` makes
+    the probability draws repeatable.
+    """
+    global _mtmlFaults, _mtmlFaultRelease, _mtmlFaultRandom
+
+    if _mtmlFaultRandom is None:
+        import random
+
+        _mtmlFaultRandom = random.Random()
+    if seed is not None:
+        _mtmlFaultRandom.seed(seed)
+    _mtmlFaultRelease.set()  # calls hung by the previous rules return
+    _mtmlFaultRelease = threading.Event()
+    _mtmlFaults = tuple(faults)
+    _mtmlDispatchRepublish()
+    return faults
+
+
+def mtmlFaultClear():
+    """Removes every fault and releases calls hung by one."""
+    global _mtmlFaults
+
+    _mtmlFaults = ()
+    _mtmlFaultRelease.set()
+    _mtmlDispatchRepublish()
+
+
+## Call watchdog ##
+# With the watchdog enabled, read-only calls on a device run on that device's worker thread
+# and the caller waits at most a deadline for them. A call that misses it returns
+# MTML_ERROR_TIMEOUT and quarantines the device: its calls fail fast with
+# MTML_ERROR_TIMEOUT for a backoff period that doubles with every further timeout, so one
+# hung board cannot stall a poller that also samples healthy devices. The worker stays
+# blocked in the hung call (its arguments kept alive) until the driver returns.
+MTML_WATCHDOG_APIS = ("mtml*Get*", "mtml*Count*")
+# library and system calls take the library or system handle, not a device: never watched
+_MTML_WATCHDOG_INLINE = ("mtmlLibrary", "mtmlSystem")
+
+_mtmlWatchdog = None  # the enabled _MtmlWatchdog, or None
+
+
+class MtmlWatchdogState(object):
+    """
+    Watchdog record of one device (keyed by native handle `address`): `timeouts` so far,
+    the current `backoff` in seconds and, while quarantined, `until` (time.monotonic()).
+    """
+
+    __slots__ = ("address", "timeouts", "backoff", "until", "worker", "stuck")
+
+    def __init__(self, address, backoff):
+        self.address = address
+        self.timeouts = 0
+        self.backoff = backoff
+        self.until = 0.0
+        self.worker = None
+        self.stuck = None  # the last call that timed out; hung while not done
+
+    @property
+    def quarantined(self):
+        return self.until > time.monotonic()
+
+    def __repr__(self):
+        return (
+            "MtmlWatchdogState(address=%#x, timeouts=%d, backoff=%.1f, quarantined=%s)"
+            % (
+                self.address,
+                self.timeouts,
+                self.backoff,
+                self.quarantined,
+            )
+        )
+
+
+class _MtmlWatchdogCall(object):
+    __slots__ = ("fn", "args", "ret", "done")
+
+    def __init__(self, fn, args):
+        self.fn = fn
+        self.args = args
+        self.ret = None
+        self.done = threading.Event()
+
+
+class _MtmlWatchdog(object):
+    def __init__(self, timeout, timeouts, backoff, maxBackoff, apis):
+        self.timeout = timeout
+        self.timeouts = timeouts
+        self.backoff = backoff
+        self.maxBackoff = maxBackoff
+        self.apis = apis
+        self.states = dict()  # device address -> MtmlWatchdogState
+        self.lock = threading.Lock()
+        self.stopped = False
+
+    def deadline(self, name):
+        from fnmatch import fnmatchcase
+
+        for pattern, timeout in self.timeouts.items():
+            if fnmatchcase(name, pattern):
+                return timeout
+        return self.timeout
+
+    def state(self, address):
+        state = self.states.get(address)
+        if state is None:
+            with self.lock:
+                state = self.states.get(address)
+                if state is None:
+                    import queue
+
+                    state = MtmlWatchdogState(address, self.backoff)
+                    state.worker = queue.SimpleQueue()
+                    threading.Thread(
+                        target=self._work,
+                        args=(state,),
+                        name="mtml-watchdog-%#x" % address,
+                        daemon=True,
+                    ).start()
+                    self.states[address] = state
+        return state
+
+    def _work(self, state):
+        queue = state.worker
+        while True:
+            call = queue.get()
+            if call is None:
+                return
+            try:
+                call.ret = call.fn(*call.args)
+            finally:
+                call.done.set()
+
+    def admit(self, state):
+        """Whether a call on `state`'s device may run, or must fail fast."""
+        if state.until > time.monotonic():
+            return False
+        stuck = state.stuck
+        if stuck is not None and not stuck.done.is_set():
+            # backoff expired but the hung call has not returned: stay in quarantine, which
+            # is not a new timeout
+            with self.lock:
+                state.until = time.monotonic() + state.backoff
+            return False
+        return True
+
+    def expire(self, state, call):
+        state.stuck = call
+        self.quarantine(state)
+
+    def answered(self, state):
+        if state.timeouts and state.backoff != self.backoff:
+            state.backoff = self.backoff  # answered in time again
+
+    def quarantine(self, state):
+        with self.lock:
+            state.timeouts += 1
+            state.until = time.monotonic() + state.backoff
+            state.backoff = min(state.backoff * 2.0, self.maxBackoff)
+
+    def stop(self):
+        self.stopped = True
+        for state in list(self.states.values()):
+            state.worker.put(None)
+
+
+class _MtmlWatchedFunction(object):
+    __slots__ = ("name", "fn", "watchdog", "deadline")
+
+    def __init__(self, name, fn, watchdog):
+        self.name = name
+        self.fn = fn
+        self.watchdog = watchdog
+        self.deadline = watchdog.deadline(name)
+
+    def __call__(self, *args):
+        watchdog = self.watchdog
+        try:
+            address = cast(args[0], c_void_p).value
+        except (IndexError, ArgumentError):
+            address = None
+        if address is None or watchdog.stopped:
+            return self.fn(*args)
+        state = watchdog.state(_mtmlSubHandleOwners.get(address, address))
+        if not watchdog.admit(state):
+            return MTML_ERROR_TIMEOUT
+        call = _MtmlWatchdogCall(self.fn, args)
+        state.worker.put(call)
+        if not call.done.wait(self.deadline):
+            watchdog.expire(state, call)
+            return MTML_ERROR_TIMEOUT
+        watchdog.answered(state)
+        return call.ret
+
+
+def _mtmlWatchdogWrap(name, fn):
+    watchdog = _mtmlWatchdog
+    if (
+        watchdog is None
+        or name in _mtmlFunctionRestypes
+        or name.startswith(_MTML_WATCHDOG_INLINE)
+    ):
+        return fn
+    from fnmatch import fnmatchcase
+
+    if not any(fnmatchcase(name, pattern) for pattern in watchdog.apis):
+        return fn
+    return _MtmlWatchedFunction(name, fn, watchdog)
+
+
+def _mtmlDispatchWrap(name, fn):
+    """`fn` (raw or wrapped) wrapped for the installed faults and the watchdog, if any."""
+    while isinstance(fn, (_MtmlFaultyFunction, _MtmlWatchedFunction)):
+        fn = fn.fn
+    # the watchdog goes outside, so an injected hang is cut off by its deadline
+    return _mtmlWatchdogWrap(name, _mtmlFaultWrap(name, fn))
+
+
+def _mtmlDispatchRepublish():
+    global _mtmlGetFunctionPointer_cache
+
+    with libLoadLock:
+        _mtmlGetFunctionPointer_cache = MappingProxyType(
+            {
+                name: _mtmlDispatchWrap(name, fn)
+                for name, fn in _mtmlGetFunctionPointer_cache.items()
+            }
+        )
+
+
+def mtmlWatchdogEnable(
+    timeout=1.0, timeouts=None, backoff=1.0, maxBackoff=60.0, apis=MTML_WATCHDOG_APIS
+):
+    """
+    Runs the MTML functions matching `apis` (globs; read-only queries by default) on
+    per-device worker threads with a deadline of `timeout` seconds, or of the first match in
+    `timeouts` ({glob: seconds}). A missed deadline returns MTML_ERROR_TIMEOUT and
+    quarantines the device for `backoff` seconds, doubling up to `maxBackoff` while it keeps
+    timing out. Library and system calls, and calls without a device or sub-handle
+    argument, run inline.
+    """
+    global _mtmlWatchdog
+
+    previous = _mtmlWatchdog
+    _mtmlWatchdog = _MtmlWatchdog(
+        timeout, dict(timeouts or {}), backoff, maxBackoff, tuple(apis)
+    )
+    _mtmlDispatchRepublish()
+    if previous is not None:
+        previous.stop()
+
+
+def mtmlWatchdogDisable():
+    """Calls run inline again; idle workers exit, hung ones when their call returns."""
+    global _mtmlWatchdog
+
+    previous, _mtmlWatchdog = _mtmlWatchdog, None
+    _mtmlDispatchRepublish()
+    if previous is not None:
+        previous.stop()
+
+
+def mtmlWatchdogStates():
+    """MtmlWatchdogState per device address the enabled watchdog has seen ({} if disabled)."""
+    watchdog = _mtmlWatchdog
+    return dict(watchdog.states) if watchdog is not None else {}
+
+
+def _mtmlDeviceLock(device):
+    """
+    Returns the lock that serializes state-changing calls on one device.
+    Keyed by the native handle address, so every handle to the same device shares it.
+    """
+    key = cast(device, c_void_p).value
+    lock = _mtmlDeviceLocks.get(key)
+    if lock is None:
+        with _mtmlDeviceLocksLock:
+            lock = _mtmlDeviceLocks.setdefault(key, threading.Lock())
+    return lock
+
+
 ## string/bytes conversion for ease of use
 def convertStrBytes(func):
     """
@@ -671,9 +1123,8 @@ def mtmlLibraryInit():
 
     # Atomically update refcount
     global _mtmlLib_refcount
-    libLoadLock.acquire()
-    _mtmlLib_refcount += 1
-    libLoadLock.release()
+    with _mtmlLib_refcountLock:
+        _mtmlLib_refcount += 1
     return None
 
 
@@ -692,20 +1143,19 @@ def mtmlLibraryShutDown():
     # Reset libHandle to a fresh instance to allow reinitialization
     # and prevent dangling references during garbage collection
     libHandle = c_mtmlLibrary_t()
+    _mtmlInvalidateDeviceHandles()
 
     # Atomically update refcount
     global _mtmlLib_refcount
-    libLoadLock.acquire()
-    if 0 < _mtmlLib_refcount:
-        _mtmlLib_refcount -= 1
-    libLoadLock.release()
+    with _mtmlLib_refcountLock:
+        if 0 < _mtmlLib_refcount:
+            _mtmlLib_refcount -= 1
     return None
 
 
 @convertStrBytes
 def mtmlErrorString(result):
     fn = _mtmlGetFunctionPointer("mtmlErrorString")
-    fn.restype = c_char_p  # otherwise return is an int
     ret = fn(result)
     return ret
 
@@ -766,6 +1216,7 @@ def mtmlDeviceInitMemory(device):
     fn = _mtmlGetFunctionPointer("mtmlDeviceInitMemory")
     ret = fn(device, byref(c_memory))
     _mtmlCheckReturn(ret)
+    _mtmlSubHandleOwners[cast(c_memory, c_void_p).value] = cast(device, c_void_p).value
     return c_memory
 
 
@@ -775,6 +1226,7 @@ def mtmlDeviceInitGpu(device):
     fn = _mtmlGetFunctionPointer("mtmlDeviceInitGpu")
     ret = fn(device, byref(c_gpu))
     _mtmlCheckReturn(ret)
+    _mtmlSubHandleOwners[cast(c_gpu, c_void_p).value] = cast(device, c_void_p).value
     return c_gpu
 
 
@@ -784,6 +1236,7 @@ def mtmlDeviceInitVpu(device):
     fn = _mtmlGetFunctionPointer("mtmlDeviceInitVpu")
     ret = fn(device, byref(c_vpu))
     _mtmlCheckReturn(ret)
+    _mtmlSubHandleOwners[cast(c_vpu, c_void_p).value] = cast(device, c_void_p).value
     return c_vpu
 
 
@@ -859,6 +1312,9 @@ def mtmlDeviceGetMtLinkState(device, linkIndex):
     fn = _mtmlGetFunctionPointer("mtmlDeviceGetMtLinkState")
     ret = fn(device, linkIndex, byref(c_mtLinkState))
     _mtmlCheckReturn(ret)
+    adjacency = _mtmlMtLinkAdjacency
+    if adjacency is not None:
+        adjacency.observe(device, linkIndex, c_mtLinkState.value)
     return c_mtLinkState.value
 
 
@@ -1014,6 +1470,7 @@ def mtmlDeviceFreeGpu(gpu):
     fn = _mtmlGetFunctionPointer("mtmlDeviceFreeGpu")
     ret = fn(gpu)
     _mtmlCheckReturn(ret)
+    _mtmlSubHandleOwners.pop(cast(gpu, c_void_p).value, None)
     return None
 
 
@@ -1021,6 +1478,7 @@ def mtmlDeviceFreeMemory(memory):
     fn = _mtmlGetFunctionPointer("mtmlDeviceFreeMemory")
     ret = fn(memory)
     _mtmlCheckReturn(ret)
+    _mtmlSubHandleOwners.pop(cast(memory, c_void_p).value, None)
     return None
 
 
@@ -1028,6 +1486,7 @@ def mtmlDeviceFreeVpu(vpu):
     fn = _mtmlGetFunctionPointer("mtmlDeviceFreeVpu")
     ret = fn(vpu)
     _mtmlCheckReturn(ret)
+    _mtmlSubHandleOwners.pop(cast(vpu, c_void_p).value, None)
     return None
 
 
@@ -1197,17 +1656,25 @@ def mtmlDeviceCountActiveVirtDevices(device):
     return c_count.value
 
 
-def mtmlDeviceGetActiveVirtDeviceUuids(device, entryLength, entryCount):
-    c_uuids = create_string_buffer(entryLength * entryCount)
+def mtmlDeviceGetActiveVirtDeviceUuids(device, entryLength, entryCount, buffer=None):
+    # A caller polling the same device can pass back a string buffer of at least
+    # entryLength * entryCount bytes instead of having one allocated per call.
+    size = entryLength * entryCount
+    if buffer is None or sizeof(buffer) < size:
+        c_uuids = create_string_buffer(size)
+    else:
+        c_uuids = buffer
+        memset(c_uuids, 0, size)
     fn = _mtmlGetFunctionPointer("mtmlDeviceGetActiveVirtDeviceUuids")
     ret = fn(device, c_uuids, c_uint(entryLength), c_uint(entryCount))
     _mtmlCheckReturn(ret)
     # Parse the buffer into a list of UUIDs
+    raw = string_at(c_uuids, size)
     uuids = []
     for i in range(entryCount):
-        uuid = c_uuids[i * entryLength : (i + 1) * entryLength].decode().rstrip("\x00")
+        uuid = raw[i * entryLength : (i + 1) * entryLength].split(b"\x00", 1)[0]
         if uuid:
-            uuids.append(uuid)
+            uuids.append(uuid.decode())
     return uuids
 
 
@@ -1414,7 +1881,11 @@ def mtmlLogGetConfiguration():
 ## MPC APIs
 def mtmlDeviceSetMpcMode(device, mode):
     fn = _mtmlGetFunctionPointer("mtmlDeviceSetMpcMode")
-    ret = fn(device, c_uint(mode))
+    with _mtmlDeviceLock(device):
+        ret = fn(device, c_uint(mode))
+    # every opaque pointer handed out by the library is invalid after reconfiguration
+    if ret == MTML_SUCCESS:
+        _mtmlInvalidateDeviceHandles()
     _mtmlCheckReturn(ret)
     return None
 
@@ -1479,7 +1950,11 @@ def mtmlDeviceGetMpcConfigurationByName(device, configName):
 
 def mtmlDeviceSetMpcConfiguration(device, configId):
     fn = _mtmlGetFunctionPointer("mtmlDeviceSetMpcConfiguration")
-    ret = fn(device, c_uint(configId))
+    with _mtmlDeviceLock(device):
+        ret = fn(device, c_uint(configId))
+    # every opaque pointer handed out by the library is invalid after reconfiguration
+    if ret == MTML_SUCCESS:
+        _mtmlInvalidateDeviceHandles()
     _mtmlCheckReturn(ret)
     return None
 
@@ -1615,7 +2090,8 @@ def mtmlDeviceGetCpuAffinityWithinNode(device, cpuSetSize):
 ## Device reset API
 def mtmlDeviceReset(device):
     fn = _mtmlGetFunctionPointer("mtmlDeviceReset")
-    ret = fn(device)
+    with _mtmlDeviceLock(device):
+        ret = fn(device)
     _mtmlCheckReturn(ret)
     return None
 
@@ -1681,700 +2157,800 @@ def mtmlLibrarySetMpcConfigurationInBatch(devices, mpcConfigIds):
     c_configIds = (c_uint * count)(*mpcConfigIds)
     fn = _mtmlGetFunctionPointer("mtmlLibrarySetMpcConfigurationInBatch")
     global libHandle
-    ret = fn(libHandle, c_uint(count), c_devices, c_configIds)
+    # take every device lock in address order so concurrent batches cannot deadlock
+    locks = sorted(
+        {cast(d, c_void_p).value: _mtmlDeviceLock(d) for d in devices}.items()
+    )
+    for _, lock in locks:
+        lock.acquire()
+    try:
+        ret = fn(libHandle, c_uint(count), c_devices, c_configIds)
+    finally:
+        for _, lock in reversed(locks):
+            lock.release()
+    if ret == MTML_SUCCESS:
+        _mtmlInvalidateDeviceHandles()
     _mtmlCheckReturn(ret)
     return None
 
 
-# nvml wrapper layer ###########################################################
-# NVML constants and types###########################################
-NVML_SUCCESS = MTML_SUCCESS
-NVML_ERROR_NOT_SUPPORTED = MTML_ERROR_NOT_SUPPORTED
-NVML_ERROR_UNINITIALIZED = MTML_ERROR_UNINITIALIZED
-NVML_ERROR_FUNCTION_NOT_FOUND = MTML_ERROR_FUNCTION_NOT_FOUND
-NVML_ERROR_INSUFFICIENT_SIZE = MTML_ERROR_INSUFFICIENT_SIZE
-NVML_ERROR_GPU_IS_LOST = MTML_ERROR_GPU_IS_LOST
-NVML_ERROR_LIBRARY_NOT_FOUND = MTML_ERROR_LIBRARY_NOT_FOUND
-NVML_ERROR_NO_PERMISSION = MTML_ERROR_NO_PERMISSION
-NVML_ERROR_NOT_FOUND = MTML_ERROR_NOT_FOUND
-NVML_ERROR_UNKNOWN = MTML_ERROR_UNKNOWN
-
-
-_nvmlClockType_t = c_uint
-NVML_CLOCK_GRAPHICS = 0
-NVML_CLOCK_SM = 1
-NVML_CLOCK_MEM = 2
-NVML_CLOCK_VIDEO = 3
-NVML_CLOCK_COUNT = 4
-
-_nvmlTemperatureSensors_t = c_uint
-NVML_TEMPERATURE_GPU = 0
-NVML_TEMPERATURE_COUNT = 1
-
-_nvmlDriverModel_t = c_uint
-NVML_DRIVER_WDDM = 0
-NVML_DRIVER_WDM = 1
-NVML_DRIVER_MCDM = 2
-
-_nvmlMemoryErrorType_t = c_uint
-NVML_MEMORY_ERROR_TYPE_CORRECTED = 0
-NVML_MEMORY_ERROR_TYPE_UNCORRECTED = 1
-NVML_MEMORY_ERROR_TYPE_COUNT = 2
-
-_nvmlEccCounterType_t = c_uint
-NVML_VOLATILE_ECC = 0
-NVML_AGGREGATE_ECC = 1
-NVML_ECC_COUNTER_TYPE_COUNT = 2
-
-_nvmlComputeMode_t = c_uint
-NVML_COMPUTEMODE_DEFAULT = 0
-NVML_COMPUTEMODE_EXCLUSIVE_THREAD = 1  ## Support Removed
-NVML_COMPUTEMODE_PROHIBITED = 2
-NVML_COMPUTEMODE_EXCLUSIVE_PROCESS = 3
-NVML_COMPUTEMODE_COUNT = 4
-
-_nvmlPcieUtilCounter_t = c_uint
-NVML_PCIE_UTIL_TX_BYTES = 0
-NVML_PCIE_UTIL_RX_BYTES = 1
-NVML_PCIE_UTIL_COUNT = 2
-
-NVML_NVLINK_MAX_LINKS = 18
-# NVLink Link Count
-NVML_FI_DEV_NVLINK_LINK_COUNT = 91
-
-# NVLink Throughput Counters
-NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_TX = 138  # NVLink TX Data throughput in KiB
-NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_RX = 139  # NVLink RX Data throughput in KiB
-NVML_FI_DEV_NVLINK_THROUGHPUT_RAW_TX = 140  # NVLink TX Data + protocol overhead in KiB
-NVML_FI_DEV_NVLINK_THROUGHPUT_RAW_RX = 141  # NVLink RX Data + protocol overhead in KiB
-
-# P2P Capability Index (maps to MtLink for MTML)
-_nvmlGpuP2PCapsIndex_t = c_uint
-NVML_P2P_CAPS_INDEX_READ = 0
-NVML_P2P_CAPS_INDEX_WRITE = 1
-NVML_P2P_CAPS_INDEX_NVLINK = 2  # Maps to MtLink for MTML
-NVML_P2P_CAPS_INDEX_ATOMICS = 3
-NVML_P2P_CAPS_INDEX_PROP = 4
-NVML_P2P_CAPS_INDEX_PCI = 4
-NVML_P2P_CAPS_INDEX_UNKNOWN = 5
-
-# P2P Status
-_nvmlGpuP2PStatus_t = c_uint
-NVML_P2P_STATUS_OK = 0
-NVML_P2P_STATUS_CHIPSET_NOT_SUPPORED = 1
-NVML_P2P_STATUS_CHIPSET_NOT_SUPPORTED = NVML_P2P_STATUS_CHIPSET_NOT_SUPPORED
-NVML_P2P_STATUS_GPU_NOT_SUPPORTED = 2
-NVML_P2P_STATUS_IOH_TOPOLOGY_NOT_SUPPORTED = 3
-NVML_P2P_STATUS_DISABLED_BY_REGKEY = 4
-NVML_P2P_STATUS_NOT_SUPPORTED = 5
-NVML_P2P_STATUS_UNKNOWN = 6
-
-# GPU Topology Level
-_nvmlGpuTopologyLevel_t = c_uint
-NVML_TOPOLOGY_INTERNAL = 0
-NVML_TOPOLOGY_SINGLE = 10
-NVML_TOPOLOGY_MULTIPLE = 20
-NVML_TOPOLOGY_HOSTBRIDGE = 30
-NVML_TOPOLOGY_NODE = 40  # NVML calls this NODE
-NVML_TOPOLOGY_SYSTEM = 50
-
-_nvmlValueType_t = c_uint
-NVML_VALUE_TYPE_DOUBLE = 0
-NVML_VALUE_TYPE_UNSIGNED_INT = 1
-NVML_VALUE_TYPE_UNSIGNED_LONG = 2
-NVML_VALUE_TYPE_UNSIGNED_LONG_LONG = 3
-NVML_VALUE_TYPE_SIGNED_LONG_LONG = 4
-NVML_VALUE_TYPE_SIGNED_INT = 5
-NVML_VALUE_TYPE_UNSIGNED_SHORT = 6
-NVML_VALUE_TYPE_COUNT = 7
-
-NVMLError_FunctionNotFound: _TypeAlias = MTMLError_FunctionNotFound
-NVMLError_GpuIsLost: _TypeAlias = MTMLError_GpuIsLost
-NVMLError_InvalidArgument: _TypeAlias = MTMLError_NotFound
-NVMLError_LibraryNotFound: _TypeAlias = MTMLError_LibraryNotFound
-NVMLError_NoPermission: _TypeAlias = MTMLError_NoPermission
-NVMLError_NotFound: _TypeAlias = MTMLError_NotFound
-NVMLError_NotSupported: _TypeAlias = MTMLError_NotSupported
-NVMLError_Unknown: _TypeAlias = MTMLError_Unknown
-
-c_nvmlFieldValue_t = c_mtmlFieldValue_t
-c_nvmlDevice_t = c_mtmlDevice_t
-
-
-@dataclass(frozen=True)
-class NVMLMemoryInfo:
-    total: int
-    free: int
-    used: int
-
-
-@dataclass(frozen=True)
-class NVMLUtilization:
-    gpu: int
-    memory: int
-
-
-class NVMLError(MTMLError):
-    def __new__(typ, value):
-        obj = super().__new__(MTMLError, value)
-
-        if not isinstance(obj, NVMLError):
-            obj.__class__ = NVMLError
-
-        return obj
-
-
-def nvmlStructToFriendlyObject(struct):
-    return mtmlStructToFriendlyObject(struct)
-
-
-def nvmlInit():
-    return nvmlInitWithFlags(0)
-
-
-def nvmlInitWithFlags(flags):
-    return mtmlLibraryInit()
-
-
-def nvmlShutdown():
-    return mtmlLibraryShutDown()
-
-
-def nvmlExceptionClass(nvmlErrorCode):
-    if nvmlErrorCode not in NVMLError._valClassMapping:
-        raise ValueError("nvmlErrorCode %s is not valid" % nvmlErrorCode)
-    return NVMLError._valClassMapping[nvmlErrorCode]
-
-
-def nvmlSystemGetDriverVersion():
-    c_system = mtmlLibraryInitSystem()
-    return mtmlSystemGetDriverVersion(c_system)
-
-
-def nvmlDeviceGetCount():
-    return mtmlLibraryCountDevice()
-
-
-def nvmlDeviceGetHandleByIndex(index):
-    return mtmlLibraryInitDeviceByIndex(index)
+## Device registry
+class MtmlDevice(object):
+    """
+    Hashable identity of a physical device.
 
+    Raw handles are ctypes pointers without value equality, so two handles to the same GPU
+    compare unequal. MtmlDevice compares and hashes by UUID and carries the index, PCI SBDF,
+    native handle address and the handle itself for passing back into mtml* calls.
+    """
 
-def nvmlDeviceGetHandleByUuid(uuid):
-    return mtmlLibraryInitDeviceByUuid(uuid)
+    __slots__ = ("index", "uuid", "sbdf", "address", "handle")
 
+    def __init__(self, index, uuid, sbdf, handle):
+        self.index = index
+        self.uuid = uuid
+        self.sbdf = sbdf
+        self.handle = handle
+        self.address = cast(handle, c_void_p).value
 
-def nvmlDeviceGetHandleByPciBusId(pciBusId):
-    return mtmlLibraryInitDeviceByPciSbdf(pciBusId)
+    def __eq__(self, other):
+        if not isinstance(other, MtmlDevice):
+            return NotImplemented
+        return self.uuid == other.uuid
+
+    def __hash__(self):
+        return hash(self.uuid)
+
+    def __repr__(self):
+        return "MtmlDevice(index=%d, uuid=%r, sbdf=%r)" % (
+            self.index,
+            self.uuid,
+            self.sbdf,
+        )
 
 
-def nvmlDeviceGetIndex(device):
-    return mtmlDeviceGetIndex(device)
+def _mtmlNormalizeSbdf(sbdf):
+    # "0000:3b:00.0", "00000000:3B:00.0" and "3b:00.0" all name the same function
+    parts = sbdf.strip().lower().split(":")
+    if len(parts) == 2:
+        parts.insert(0, "0")
+    try:
+        parts[0] = "%08x" % int(parts[0], 16)
+    except ValueError:
+        pass
+    return ":".join(parts)
 
 
-def nvmlDeviceGetName(device):
-    return mtmlDeviceGetName(device)
+class MtmlDeviceRegistry(object):
+    """
+    Index, UUID, PCI SBDF and native handle address of every device, each mapped to its
+    MtmlDevice in a dict so lookups in any direction are O(1) and issue no driver calls.
+    """
 
+    def __init__(self, devices):
+        self.devices = tuple(devices)
+        self._byIndex = {d.index: d for d in self.devices}
+        self._byUuid = {d.uuid: d for d in self.devices}
+        self._bySbdf = {_mtmlNormalizeSbdf(d.sbdf): d for d in self.devices if d.sbdf}
+        self._byAddress = {d.address: d for d in self.devices}
 
-def nvmlDeviceGetUUID(device):
-    return mtmlDeviceGetUUID(device)
+    def __len__(self):
+        return len(self.devices)
 
+    def __iter__(self):
+        return iter(self.devices)
 
-def nvmlDeviceGetPciInfo(device):
-    return mtmlDeviceGetPciInfo(device)
+    def byIndex(self, index):
+        try:
+            return self._byIndex[index]
+        except KeyError:
+            raise MTMLError(MTML_ERROR_NOT_FOUND)
 
+    def byUuid(self, uuid):
+        try:
+            return self._byUuid[uuid]
+        except KeyError:
+            raise MTMLError(MTML_ERROR_NOT_FOUND)
 
-def nvmlDeviceGetSerial(device):
-    return mtmlDeviceGetSerialNumber(device)
+    def bySbdf(self, sbdf):
+        try:
+            return self._bySbdf[_mtmlNormalizeSbdf(sbdf)]
+        except KeyError:
+            raise MTMLError(MTML_ERROR_NOT_FOUND)
 
+    def byHandle(self, handle):
+        address = cast(handle, c_void_p).value
+        device = self._byAddress.get(address)
+        if device is None:
+            # The library may hand out another pointer for the same device (e.g. the remote end
+            # of an MtLink); resolve it once by UUID and remember the alias.
+            device = self.byUuid(mtmlDeviceGetUUID(handle))
+            self._byAddress[address] = device
+        return device
 
-def nvmlDeviceGetMemoryInfo(device):
-    handle = mtmlDeviceInitMemory(device)
-    total = mtmlMemoryGetTotal(handle)
-    used = mtmlMemoryGetUsed(handle)
-    return NVMLMemoryInfo(total=total, free=(total - used), used=used)
 
+_mtmlDeviceRegistry = None
+_mtmlDeviceRegistryLock = threading.Lock()
 
-def nvmlDeviceGetUtilizationRates(device):
-    gpu = mtmlGpuGetUtilization(device)
-    memory = mtmlMemoryGetUtilization(device)
-    return NVMLUtilization(gpu=gpu, memory=memory)
 
+def mtmlGetDeviceRegistry():
+    """
+    Returns the registry of all devices, enumerating them on first use after mtmlLibraryInit.
+    The registry is dropped by mtmlLibraryShutDown and by MPC reconfiguration, which invalidate
+    every device handle.
+    """
+    global _mtmlDeviceRegistry
 
-def nvmlDeviceGetClockInfo(device, type):
-    if type == NVML_CLOCK_GRAPHICS or type == NVML_CLOCK_SM:
-        return mtmlGpuGetClock(device)
-    elif type == NVML_CLOCK_VIDEO:
-        return mtmlVpuGetClock(device)
-    elif type == NVML_CLOCK_MEM:
-        return mtmlMemoryGetClock(device)
-    else:
-        return 0
+    registry = _mtmlDeviceRegistry
+    if registry is not None:
+        return registry
 
+    with _mtmlDeviceRegistryLock:
+        if _mtmlDeviceRegistry is None:
+            devices = []
+            for index in range(mtmlLibraryCountDevice()):
+                handle = mtmlLibraryInitDeviceByIndex(index)
+                try:
+                    sbdf = mtmlDeviceGetPciInfo(handle).sbdf
+                except MTMLError:
+                    sbdf = None
+                devices.append(
+                    MtmlDevice(index, mtmlDeviceGetUUID(handle), sbdf, handle)
+                )
+            _mtmlDeviceRegistry = MtmlDeviceRegistry(devices)
+        return _mtmlDeviceRegistry
 
-def nvmlDeviceGetMaxClockInfo(device, type):
-    if type == NVML_CLOCK_GRAPHICS or type == NVML_CLOCK_SM:
-        return mtmlGpuGetMaxClock(device)
-    elif type == NVML_CLOCK_VIDEO:
-        return mtmlVpuGetMaxClock(device)
-    elif type == NVML_CLOCK_MEM:
-        return mtmlMemoryGetMaxClock(device)
-    else:
-        return 0
 
+def _mtmlInvalidateDeviceHandles():
+    global _mtmlDeviceRegistry
+    _mtmlDeviceRegistry = None
+    # a later init may reuse these addresses for sub-handles of other devices
+    _mtmlSubHandleOwners.clear()
+    mtmlMtLinkInvalidate()
 
-def nvmlDeviceGetTemperature(device, type):
-    return mtmlGpuGetTemperature(device)
 
+## MtLink adjacency
+class MtmlMtLinkAdjacency(object):
+    """
+    Which devices each device reaches over one MtLink hop, from a single walk of every
+    device's links (spec, state, remote device). peers[k] is a bitmask of registry positions
+    reached by the k-th registry device over links that were up. Pairs the walk does not
+    connect are checked the way nvmlDeviceGetP2PStatus always has (same board topology
+    level, then mtmlDeviceCountMtLinkLayouts) on first use and remembered.
+    """
 
-def nvmlDeviceGetPowerUsage(device):
-    return mtmlDeviceGetPowerUsage(device)
+    def __init__(self, registry):
+        self.registry = registry
+        self._position = {d.uuid: k for k, d in enumerate(registry.devices)}
+        self.peers = [0] * len(registry)
+        self._states = {}  # (handle address, link) -> state at build time
+        self._links = []  # (handle, link) whose state was read
+        self._fallback = {}  # (position, position) -> connected
+        self.expires = time.monotonic() + MTML_MTLINK_REVALIDATE_SECONDS
+        for k, device in enumerate(registry.devices):
+            try:
+                linkNum = mtmlDeviceGetMtLinkSpec(device.handle).linkNum
+            except MTMLError:
+                continue
+            for link in range(linkNum):
+                try:
+                    state = mtmlDeviceGetMtLinkState(device.handle, link)
+                    self._states[(device.address, link)] = state
+                    self._links.append((device.handle, link))
+                    if state != MTML_MTLINK_STATE_UP:
+                        continue
+                    remote = registry.byHandle(
+                        mtmlDeviceGetMtLinkRemoteDevice(device.handle, link)
+                    )
+                except MTMLError:
+                    continue
+                self.peers[k] |= 1 << self._position[remote.uuid]
+
+    def position(self, device):
+        """Registry position of an index, UUID, MtmlDevice or handle."""
+        if isinstance(device, int):
+            device = self.registry.byIndex(device)
+        elif isinstance(device, str):
+            device = self.registry.byUuid(device)
+        elif not isinstance(device, MtmlDevice):
+            device = self.registry.byHandle(device)
+        return self._position[device.uuid]
+
+    def observe(self, device, link, state):
+        """Drops this adjacency if `state` differs from the state it was built with."""
+        seen = self._states.get((cast(device, c_void_p).value, link))
+        if seen is not None and seen != state:
+            mtmlMtLinkInvalidate()
+
+    def revalidate(self):
+        """
+        Re-reads the state of every link the walk saw up or down, one call per link; a
+        changed state drops the adjacency through observe().
+        """
+        self.expires = time.monotonic() + MTML_MTLINK_REVALIDATE_SECONDS
+        for handle, link in self._links:
+            try:
+                mtmlDeviceGetMtLinkState(handle, link)
+            except MTMLError:
+                pass
 
+    def _connected(self, i, j):
+        if self.peers[i] >> j & 1:
+            return True
+        connected = self._fallback.get((i, j))
+        if connected is None:
+            a = self.registry.devices[i].handle
+            b = self.registry.devices[j].handle
+            connected = False
+            try:
+                connected = mtmlDeviceGetTopologyLevel(a, b) == MTML_TOPOLOGY_INTERNAL
+            except MTMLError:
+                pass
+            if not connected:
+                try:
+                    connected = mtmlDeviceCountMtLinkLayouts(a, b) > 0
+                except MTMLError:
+                    pass
+            self._fallback[(i, j)] = connected
+        return connected
+
+    def connected(self, a, b):
+        """Whether `a` reaches `b` over one MtLink hop."""
+        return self._connected(self.position(a), self.position(b))
+
+    def isFullMesh(self, devices):
+        """Whether every device in `devices` reaches every later one in one hop."""
+        positions = [self.position(d) for d in devices]
+        for n, i in enumerate(positions):
+            want = 0
+            for j in positions[n + 1 :]:
+                want |= 1 << j
+            missing = want & ~self.peers[i]
+            while missing:
+                j = (missing & -missing).bit_length() - 1
+                missing &= missing - 1
+                if not self._connected(i, j):
+                    return False
+        return True
+
+
+# an adjacency older than this re-reads its link states on the next lookup
+MTML_MTLINK_REVALIDATE_SECONDS = 1.0
+
+_mtmlMtLinkAdjacency = None
+_mtmlMtLinkAdjacencyLock = threading.Lock()
+_mtmlMtLinkGeneration = 0  # bumped by every invalidation
+
+
+def mtmlGetMtLinkAdjacency():
+    """
+    The MtLink adjacency of all devices, built on first use. It is dropped when the device
+    registry is, by mtmlMtLinkInvalidate(), and as soon as any mtmlDeviceGetMtLinkState call
+    returns a state other than the one the adjacency was built with. Lookups more than
+    MTML_MTLINK_REVALIDATE_SECONDS after the last check re-read the link states first, so a
+    link going down is noticed even when nothing else reads it.
+    """
+    global _mtmlMtLinkAdjacency
+
+    adjacency = _mtmlMtLinkAdjacency
+    if adjacency is not None:
+        if time.monotonic() < adjacency.expires:
+            return adjacency
+        adjacency.revalidate()
+        adjacency = _mtmlMtLinkAdjacency
+        if adjacency is not None:
+            return adjacency
+    registry = mtmlGetDeviceRegistry()
+    with _mtmlMtLinkAdjacencyLock:
+        while _mtmlMtLinkAdjacency is None:
+            generation = _mtmlMtLinkGeneration
+            adjacency = MtmlMtLinkAdjacency(registry)
+            # an invalidation during the walk may have seen a state the walk missed
+            if generation == _mtmlMtLinkGeneration:
+                _mtmlMtLinkAdjacency = adjacency
+        return _mtmlMtLinkAdjacency
+
+
+def mtmlMtLinkInvalidate():
+    global _mtmlMtLinkAdjacency, _mtmlMtLinkGeneration
+    _mtmlMtLinkGeneration += 1
+    _mtmlMtLinkAdjacency = None
+
+
+def mtmlIsFullMtLink(device_ids):
+    """
+    Whether the devices in `device_ids` (indexes, UUIDs, MtmlDevices or handles) are fully
+    connected by one-hop MtLinks: the check sglang's is_full_nvlink makes pair by pair with
+    nvmlDeviceGetP2PStatus(NVML_P2P_CAPS_INDEX_NVLINK), answered from the cached adjacency
+    with a few bitmask operations per device.
+    """
+    return mtmlGetMtLinkAdjacency().isFullMesh(device_ids)
 
-# cannot expose this function directly since _nvmlGetFunctionPointer will retrive the function pointer from the mtml library directly.
-# it will cause a MTMLError_FunctionNotFound exception when we get nvml function pointer from the mtml library.
-# def _nvmlGetFunctionPointer(name):
-#     return _mtmlGetFunctionPointer(name)
 
+## Snapshot polling
+class c_mtmlTimespec_t(Structure):
+    _fields_ = [("tv_sec", c_long), ("tv_nsec", c_long)]
 
-def nvmlDeviceGetFanSpeed(device):
-    try:
-        return mtmlDeviceGetFanSpeed(device, 0)
-    except MTMLError:
-        return 0
 
+# name, C type, handle the getter takes ("device", "gpu", "memory" or "vpu"), MTML getter
+_MTML_SNAPSHOT_METRICS = (
+    ("gpuUtil", c_uint, "gpu", "mtmlGpuGetUtilization"),
+    ("gpuClock", c_uint, "gpu", "mtmlGpuGetClock"),
+    ("temperature", c_int, "gpu", "mtmlGpuGetTemperature"),
+    ("memoryUtil", c_uint, "memory", "mtmlMemoryGetUtilization"),
+    ("memoryTotal", c_ulonglong, "memory", "mtmlMemoryGetTotal"),
+    ("memoryUsed", c_ulonglong, "memory", "mtmlMemoryGetUsed"),
+    ("memoryClock", c_uint, "memory", "mtmlMemoryGetClock"),
+    ("powerUsage", c_uint, "device", "mtmlDeviceGetPowerUsage"),
+    ("vpuClock", c_uint, "vpu", "mtmlVpuGetClock"),
+)
+# encodeUtil and decodeUtil both come from one mtmlVpuGetUtilization call and share a status
+MTML_SNAPSHOT_METRICS = tuple(m[0] for m in _MTML_SNAPSHOT_METRICS) + (
+    "encodeUtil",
+    "decodeUtil",
+)
+_MTML_SNAPSHOT_STATUS_SLOTS = len(_MTML_SNAPSHOT_METRICS) + 1
 
-def nvmlDeviceGetFanSpeed_v2(device, fan):
-    try:
-        return mtmlDeviceGetFanSpeed(device, fan)
-    except MTMLError:
-        return 0
 
+def _mtmlSnapshotStatusColumn(metric):
+    if metric in ("encodeUtil", "decodeUtil"):
+        return len(_MTML_SNAPSHOT_METRICS)
+    return MTML_SNAPSHOT_METRICS.index(metric)
 
-def nvmlDeviceGetBAR1MemoryInfo(device):
-    # Not Support
-    return "N/A"
 
+# bool(status code) byte -> success flag byte
+_MTML_SNAPSHOT_FAILED_TO_VALID = bytes.maketrans(b"\x00\x01", b"\x01\x00")
 
-def nvmlDeviceGetEncoderUtilization(device):
-    try:
-        vpu = mtmlDeviceInitVpu(device)
-        util = mtmlVpuGetUtilization(vpu)
-        return [util.encodeUtil, 0]  # samplingPeriodUs not available
-    except MTMLError:
-        return [0, 0]
 
+def mtmlSnapshotValid(status, metric, rows, start=0):
+    """
+    Whether the read of `metric` succeeded, as bytes holding 1 or 0 per device row, for `rows`
+    rows starting at `start` of `status`: MtmlSnapshot.buffer.status, or a copy laid out like
+    it. MTML_SUCCESS is 0, so the flags come from one strided slice without a per-row loop.
+    """
+    stride = _MTML_SNAPSHOT_STATUS_SLOTS
+    first = start * stride + _mtmlSnapshotStatusColumn(metric)
+    codes = status[first : (start + rows) * stride : stride]
+    return bytes(map(bool, codes)).translate(_MTML_SNAPSHOT_FAILED_TO_VALID)
 
-def nvmlDeviceGetDecoderUtilization(device):
-    try:
-        vpu = mtmlDeviceInitVpu(device)
-        util = mtmlVpuGetUtilization(vpu)
-        return [util.decodeUtil, 0]  # samplingPeriodUs not available
-    except MTMLError:
-        return [0, 0]
 
+_CLOCK_REALTIME = 0
+try:
+    _clock_gettime = CDLL(None).clock_gettime
+except (OSError, AttributeError, TypeError):
+    # Windows: CDLL(None) raises TypeError; mtmlPollInto falls back to time.time_ns()
+    _clock_gettime = None
 
-def nvmlSystemGetCudaDriverVersion():
-    # Not Support
-    return 0
 
+def _mtmlSnapshotStruct(count):
+    class c_mtmlSnapshot_t(Structure):
+        _fields_ = [(m[0], m[1] * count) for m in _MTML_SNAPSHOT_METRICS] + [
+            ("encodeUtil", c_uint * count),
+            ("decodeUtil", c_uint * count),
+            ("status", c_uint * (count * _MTML_SNAPSHOT_STATUS_SLOTS)),
+            ("timestamp", c_mtmlTimespec_t),
+        ]
 
-def nvmlDeviceGetDisplayMode(device):
-    # Not Support
-    return 0
+    return c_mtmlSnapshot_t
 
 
-def nvmlDeviceGetCurrentDriverModel(device):
-    # Not Support
-    return 3
+_c_mtmlSnapshotDevice_t = _mtmlSnapshotStruct(1)
 
 
-def nvmlDeviceGetPersistenceMode(device):
-    # Not Support
-    return 0
+class MtmlSnapshotDevice(object):
+    """
+    View of one device's slot in an MtmlSnapshot. Attribute reads go straight to the shared
+    buffer, so a view stays current across polls. status(metric) is the MtmlReturn code of the
+    last read of that metric.
+    """
 
+    __slots__ = ("_buffer", "_slot", "handle")
 
-def nvmlDeviceGetPerformanceState(device):
-    # Not Support
-    return "N/A"
+    def __init__(self, buffer, slot, handle):
+        self._buffer = buffer
+        self._slot = slot
+        self.handle = handle
 
+    def status(self, metric):
+        column = _mtmlSnapshotStatusColumn(metric)
+        return self._buffer.status[self._slot * _MTML_SNAPSHOT_STATUS_SLOTS + column]
 
-def nvmlDeviceGetTotalEccErrors(device, errorType, counterType):
-    try:
-        memory = mtmlDeviceInitMemory(device)
-        return mtmlMemoryGetEccErrorCounter(
-            memory, errorType, counterType, MTML_MEMORY_LOCATION_DRAM
+    def __repr__(self):
+        return "MtmlSnapshotDevice(%s)" % ", ".join(
+            "%s=%s" % (m, getattr(self, m)) for m in MTML_SNAPSHOT_METRICS
         )
-    except MTMLError:
-        return 0
-
-
-def nvmlDeviceGetPowerManagementLimit(device):
-    # Not Support
-    return 0
-
-
-def nvmlDeviceGetPcieThroughput(device, type):
-    # Not Support
-    return 0
-
 
-def nvmlDeviceGetFieldValues(handle, fieldIds):
-    # Not Support
-    return []
 
+def _snapshotColumn(name):
+    def get(self):
+        return getattr(self._buffer, name)[self._slot]
 
-def nvmlDeviceGetDisplayActive(device):
-    # not support
-    return 0
+    return property(get)
 
 
-def nvmlDeviceGetComputeMode(device):
-    # not support
-    return 5
+for _name in MTML_SNAPSHOT_METRICS:
+    setattr(MtmlSnapshotDevice, _name, _snapshotColumn(_name))
+del _name
 
 
-def nvmlDeviceGetCudaComputeCapability(device):
+class MtmlSnapshot(object):
     """
-    Get MUSA (Meta-computing Unified System Architecture) compute capability
-    for Moore Threads GPU. Returns (major, minor) tuple.
+    Preallocated telemetry for a fixed set of devices, overwritten in place by mtmlPollInto().
 
-    Uses torch.musa.get_device_capability via torchada (torch + torch_musa)
-    to get the correct MUSA capability.
+    All values live in one ctypes structure holding an array per metric with one slot per
+    device, plus the per-metric return codes and the poll timestamp. The GPU, memory and VPU
+    sub-handles, function pointers and byref() arguments are built once here, so a steady-state
+    poll allocates no Python objects. Like any device handle, a snapshot is invalid after
+    mtmlLibraryShutDown or MPC reconfiguration; call close() and build a new one.
     """
-    try:
-        import torch
-        import torch_musa
-
-        # Get device index from the device handle
-        # We need to find which device index this handle corresponds to
-        device_count = mtmlLibraryCountDevice()
-        for idx in range(device_count):
-            handle = mtmlLibraryInitDeviceByIndex(idx)
-            if mtmlDeviceGetUUID(handle) == mtmlDeviceGetUUID(device):
-                major, minor = torch.musa.get_device_capability(idx)
-                return (major, minor)
-        # If no match found, try device 0
-        major, minor = torch.musa.get_device_capability(0)
-        return (major, minor)
-    except ImportError:
-        # torch or torch_musa not available
-        return (0, 0)
-    except Exception:
-        return (0, 0)
-
-
-def nvmlDeviceIsMigDeviceHandle(device):
-    # not support
-    return 0
-
-
-def nvmlDeviceGetMigMode(device):
-    # Not Support
-    # [currentMode, pendingMode]
-    return [0, 0]
-
-
-def nvmlDeviceGetComputeRunningProcesses(device):
-    # Not Support
-    return []
-
-
-def nvmlDeviceGetGraphicsRunningProcesses(device):
-    # Not Support
-    return []
-
-
-def nvmlDeviceGetProcessUtilization(device, timeStamp):
-    # Not Support
-    return []
-
-
-def nvmlDeviceGetMaxMigDeviceCount(device):
-    # Not Support
-    return 0
-
-
-def nvmlDeviceGetMigDeviceHandleByIndex(device, index):
-    # Not Support
-    return "N/A"
-
-
-def nvmlDeviceGetDeviceHandleFromMigDeviceHandle(device):
-    # Not Support
-    return "N/A"
-
-
-def nvmlDeviceGetGpuInstanceId(device):
-    # Not Support
-    return 0
 
+    def __init__(self, devices=None):
+        if devices is None:
+            devices = mtmlGetDeviceRegistry().devices
+        self.handles = [d.handle if isinstance(d, MtmlDevice) else d for d in devices]
+        self.buffer = _mtmlSnapshotStruct(len(self.handles))()
+        self.devices = [
+            MtmlSnapshotDevice(self.buffer, i, h) for i, h in enumerate(self.handles)
+        ]
+        self._timestampRef = byref(self.buffer.timestamp)
+        self._subHandles = []
+        self._calls = []
+        self._callNames = []
+        self._codecCalls = []
+        self._outstanding = {}  # slot -> watched poll job that missed its deadline
+
+        status = self.buffer.status
+        for i, handle in enumerate(self.handles):
+            owners = {"device": handle}
+            for kind, init, free in (
+                ("gpu", mtmlDeviceInitGpu, mtmlDeviceFreeGpu),
+                ("memory", mtmlDeviceInitMemory, mtmlDeviceFreeMemory),
+                ("vpu", mtmlDeviceInitVpu, mtmlDeviceFreeVpu),
+            ):
+                try:
+                    owners[kind] = init(handle)
+                    self._subHandles.append((free, owners[kind], i))
+                except MTMLError as e:
+                    owners[kind] = e.value
+
+            base = i * _MTML_SNAPSHOT_STATUS_SLOTS
+            for column, (name, ctype, kind, fn_name) in enumerate(
+                _MTML_SNAPSHOT_METRICS
+            ):
+                owner = owners[kind]
+                if isinstance(owner, int):
+                    # sub-handle unavailable: report its error for every poll
+                    status[base + column] = owner
+                    continue
+                ref = byref(getattr(self.buffer, name), i * sizeof(ctype))
+                self._calls.append(
+                    (_mtmlGetFunctionPointer(fn_name), owner, ref, base + column)
+                )
+                self._callNames.append(fn_name)
+
+            column = len(_MTML_SNAPSHOT_METRICS)
+            if isinstance(owners["vpu"], int):
+                status[base + column] = owners["vpu"]
+            else:
+                scratch = c_mtmlCodecUtil_t()
+                self._codecCalls.append(
+                    (
+                        _mtmlGetFunctionPointer("mtmlVpuGetUtilization"),
+                        owners["vpu"],
+                        byref(scratch),
+                        scratch,
+                        base + column,
+                        i,
+                    )
+                )
+        # the function table these pointers came from; mtmlPollInto rebinds when it changes
+        self._dispatch = _mtmlGetFunctionPointer_cache
+        self._watchGroups = self._groupForWatchdog()
+
+    def _rebind(self):
+        self._calls = [
+            (_mtmlGetFunctionPointer(name),) + call[1:]
+            for name, call in zip(self._callNames, self._calls)
+        ]
+        self._codecCalls = [
+            (_mtmlGetFunctionPointer("mtmlVpuGetUtilization"),) + call[1:]
+            for call in self._codecCalls
+        ]
+        self._dispatch = _mtmlGetFunctionPointer_cache
+        self._watchGroups = self._groupForWatchdog()
+
+    def _groupForWatchdog(self):
+        # one _MtmlSnapshotGroup per device, with the watchdog's wrapper removed, so each
+        # device's reads go to its worker as one job
+        if _mtmlWatchdog is None:
+            return None
+        groups = {}
+
+        def group(i):
+            g = groups.get(i)
+            if g is None:
+                g = groups[i] = _MtmlSnapshotGroup(
+                    i, cast(self.handles[i], c_void_p).value
+                )
+            return g
+
+        for fn, handle, ref, slot in self._calls:
+            i, column = divmod(slot, _MTML_SNAPSHOT_STATUS_SLOTS)
+            g = group(i)
+            name = _MTML_SNAPSHOT_METRICS[column][0]
+            target = getattr(g.scratch, name)
+            g.calls.append((_mtmlUnwatched(fn), handle, byref(target), column))
+            g.copies.append((getattr(self.buffer, name), target, column))
+        for fn, handle, ref, scratch, slot, i in self._codecCalls:
+            g = group(i)
+            column = slot - i * _MTML_SNAPSHOT_STATUS_SLOTS
+            codec = c_mtmlCodecUtil_t()
+            g.codecCalls.append(
+                (_mtmlUnwatched(fn), handle, byref(codec), codec, column, 0)
+            )
+            g.copies.append((self.buffer.encodeUtil, g.scratch.encodeUtil, column))
+            g.copies.append((self.buffer.decodeUtil, g.scratch.decodeUtil, column))
+        return list(groups.values())
+
+    def __len__(self):
+        return len(self.devices)
+
+    def __iter__(self):
+        return iter(self.devices)
+
+    def __getitem__(self, slot):
+        return self.devices[slot]
+
+    @property
+    def timestamp(self):
+        """Wall-clock time of the last poll in seconds, 0.0 before the first poll."""
+        ts = self.buffer.timestamp
+        return ts.tv_sec + ts.tv_nsec * 1e-9
+
+    def column(self, metric):
+        """
+        The ctypes array holding `metric` for every device. It supports the buffer protocol,
+        so numpy.asarray() or memoryview() view the live values without copying.
+        """
+        return getattr(self.buffer, metric)
+
+    def _arrowColumns(self):
+        import pymtml_arrow
+
+        index = getattr(self, "_deviceIndex", None)
+        if index is None:
+            index = self._deviceIndex = (c_int32 * len(self))(*range(len(self)))
+        uuids = [mtmlDeviceGetUUID(h) for h in self.handles]
+        # the poll time and the validity are taken as of the export; values stay live views
+        ts = self.buffer.timestamp
+        stamp = (c_int64 * len(self))(
+            *[ts.tv_sec * 1000000000 + ts.tv_nsec] * len(self)
+        )
+        columns = [
+            pymtml_arrow.ArrowColumn(
+                "timestamp",
+                c_int64,
+                stamp,
+                format=pymtml_arrow.ARROW_TIMESTAMP_NS_UTC,
+            ),
+            pymtml_arrow.ArrowColumn("device", c_int32, index, dictionary=uuids),
+        ]
+        for metric in MTML_SNAPSHOT_METRICS:
+            array = self.column(metric)
+            valid = mtmlSnapshotValid(self.buffer.status, metric, len(self))
+            columns.append(
+                pymtml_arrow.ArrowColumn(
+                    metric,
+                    array._type_,
+                    array,
+                    validity=pymtml_arrow.validityBitmap(valid),
+                )
+            )
+        return columns
 
-def nvmlDeviceGetComputeInstanceId(device):
-    # Not Support
-    return 0
+    def __arrow_c_schema__(self):
+        import pymtml_arrow
 
+        return pymtml_arrow.toCapsule(
+            pymtml_arrow.recordBatchSchema(self._arrowColumns())
+        )
 
-def nvmlDeviceGetP2PStatus(device1, device2, p2pIndex):
-    """
-    Get P2P status between two devices.
-    Maps NVML P2P caps to MTML P2P caps.
+    def __arrow_c_array__(self, requested_schema=None):
+        """
+        Arrow PyCapsule export: one row per device, viewing the snapshot buffer. Failed reads
+        are null.
+        """
+        import pymtml_arrow
 
-    For NVML_P2P_CAPS_INDEX_NVLINK, this performs detailed MtLink detection
-    to check if two devices are connected via MtLink (1 hop).
-    """
-    try:
-        # Map NVML P2P index to MTML P2P caps
-        if p2pIndex == NVML_P2P_CAPS_INDEX_READ:
-            mtml_cap = MTML_P2P_CAPS_READ
-        elif p2pIndex == NVML_P2P_CAPS_INDEX_WRITE:
-            mtml_cap = MTML_P2P_CAPS_WRITE
-        elif p2pIndex == NVML_P2P_CAPS_INDEX_NVLINK:
-            # For NVLink check, use MtLink status
-            # This performs the same MtLink detection logic used in sglang's MUSA branch
-
-            # First check topology - if same device, they're connected
-            try:
-                level = mtmlDeviceGetTopologyLevel(device1, device2)
-                if level == MTML_TOPOLOGY_INTERNAL:
-                    return NVML_P2P_STATUS_OK
-            except MTMLError:
-                pass
+        return pymtml_arrow.exportRecordBatch(self._arrowColumns(), len(self))
 
-            # Check MtLink connectivity by iterating through links
-            # This is the detailed check: for each link on device1, check if
-            # the remote device matches device2's UUID
-            try:
-                peer_uuid = mtmlDeviceGetUUID(device2)
-                link_spec = mtmlDeviceGetMtLinkSpec(device1)
-                for link_idx in range(link_spec.linkNum):
-                    try:
-                        if (
-                            mtmlDeviceGetMtLinkState(device1, link_idx)
-                            != MTML_MTLINK_STATE_UP
-                        ):
-                            continue
-                        remote_handle = mtmlDeviceGetMtLinkRemoteDevice(
-                            device1, link_idx
-                        )
-                        if remote_handle:
-                            remote_uuid = mtmlDeviceGetUUID(remote_handle)
-                            if remote_uuid == peer_uuid:
-                                return NVML_P2P_STATUS_OK
-                    except MTMLError:
-                        continue
-            except MTMLError:
-                pass
+    def close(self):
+        """
+        Frees the GPU, memory and VPU sub-handles held by this snapshot. Those of a device
+        whose watched poll missed its deadline are freed once the hung reads return.
+        """
+        subHandles, self._subHandles = self._subHandles, []
+        outstanding, self._outstanding = self._outstanding, {}
+        self._calls = []
+        self._callNames = []
+        self._codecCalls = []
+        self._watchGroups = None
+        deferred = {}
+        for free, handle, i in subHandles:
+            job = outstanding.get(i)
+            if job is not None and not job.done.is_set():
+                deferred.setdefault(job, []).append((free, handle))
+            else:
+                _mtmlSnapshotFree([(free, handle)])
+        for job, frees in deferred.items():
+            threading.Thread(
+                target=_mtmlSnapshotFreeAfter,
+                args=(job, frees),
+                name="mtml-snapshot-free",
+                daemon=True,
+            ).start()
+
+
+def _mtmlSnapshotFree(frees):
+    for free, handle in frees:
+        try:
+            free(handle)
+        except MTMLError:
+            pass
 
-            # Fallback: try mtmlDeviceCountMtLinkLayouts as a secondary check
-            try:
-                link_count = mtmlDeviceCountMtLinkLayouts(device1, device2)
-                if link_count > 0:
-                    return NVML_P2P_STATUS_OK
-            except MTMLError:
-                pass
 
-            return NVML_P2P_STATUS_NOT_SUPPORTED
-        else:
-            # For other P2P caps, use MTML P2P status
-            mtml_cap = MTML_P2P_CAPS_READ
-
-        status = mtmlDeviceGetP2PStatus(device1, device2, mtml_cap)
-        # Map MTML status to NVML status
-        if status == MTML_P2P_STATUS_OK:
-            return NVML_P2P_STATUS_OK
-        elif status == MTML_P2P_STATUS_CHIPSET_NOT_SUPPORTED:
-            return NVML_P2P_STATUS_CHIPSET_NOT_SUPPORTED
-        elif status == MTML_P2P_STATUS_GPU_NOT_SUPPORTED:
-            return NVML_P2P_STATUS_GPU_NOT_SUPPORTED
-        else:
-            return NVML_P2P_STATUS_UNKNOWN
-    except MTMLError:
-        return NVML_P2P_STATUS_NOT_SUPPORTED
+def _mtmlSnapshotFreeAfter(job, frees):
+    job.done.wait()
+    _mtmlSnapshotFree(frees)
 
 
-def nvmlDeviceGetTopologyCommonAncestor(device1, device2):
+class _MtmlSnapshotGroup(object):
     """
-    Get the common ancestor topology level between two devices.
-    Maps MTML topology levels to NVML topology levels.
+    One device's reads in a watched poll. They write a private one-device `scratch` buffer,
+    which is copied into the snapshot (`copies`: snapshot column, scratch column, status
+    column) only when the job finished in time, so a read that outlives its deadline never
+    writes the buffer consumers see.
     """
-    try:
-        level = mtmlDeviceGetTopologyLevel(device1, device2)
-        # Map MTML topology level to NVML topology level
-        if level == MTML_TOPOLOGY_INTERNAL:
-            return NVML_TOPOLOGY_INTERNAL
-        elif level == MTML_TOPOLOGY_SINGLE:
-            return NVML_TOPOLOGY_SINGLE
-        elif level == MTML_TOPOLOGY_MULTIPLE:
-            return NVML_TOPOLOGY_MULTIPLE
-        elif level == MTML_TOPOLOGY_HOSTBRIDGE:
-            return NVML_TOPOLOGY_HOSTBRIDGE
-        elif level == MTML_TOPOLOGY_NODE:
-            return NVML_TOPOLOGY_NODE
-        elif level == MTML_TOPOLOGY_SYSTEM:
-            return NVML_TOPOLOGY_SYSTEM
-        else:
-            return NVML_TOPOLOGY_SYSTEM
-    except MTMLError:
-        return NVML_TOPOLOGY_SYSTEM
 
-
-def nvmlDeviceGetTopologyNearestGpus(device, level):
+    __slots__ = ("index", "address", "scratch", "calls", "codecCalls", "copies")
+
+    def __init__(self, index, address):
+        self.index = index
+        self.address = address
+        self.scratch = _c_mtmlSnapshotDevice_t()
+        self.calls = []
+        self.codecCalls = []
+        self.copies = []
+
+    def publish(self, buffer):
+        status = buffer.status
+        source = self.scratch.status
+        i = self.index
+        base = i * _MTML_SNAPSHOT_STATUS_SLOTS
+        for target, values, column in self.copies:
+            ret = source[column]
+            status[base + column] = ret
+            if ret == MTML_SUCCESS:
+                target[i] = values[0]
+
+    def fail(self, buffer, code):
+        status = buffer.status
+        base = self.index * _MTML_SNAPSHOT_STATUS_SLOTS
+        for _, _, column in self.copies:
+            status[base + column] = code
+
+
+def _mtmlUnwatched(fn):
+    return fn.fn if isinstance(fn, _MtmlWatchedFunction) else fn
+
+
+def _mtmlPollCalls(buffer, calls, codecCalls):
+    status = buffer.status
+    for fn, handle, ref, slot in calls:
+        status[slot] = fn(handle, ref)
+    encode = buffer.encodeUtil
+    decode = buffer.decodeUtil
+    for fn, handle, ref, scratch, slot, i in codecCalls:
+        ret = fn(handle, ref)
+        status[slot] = ret
+        if ret == MTML_SUCCESS:
+            # utilization is 0-100, so these reads hit the small-int cache
+            encode[i] = scratch.encodeUtil
+            decode[i] = scratch.decodeUtil
+
+
+def _mtmlPollWatched(snapshot, watchdog):
     """
-    Get GPUs at or nearer than the given topology level.
+    The watchdog's poll: every device's reads run as one job on its worker, all devices at
+    once, within one default deadline. Reads of a device that is quarantined or misses the
+    deadline report MTML_ERROR_TIMEOUT and keep their previous values.
     """
-    try:
-        # Map NVML level to MTML level
-        if level >= NVML_TOPOLOGY_SYSTEM:
-            mtml_level = MTML_TOPOLOGY_SYSTEM
-        elif level >= NVML_TOPOLOGY_NODE:
-            mtml_level = MTML_TOPOLOGY_NODE
-        elif level >= NVML_TOPOLOGY_HOSTBRIDGE:
-            mtml_level = MTML_TOPOLOGY_HOSTBRIDGE
-        elif level >= NVML_TOPOLOGY_MULTIPLE:
-            mtml_level = MTML_TOPOLOGY_MULTIPLE
-        elif level >= NVML_TOPOLOGY_SINGLE:
-            mtml_level = MTML_TOPOLOGY_SINGLE
+    buffer = snapshot.buffer
+    outstanding = snapshot._outstanding
+    pending = []
+    for group in snapshot._watchGroups:
+        state = watchdog.state(group.address)
+        if watchdog.admit(state):
+            job = _MtmlWatchdogCall(
+                _mtmlPollCalls, (group.scratch, group.calls, group.codecCalls)
+            )
+            state.worker.put(job)
+            pending.append((state, job, group))
         else:
-            mtml_level = MTML_TOPOLOGY_INTERNAL
-
-        count = mtmlDeviceCountDeviceByTopologyLevel(device, mtml_level)
-        if count > 0:
-            return mtmlDeviceGetDeviceByTopologyLevel(device, mtml_level, count)
-        return []
-    except MTMLError:
-        return []
-
-
-def nvmlDeviceGetNvLinkState(device, link):
-    """
-    Get NVLink state - maps to MtLink state for MTML.
-    """
-    try:
-        state = mtmlDeviceGetMtLinkState(device, link)
-        return 1 if state else 0
-    except MTMLError:
-        return 0
-
-
-def nvmlDeviceGetNvLinkCapability(device, link, capability):
+            group.fail(buffer, MTML_ERROR_TIMEOUT)
+    deadline = time.monotonic() + watchdog.timeout
+    for state, job, group in pending:
+        if job.done.wait(max(0.0, deadline - time.monotonic())):
+            watchdog.answered(state)
+            group.publish(buffer)
+            continue
+        watchdog.expire(state, job)
+        outstanding[group.index] = job  # close() leaves its sub-handles to the job
+        group.fail(buffer, MTML_ERROR_TIMEOUT)
+
+
+def mtmlPollInto(snapshot):
     """
-    Get NVLink capability - maps to MtLink cap status for MTML.
+    Reads every metric of every device in `snapshot` and overwrites its buffer in place.
+    Failed reads leave the previous value and record the MtmlReturn code in the status
+    column instead of raising, so one broken metric does not abort the poll.
     """
-    try:
-        return mtmlDeviceGetMtLinkCapStatus(device, link, capability)
-    except MTMLError:
-        return 0
+    if snapshot._dispatch is not _mtmlGetFunctionPointer_cache:
+        # faults were installed or cleared, or the library was swapped, since binding
+        snapshot._rebind()
+    watchdog = _mtmlWatchdog
+    if watchdog is None or snapshot._watchGroups is None:
+        _mtmlPollCalls(snapshot.buffer, snapshot._calls, snapshot._codecCalls)
+    else:
+        _mtmlPollWatched(snapshot, watchdog)
+    if _clock_gettime is not None:
+        _clock_gettime(_CLOCK_REALTIME, snapshot._timestampRef)
+    else:
+        now = time.time_ns()
+        snapshot.buffer.timestamp.tv_sec = now // 1000000000
+        snapshot.buffer.timestamp.tv_nsec = now % 1000000000
+    return snapshot
 
 
-def nvmlDeviceGetNvLinkRemotePciInfo(device, link):
+def _mtmlLoadNvmlSection():
     """
-    Get NVLink remote PCI info - maps to MtLink for MTML.
+    Imports the nvml compatibility layer (_pymtml_nvml.py) and publishes its names on this
+    module, so `import pymtml as pynvml` keeps working unchanged.
     """
+    global _mtmlNvmlSectionLoader
+
+    this_module = globals()
+    if "nvmlInit" in this_module:
+        return
+    with _mtmlLazySectionLock:
+        if "nvmlInit" in this_module:
+            return
+        _extractMTMLErrorsAsClasses()
+        _mtmlNvmlSectionLoader = threading.get_ident()
+        try:
+            import _pymtml_nvml
+        finally:
+            _mtmlNvmlSectionLoader = None
+
+        for name, value in vars(_pymtml_nvml).items():
+            if not name.startswith("__") and name not in this_module:
+                this_module[name] = value
+
+
+def __getattr__(name):
+    # PEP 562 hook, only consulted for names not (yet) defined in the module
+    if name.startswith("MTMLError_"):
+        _extractMTMLErrorsAsClasses()
+    elif name.startswith(_NVML_SECTION_PREFIXES):
+        _mtmlLoadNvmlSection()
+    elif name == "__all__":
+        if _mtmlNvmlSectionLoader == threading.get_ident():
+            # the nvml section's own `from pymtml import *` takes the core names only
+            raise AttributeError(name)
+        # `from pymtml import *` exports every section
+        _mtmlLoadNvmlSection()
+        return [x for x in globals() if not x.startswith("_")]
     try:
-        remote_device = mtmlDeviceGetMtLinkRemoteDevice(device, link)
-        return mtmlDeviceGetPciInfo(remote_device)
-    except MTMLError:
-        return None
-
-
-def nvmlDeviceGetNumGpuCores(device):
-    """Get number of GPU cores."""
-    try:
-        return mtmlDeviceCountGpuCores(device)
-    except MTMLError:
-        return 0
-
-
-def nvmlDeviceGetMemoryBusWidth(device):
-    """Get memory bus width in bits."""
-    try:
-        memory = mtmlDeviceInitMemory(device)
-        return mtmlMemoryGetBusWidth(memory)
-    except MTMLError:
-        return 0
-
-
-def nvmlDeviceGetVbiosVersion(device):
-    """Get VBIOS version."""
-    try:
-        return mtmlDeviceGetVbiosVersion(device)
-    except MTMLError:
-        return ""
-
-
-def nvmlDeviceGetBrand(device):
-    """Get device brand."""
-    try:
-        return mtmlDeviceGetBrand(device)
-    except MTMLError:
-        return MTML_BRAND_UNKNOWN
-
-
-def nvmlDeviceGetMinorNumber(device):
-    """Get device minor number (render node number)."""
-    try:
-        # Parse from render path: /dev/dri/renderD128 -> 128
-        render_path = mtmlDeviceGetRenderPath(device)
-        if isinstance(render_path, bytes):
-            render_path = render_path.decode()
-        # Extract number from path like /dev/dri/renderD128
-        import re
-
-        match = re.search(r"renderD(\d+)", render_path)
-        if match:
-            return int(match.group(1))
-        return 0
-    except (MTMLError, Exception):
-        return 0
-
-
-def nvmlDeviceGetCpuAffinity(device, cpuSetSize):
-    """Get CPU affinity for device."""
-    try:
-        return mtmlDeviceGetCpuAffinityWithinNode(device, cpuSetSize)
-    except MTMLError:
-        return [0] * cpuSetSize
-
-
-def nvmlDeviceGetMemoryAffinity(device, nodeSetSize, scope):
-    """Get memory affinity for device."""
-    try:
-        return mtmlDeviceGetMemoryAffinityWithinNode(device, nodeSetSize)
-    except MTMLError:
-        return [0] * nodeSetSize
-
-
-def nvmlDeviceGetCpuAffinityWithinScope(device, cpuSetSize, scope):
-    """Get CPU affinity within scope for device."""
-    try:
-        return mtmlDeviceGetCpuAffinityWithinNode(device, cpuSetSize)
-    except MTMLError:
-        return [0] * cpuSetSize
-
-
-def nvmlDeviceGetEccMode(device):
-    """Get ECC mode - returns (current, pending)."""
-    try:
-        memory = mtmlDeviceInitMemory(device)
-        return mtmlMemoryGetEccMode(memory)
-    except MTMLError:
-        return (0, 0)
-
-
-def nvmlDeviceGetCurrentEccMode(device):
-    """Get current ECC mode."""
-    return nvmlDeviceGetEccMode(device)[0]
-
-
-def nvmlDeviceGetPendingEccMode(device):
-    """Get pending ECC mode."""
-    return nvmlDeviceGetEccMode(device)[1]
-
-
-def nvmlDeviceGetRetiredPagesPendingStatus(device):
-    """Get retired pages pending status."""
-    try:
-        memory = mtmlDeviceInitMemory(device)
-        return mtmlMemoryGetRetiredPagesPendingStatus(memory)
-    except MTMLError:
-        return 0
+        return globals()[name]
+    except KeyError:
+        raise AttributeError("module %r has no attribute %r" % (__name__, name))
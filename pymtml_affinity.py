@@ -0,0 +1,219 @@
+##
+# CPU and NUMA affinity pinning for GPU workers
+#
+# mtmlDeviceGetCpuAffinityWithinNode and mtmlDeviceGetMemoryAffinityWithinNode return raw
+# unsigned long bitmasks. mtmlAffinityGet decodes them once per device (by UUID) into CPU
+# and NUMA node ids; mtmlAffinityPin pins the calling thread or the whole process to the
+# device's CPUs with sched_setaffinity and can set the memory policy to the device's NUMA
+# nodes with set_mempolicy.
+#
+# Devices that share a NUMA node share its CPUs, so running one worker per device on all of
+# them oversubscribes those CPUs. mtmlAffinityCpuSlice splits the shared CPUs into disjoint
+# contiguous slices, one per (device, worker) among the devices with the same CPU set. The
+# split only depends on the device list and the CPUs the process was allowed at import (not
+# on a thread's current, possibly already pinned, mask), so independent worker processes
+# started with the same CPU set agree on it without talking to each other.
+##
+import ctypes
+import os
+import platform
+import threading
+
+from pymtml import *
+
+_WORD_BITS = 64
+
+# set_mempolicy(2) modes
+MTML_MEMPOLICY_PREFERRED = 1
+MTML_MEMPOLICY_BIND = 2
+MTML_MEMPOLICY_INTERLEAVE = 3
+_MEMPOLICY_MODES = {
+    "preferred": MTML_MEMPOLICY_PREFERRED,
+    "bind": MTML_MEMPOLICY_BIND,
+    "interleave": MTML_MEMPOLICY_INTERLEAVE,
+}
+
+# CPUs this process may use, read once at import: mtmlAffinityPin narrows the calling
+# thread's mask, and slices computed after a pin must not shrink with it. None where the
+# platform has no sched_getaffinity (not Linux): every CPU of the device is allowed
+_mtmlAllowedCpus = (
+    frozenset(os.sched_getaffinity(0)) if hasattr(os, "sched_getaffinity") else None
+)
+
+# glibc has no set_mempolicy wrapper (it lives in libnuma), so it is called by number
+_SYS_SET_MEMPOLICY = {"x86_64": 238, "aarch64": 237, "loongarch64": 237}.get(
+    platform.machine()
+)
+
+
+class MtmlDeviceAffinity(object):
+    """CPU ids and NUMA node ids local to one device; empty when the driver cannot tell."""
+
+    __slots__ = ("uuid", "cpus", "numaNodes")
+
+    def __init__(self, uuid, cpus, numaNodes):
+        self.uuid = uuid
+        self.cpus = tuple(cpus)
+        self.numaNodes = tuple(numaNodes)
+
+    def __repr__(self):
+        return "MtmlDeviceAffinity(uuid=%r, cpus=%r, numaNodes=%r)" % (
+            self.uuid,
+            self.cpus,
+            self.numaNodes,
+        )
+
+
+def mtmlAffinityDecode(words):
+    """Bit numbers set in a list of unsigned long mask words, lowest first."""
+    return [
+        w * _WORD_BITS + b
+        for w, word in enumerate(words)
+        for b in range(_WORD_BITS)
+        if word >> b & 1
+    ]
+
+
+def _words(count):
+    return max(1, (count + _WORD_BITS - 1) // _WORD_BITS)
+
+
+def _nodeCount():
+    try:
+        return len(
+            [n for n in os.listdir("/sys/devices/system/node") if n.startswith("node")]
+        )
+    except OSError:
+        return 1
+
+
+def _readAffinity(handle):
+    try:
+        cpus = mtmlAffinityDecode(
+            mtmlDeviceGetCpuAffinityWithinNode(handle, _words(os.cpu_count() or 1))
+        )
+    except MTMLError:
+        cpus = []
+    try:
+        nodes = mtmlAffinityDecode(
+            mtmlDeviceGetMemoryAffinityWithinNode(handle, _words(_nodeCount()))
+        )
+    except MTMLError:
+        nodes = []
+    return cpus, nodes
+
+
+_mtmlAffinityCache = dict()  # device UUID -> MtmlDeviceAffinity
+_mtmlAffinityCacheLock = threading.Lock()
+
+
+def _device(device):
+    if isinstance(device, MtmlDevice):
+        return device
+    if isinstance(device, int):
+        return mtmlGetDeviceRegistry().byIndex(device)
+    if isinstance(device, str):
+        return mtmlGetDeviceRegistry().byUuid(device)
+    return mtmlGetDeviceRegistry().byHandle(device)
+
+
+def mtmlAffinityGet(device):
+    """
+    Decoded affinity of `device` (MtmlDevice, handle, index or UUID). The masks are read once
+    per device and cached by UUID, since they only change with the hardware.
+    """
+    device = _device(device)
+    affinity = _mtmlAffinityCache.get(device.uuid)
+    if affinity is None:
+        cpus, nodes = _readAffinity(device.handle)
+        affinity = MtmlDeviceAffinity(device.uuid, cpus, nodes)
+        with _mtmlAffinityCacheLock:
+            affinity = _mtmlAffinityCache.setdefault(device.uuid, affinity)
+    return affinity
+
+
+def mtmlAffinityClearCache():
+    with _mtmlAffinityCacheLock:
+        _mtmlAffinityCache.clear()
+
+
+def mtmlAffinityCpuSlice(device, workers=1, worker=0, devices=None):
+    """
+    CPUs for worker `worker` of `workers` on `device`: the device's CPUs that this process
+    was allowed when pymtml_affinity was imported, split evenly and disjointly among every
+    worker of every device in `devices` (all devices by default) with the same CPU set.
+    Slices differ in size by at most one CPU.
+    Returns all of the device's CPUs when there are fewer CPUs than workers, and an empty
+    tuple when the driver reports no affinity.
+    """
+    if not 0 <= worker < workers:
+        raise ValueError("worker must be in [0, workers)")
+    device = _device(device)
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    own = mtmlAffinityGet(device).cpus
+    allowed = _mtmlAllowedCpus
+    cpus = list(own) if allowed is None else [c for c in own if c in allowed]
+    group = sorted(
+        {d for d in map(_device, devices) if mtmlAffinityGet(d).cpus == own} | {device},
+        key=lambda d: d.index,
+    )
+    slices = len(group) * workers
+    if len(cpus) < slices:
+        return tuple(cpus)
+    position = group.index(device) * workers + worker
+    start = position * len(cpus) // slices
+    end = (position + 1) * len(cpus) // slices
+    return tuple(cpus[start:end])
+
+
+def mtmlAffinitySetMemoryPolicy(nodes, mode="bind"):
+    """
+    Sets the memory policy of the calling thread to `mode` ("bind", "preferred" or
+    "interleave") over NUMA `nodes`. Raises OSError if the kernel refuses.
+    """
+    if _SYS_SET_MEMPOLICY is None:
+        raise OSError(0, "set_mempolicy is not supported on %s" % platform.machine())
+    nodes = list(nodes)
+    maxnode = (max(nodes) // _WORD_BITS + 1) * _WORD_BITS if nodes else _WORD_BITS
+    mask = (ctypes.c_ulong * (maxnode // _WORD_BITS))()
+    for node in nodes:
+        mask[node // _WORD_BITS] |= 1 << (node % _WORD_BITS)
+    libc = ctypes.CDLL(None, use_errno=True)
+    # maxnode counts bits and the kernel drops the last one
+    ret = libc.syscall(
+        _SYS_SET_MEMPOLICY, _MEMPOLICY_MODES[mode], mask, ctypes.c_ulong(maxnode + 1)
+    )
+    if ret != 0:
+        errno = ctypes.get_errno()
+        raise OSError(errno, os.strerror(errno))
+
+
+def mtmlAffinityPin(
+    device, workers=1, worker=0, scope="thread", memory=None, devices=None
+):
+    """
+    Pins to the CPUs of mtmlAffinityCpuSlice(device, workers, worker, devices): the calling
+    thread with scope="thread", every thread of the process with scope="process". With
+    `memory` ("bind", "preferred" or "interleave"), also sets the calling thread's memory
+    policy to the device's NUMA nodes. Returns the CPUs pinned to, or an empty tuple (and
+    changes nothing) when the driver reports no CPU affinity.
+    """
+    cpus = mtmlAffinityCpuSlice(device, workers, worker, devices)
+    if not cpus:
+        return cpus
+    if scope == "thread":
+        os.sched_setaffinity(0, cpus)
+    elif scope == "process":
+        for tid in os.listdir("/proc/self/task"):
+            try:
+                os.sched_setaffinity(int(tid), cpus)
+            except ProcessLookupError:
+                pass  # thread exited meanwhile
+    else:
+        raise ValueError("scope must be 'thread' or 'process'")
+    if memory is not None:
+        nodes = mtmlAffinityGet(device).numaNodes
+        if nodes:
+            mtmlAffinitySetMemoryPolicy(nodes, memory)
+    return cpus
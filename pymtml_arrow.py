@@ -0,0 +1,384 @@
+##
+# Arrow C Data Interface export for pymtml telemetry buffers
+#
+# Hands columns that already live in ctypes buffers to Arrow consumers (pyarrow, polars,
+# nanoarrow, ...) through the PyCapsule protocol without copying them and without depending on
+# pyarrow. See https://arrow.apache.org/docs/format/CDataInterface.html
+##
+import itertools
+import threading
+from ctypes import *
+
+ARROW_FLAG_NULLABLE = 2
+
+
+class ArrowSchema(Structure):
+    pass
+
+
+ArrowSchema._fields_ = [
+    ("format", c_char_p),
+    ("name", c_char_p),
+    ("metadata", c_char_p),
+    ("flags", c_int64),
+    ("n_children", c_int64),
+    ("children", POINTER(POINTER(ArrowSchema))),
+    ("dictionary", POINTER(ArrowSchema)),
+    ("release", CFUNCTYPE(None, POINTER(ArrowSchema))),
+    ("private_data", c_void_p),
+]
+
+
+class ArrowArray(Structure):
+    pass
+
+
+ArrowArray._fields_ = [
+    ("length", c_int64),
+    ("null_count", c_int64),
+    ("offset", c_int64),
+    ("n_buffers", c_int64),
+    ("n_children", c_int64),
+    ("buffers", POINTER(c_void_p)),
+    ("children", POINTER(POINTER(ArrowArray))),
+    ("dictionary", POINTER(ArrowArray)),
+    ("release", CFUNCTYPE(None, POINTER(ArrowArray))),
+    ("private_data", c_void_p),
+]
+
+
+class ArrowArrayStream(Structure):
+    pass
+
+
+ArrowArrayStream._fields_ = [
+    ("get_schema", CFUNCTYPE(c_int, POINTER(ArrowArrayStream), POINTER(ArrowSchema))),
+    ("get_next", CFUNCTYPE(c_int, POINTER(ArrowArrayStream), POINTER(ArrowArray))),
+    ("get_last_error", CFUNCTYPE(c_void_p, POINTER(ArrowArrayStream))),
+    ("release", CFUNCTYPE(None, POINTER(ArrowArrayStream))),
+    ("private_data", c_void_p),
+]
+
+# ctypes type -> Arrow format string
+ARROW_FORMATS = {
+    c_int32: b"i",
+    c_uint32: b"I",
+    c_int64: b"l",
+    c_uint64: b"L",
+    c_float: b"f",
+    c_double: b"g",
+}
+ARROW_TIMESTAMP_NS_UTC = b"tsn:UTC"
+
+
+def _null(struct, field="release"):
+    # ctypes rejects None for function pointer fields; an argument-less instance is NULL
+    setattr(struct, field, dict(type(struct)._fields_)[field]())
+
+
+## Ownership ##
+# Consumers move the exported structs into their own memory and later call `release` on the
+# moved copy, so the Python objects backing an export are found through private_data (a key
+# into _exports) rather than through the struct address.
+_exports = dict()
+_exportKeys = itertools.count(1)
+_exportsLock = threading.Lock()
+
+
+def _keep(objects):
+    with _exportsLock:
+        key = next(_exportKeys)
+        _exports[key] = objects
+    return key
+
+
+def _drop(key):
+    with _exportsLock:
+        return _exports.pop(key, None)
+
+
+@CFUNCTYPE(None, POINTER(ArrowSchema))
+def _releaseSchema(schema):
+    s = schema.contents
+    for i in range(s.n_children):
+        child = s.children[i].contents
+        if child.release:
+            child.release(s.children[i])
+    if s.dictionary and s.dictionary.contents.release:
+        s.dictionary.contents.release(s.dictionary)
+    _drop(s.private_data)
+    _null(s)
+
+
+@CFUNCTYPE(None, POINTER(ArrowArray))
+def _releaseArray(array):
+    a = array.contents
+    for i in range(a.n_children):
+        child = a.children[i].contents
+        if child.release:
+            child.release(a.children[i])
+    if a.dictionary and a.dictionary.contents.release:
+        a.dictionary.contents.release(a.dictionary)
+    _drop(a.private_data)
+    _null(a)
+
+
+## Builders ##
+class ArrowColumn(object):
+    """
+    One exported column: `data` is a ctypes array (or any object with a stable address via
+    addressof) holding `length` values of `ctype` starting at element `offset`.
+    `dictionary`, if given, is a list of strings and `data` holds int32 indices into it.
+    `validity`, if given, is a bitmap from validityBitmap() marking the non-null rows.
+    """
+
+    __slots__ = (
+        "name",
+        "ctype",
+        "data",
+        "offset",
+        "format",
+        "dictionary",
+        "validity",
+        "nullCount",
+    )
+
+    def __init__(
+        self,
+        name,
+        ctype,
+        data,
+        offset=0,
+        format=None,
+        dictionary=None,
+        validity=(None, 0),
+    ):
+        self.name = name
+        self.ctype = ctype
+        self.data = data
+        self.offset = offset
+        self.format = format or ARROW_FORMATS[ctype]
+        self.dictionary = dictionary
+        self.validity, self.nullCount = validity
+
+
+# row flag byte (0 or 1) -> binary digit, for validityBitmap's int() parse
+_FLAG_DIGITS = bytes.maketrans(b"\x00\x01", b"01")
+
+
+def validityBitmap(valid):
+    """
+    (bitmap, null count) for ArrowColumn from `valid`, one 0/1 byte per row, LSB-first as
+    Arrow lays it out. A column without nulls needs no bitmap, so that case is (None, 0).
+    The rows are packed by bytes.translate and int(), not a per-row Python loop.
+    """
+    valid = bytes(valid)
+    nulls = valid.count(0)
+    if not nulls:
+        return None, 0
+    size = (len(valid) + 7) // 8
+    bits = int(valid.translate(_FLAG_DIGITS)[::-1], 2)
+    return (c_uint8 * size).from_buffer_copy(bits.to_bytes(size, "little")), nulls
+
+
+def _schema(format, name, children=(), dictionary=None, flags=0):
+    schema = ArrowSchema()
+    keep = [format, name]
+    schema.format = format
+    schema.name = name
+    schema.flags = flags
+    schema.n_children = len(children)
+    if children:
+        ptrs = (POINTER(ArrowSchema) * len(children))(*[pointer(c) for c in children])
+        schema.children = ptrs
+        keep.append(ptrs)
+    if dictionary is not None:
+        schema.dictionary = pointer(dictionary)
+    keep.extend(children)
+    if dictionary is not None:
+        keep.append(dictionary)
+    schema.private_data = _keep(keep)
+    schema.release = _releaseSchema
+    return schema
+
+
+def _array(length, buffers, keep, children=(), dictionary=None, nullCount=0):
+    array = ArrowArray()
+    c_buffers = (c_void_p * len(buffers))(*buffers)
+    array.length = length
+    array.null_count = nullCount
+    array.offset = 0
+    array.n_buffers = len(buffers)
+    array.buffers = c_buffers
+    array.n_children = len(children)
+    keep = list(keep) + [c_buffers]
+    if children:
+        ptrs = (POINTER(ArrowArray) * len(children))(*[pointer(c) for c in children])
+        array.children = ptrs
+        keep.append(ptrs)
+        keep.extend(children)
+    if dictionary is not None:
+        array.dictionary = pointer(dictionary)
+        keep.append(dictionary)
+    array.private_data = _keep(keep)
+    array.release = _releaseArray
+    return array
+
+
+def _utf8Array(strings):
+    encoded = [s.encode() for s in strings]
+    offsets = (c_int32 * (len(encoded) + 1))()
+    total = 0
+    for i, value in enumerate(encoded):
+        offsets[i] = total
+        total += len(value)
+    offsets[len(encoded)] = total
+    data = create_string_buffer(b"".join(encoded), max(total, 1))
+    return _array(
+        len(encoded), [None, addressof(offsets), addressof(data)], [offsets, data]
+    )
+
+
+def _columnSchema(column):
+    dictionary = None
+    if column.dictionary is not None:
+        dictionary = _schema(b"u", None)
+    return _schema(
+        column.format,
+        column.name.encode(),
+        dictionary=dictionary,
+        flags=ARROW_FLAG_NULLABLE,
+    )
+
+
+def _columnArray(column, length):
+    address = addressof(column.data) + column.offset * sizeof(column.ctype)
+    dictionary = None
+    if column.dictionary is not None:
+        dictionary = _utf8Array(column.dictionary)
+    keep = [column.data]
+    bitmap = None
+    if column.validity is not None:
+        bitmap = addressof(column.validity)
+        keep.append(column.validity)
+    # the column's backing buffers stay referenced until the consumer releases the array
+    return _array(
+        length,
+        [bitmap, address],
+        keep,
+        dictionary=dictionary,
+        nullCount=column.nullCount,
+    )
+
+
+def recordBatchSchema(columns):
+    return _schema(b"+s", b"", children=[_columnSchema(c) for c in columns])
+
+
+def recordBatchArray(columns, length):
+    return _array(
+        length, [None], [], children=[_columnArray(c, length) for c in columns]
+    )
+
+
+## PyCapsules ##
+_PyCapsule_New = pythonapi.PyCapsule_New
+_PyCapsule_New.restype = py_object
+_PyCapsule_New.argtypes = [c_void_p, c_char_p, c_void_p]
+_PyCapsule_GetPointer = pythonapi.PyCapsule_GetPointer
+_PyCapsule_GetPointer.restype = c_void_p
+_PyCapsule_GetPointer.argtypes = [py_object, c_char_p]
+
+_CAPSULE_NAMES = {
+    ArrowSchema: b"arrow_schema",
+    ArrowArray: b"arrow_array",
+    ArrowArrayStream: b"arrow_array_stream",
+}
+_capsuleStructs = (
+    dict()
+)  # struct address -> struct, alive until the capsule is destroyed
+
+
+def _destructor(struct_type):
+    @CFUNCTYPE(None, c_void_p)
+    def destroy(capsule):
+        address = _PyCapsule_GetPointer(
+            cast(capsule, py_object), _CAPSULE_NAMES[struct_type]
+        )
+        struct = _capsuleStructs.pop(address, None)
+        # release unless a consumer moved the struct out (which nulls release)
+        if struct is not None and struct.release:
+            struct.release(pointer(struct))
+
+    return destroy
+
+
+_destructors = {t: _destructor(t) for t in _CAPSULE_NAMES}
+
+
+def toCapsule(struct):
+    address = addressof(struct)
+    _capsuleStructs[address] = struct
+    return _PyCapsule_New(
+        address,
+        _CAPSULE_NAMES[type(struct)],
+        cast(_destructors[type(struct)], c_void_p),
+    )
+
+
+def exportRecordBatch(columns, length):
+    """Returns the (schema, array) capsule pair for `__arrow_c_array__`."""
+    return (
+        toCapsule(recordBatchSchema(columns)),
+        toCapsule(recordBatchArray(columns, length)),
+    )
+
+
+def exportStream(columns_factory, batches):
+    """
+    Returns an `arrow_array_stream` capsule yielding one record batch per entry of `batches`
+    (each a (columns, length) pair). `columns_factory()` describes the schema.
+    """
+    pending = list(batches)
+
+    @CFUNCTYPE(c_int, POINTER(ArrowArrayStream), POINTER(ArrowSchema))
+    def get_schema(stream, out):
+        schema = recordBatchSchema(columns_factory())
+        memmove(out, byref(schema), sizeof(ArrowSchema))
+        _keepMoved(schema)
+        return 0
+
+    @CFUNCTYPE(c_int, POINTER(ArrowArrayStream), POINTER(ArrowArray))
+    def get_next(stream, out):
+        if not pending:
+            _null(out.contents)  # end of stream
+            return 0
+        columns, length = pending.pop(0)
+        array = recordBatchArray(columns, length)
+        memmove(out, byref(array), sizeof(ArrowArray))
+        _keepMoved(array)
+        return 0
+
+    @CFUNCTYPE(c_void_p, POINTER(ArrowArrayStream))
+    def get_last_error(stream):
+        return None
+
+    @CFUNCTYPE(None, POINTER(ArrowArrayStream))
+    def release(stream):
+        del pending[:]
+        _drop(stream.contents.private_data)
+        _null(stream.contents)
+
+    stream = ArrowArrayStream()
+    stream.get_schema = get_schema
+    stream.get_next = get_next
+    stream.get_last_error = get_last_error
+    stream.release = release
+    stream.private_data = _keep([get_schema, get_next, get_last_error, release])
+    return toCapsule(stream)
+
+
+def _keepMoved(struct):
+    # The struct was copied into consumer memory, which now owns it via private_data; the
+    # original only has to outlive the copy, which the release callback does not touch.
+    _null(struct)
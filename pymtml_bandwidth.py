@@ -0,0 +1,227 @@
+##
+# Interconnect bandwidth estimates between devices
+#
+# MtmlBandwidthModel estimates, without running a transfer, the bandwidth and latency class
+# of every device pair. Pairs joined by MtLink get active links x per-link bandwidth
+# (MtmlMtLinkSpec.bandWidth); other pairs get the narrower of the two PCIe links (current
+# generation and width) scaled by how far apart the topology level puts them. The model is
+# computed once for all devices into flat per-pair tables, so a query is a dict lookup and a
+# list index; mtmlBandwidthModelGet shares one model per device set until refresh=True (for
+# example after an MtLink goes down).
+##
+import threading
+
+from pymtml import *
+from pymtml_topology import mtmlTopologyGet
+
+# GB/s per lane and direction for PCIe generations 1-6
+MTML_PCIE_LANE_GBPS = {1: 0.25, 2: 0.5, 3: 0.985, 4: 1.969, 5: 3.938, 6: 7.563}
+
+# share of the PCIe link bandwidth a peer transfer gets at each topology level, and how much
+# of twice that survives when both directions run at once (root complexes and the socket
+# interconnect are not full duplex in practice)
+_PCIE_LEVEL_FACTOR = {
+    MTML_TOPOLOGY_INTERNAL: (1.0, 2.0),
+    MTML_TOPOLOGY_SINGLE: (1.0, 2.0),
+    MTML_TOPOLOGY_MULTIPLE: (0.9, 2.0),
+    MTML_TOPOLOGY_HOSTBRIDGE: (0.8, 1.6),
+    MTML_TOPOLOGY_NODE: (0.6, 1.6),
+    MTML_TOPOLOGY_SYSTEM: (0.4, 1.4),
+}
+_LINK_STATE_FACTOR = {MTML_MTLINK_STATE_UP: 1.0, MTML_MTLINK_STATE_DOWNGRADE: 0.5}
+
+# latency classes, fastest first, with a nominal one-way latency in microseconds
+MTML_LATENCY_MTLINK = 0
+MTML_LATENCY_PCIE_SWITCH = 1
+MTML_LATENCY_HOST_BRIDGE = 2
+MTML_LATENCY_CROSS_NUMA = 3
+MTML_LATENCY_UNKNOWN = 4
+MTML_LATENCY_NAMES = ("mtlink", "pcie-switch", "host-bridge", "cross-numa", "unknown")
+MTML_LATENCY_MICROSECONDS = (2.0, 4.0, 6.0, 10.0, 10.0)
+
+_LEVEL_LATENCY = {
+    MTML_TOPOLOGY_INTERNAL: MTML_LATENCY_PCIE_SWITCH,
+    MTML_TOPOLOGY_SINGLE: MTML_LATENCY_PCIE_SWITCH,
+    MTML_TOPOLOGY_MULTIPLE: MTML_LATENCY_PCIE_SWITCH,
+    MTML_TOPOLOGY_HOSTBRIDGE: MTML_LATENCY_HOST_BRIDGE,
+    MTML_TOPOLOGY_NODE: MTML_LATENCY_HOST_BRIDGE,
+    MTML_TOPOLOGY_SYSTEM: MTML_LATENCY_CROSS_NUMA,
+}
+
+
+def _activeLinks(devices, topology):
+    """
+    Active MtLinks between each pair as [i][j] link counts (a downgraded link counts half)
+    and each device's per-link GB/s. Links are listed with mtmlDeviceGetMtLinkRemoteDevice
+    and their state; for devices that cannot list them the mtmlDeviceCountMtLinkLayouts
+    count from the topology is used.
+    """
+    registry = mtmlGetDeviceRegistry()
+    slot = {d.uuid: i for i, d in enumerate(devices)}
+    n = len(devices)
+    links = [[0.0] * n for _ in range(n)]
+    listed = [True] * n
+    bandwidth = [0.0] * n
+    for i, device in enumerate(devices):
+        try:
+            spec = mtmlDeviceGetMtLinkSpec(device.handle)
+        except MTMLError:
+            listed[i] = False
+            continue
+        bandwidth[i] = float(spec.bandWidth)
+        try:
+            for link in range(spec.linkNum):
+                factor = _LINK_STATE_FACTOR.get(
+                    mtmlDeviceGetMtLinkState(device.handle, link), 0.0
+                )
+                if not factor:
+                    continue
+                remote = registry.byHandle(
+                    mtmlDeviceGetMtLinkRemoteDevice(device.handle, link)
+                )
+                j = slot.get(remote.uuid)
+                if j is not None:
+                    links[i][j] += factor
+        except MTMLError:
+            listed[i] = False
+    for i in range(n):
+        for j in range(n):
+            if listed[i] and listed[j]:
+                links[i][j] = max(links[i][j], links[j][i])
+            else:
+                links[i][j] = float(topology.mtlinks[i][j] or 0)
+    return links, bandwidth
+
+
+def _pcieLink(device):
+    try:
+        pci = mtmlDeviceGetPciInfo(device.handle)
+    except MTMLError:
+        return 0.0
+    return MTML_PCIE_LANE_GBPS.get(pci.pciCurGen, 0.0) * pci.pciCurWidth
+
+
+class MtmlBandwidthEstimate(object):
+    __slots__ = ("unidirectional", "bidirectional", "latencyClass", "mtlinks")
+
+    def __init__(self, unidirectional, bidirectional, latencyClass, mtlinks):
+        self.unidirectional = unidirectional
+        self.bidirectional = bidirectional
+        self.latencyClass = latencyClass
+        self.mtlinks = mtlinks
+
+    @property
+    def latencyName(self):
+        return MTML_LATENCY_NAMES[self.latencyClass]
+
+    def transferTime(self, nbytes, bidirectional=False):
+        """Estimated seconds to move `nbytes` (each way, if `bidirectional`)."""
+        if bidirectional:
+            bandwidth = self.bidirectional / 2.0
+        else:
+            bandwidth = self.unidirectional
+        if not bandwidth:
+            return float("inf")
+        latency = MTML_LATENCY_MICROSECONDS[self.latencyClass] * 1e-6
+        return latency + nbytes / (bandwidth * 1e9)
+
+    def __repr__(self):
+        return (
+            "MtmlBandwidthEstimate(unidirectional=%.1f GB/s, bidirectional=%.1f GB/s, %s)"
+            % (self.unidirectional, self.bidirectional, self.latencyName)
+        )
+
+
+class MtmlBandwidthModel(object):
+    """
+    Estimated bandwidth between every pair of `devices` (MtmlDevice list, all devices by
+    default). `unidirectional`, `bidirectional` (GB/s) and `latencyClass` are n x n lists
+    indexed by slot; estimate(a, b) wraps one pair and accepts devices as MtmlDevice, index,
+    UUID or handle.
+    """
+
+    def __init__(self, devices=None):
+        if devices is None:
+            devices = mtmlGetDeviceRegistry().devices
+        self.devices = list(devices)
+        self._slot = {}
+        for i, d in enumerate(self.devices):
+            self._slot[d.uuid] = self._slot[d.index] = self._slot[d.address] = i
+            self._slot[d] = i
+        n = len(self.devices)
+        topology = mtmlTopologyGet(self.devices)
+        links, perLink = _activeLinks(self.devices, topology)
+        pcie = [_pcieLink(d) for d in self.devices]
+
+        self.mtlinks = links
+        self.unidirectional = [[0.0] * n for _ in range(n)]
+        self.bidirectional = [[0.0] * n for _ in range(n)]
+        self.latencyClass = [[MTML_LATENCY_UNKNOWN] * n for _ in range(n)]
+        self._estimates = [[None] * n for _ in range(n)]
+        for i in range(n):
+            for j in range(n):
+                if i == j:
+                    continue
+                per = min(perLink[i], perLink[j])
+                if links[i][j] and per:
+                    uni = links[i][j] * per
+                    bidi = 2.0 * uni  # MtLink lanes are full duplex
+                    latency = MTML_LATENCY_MTLINK
+                else:
+                    level = topology.level[i][j]
+                    factor, duplex = _PCIE_LEVEL_FACTOR.get(level, (0.0, 0.0))
+                    uni = min(pcie[i], pcie[j]) * factor
+                    bidi = uni * duplex
+                    latency = _LEVEL_LATENCY.get(level, MTML_LATENCY_UNKNOWN)
+                self.unidirectional[i][j] = uni
+                self.bidirectional[i][j] = bidi
+                self.latencyClass[i][j] = latency
+                self._estimates[i][j] = MtmlBandwidthEstimate(
+                    uni, bidi, latency, links[i][j]
+                )
+
+    def slot(self, device):
+        try:
+            return self._slot[device]
+        except (KeyError, TypeError):
+            pass
+        # a raw handle (unhashable): by native address, else by the registry's alias lookup
+        slot = self._slot.get(cast(device, c_void_p).value)
+        if slot is None:
+            slot = self._slot[mtmlGetDeviceRegistry().byHandle(device)]
+        return slot
+
+    def estimate(self, a, b):
+        """MtmlBandwidthEstimate for a transfer from `a` to `b` (None when a == b)."""
+        return self._estimates[self.slot(a)][self.slot(b)]
+
+    def estimateMany(self, pairs):
+        """Estimates for an iterable of (a, b) pairs, in order."""
+        estimates, slot = self._estimates, self.slot
+        return [estimates[slot(a)][slot(b)] for a, b in pairs]
+
+    def bottleneck(self, pairs):
+        """The slowest unidirectional GB/s among `pairs`, e.g. the hops of one collective."""
+        slot, uni = self.slot, self.unidirectional
+        return min(uni[slot(a)][slot(b)] for a, b in pairs)
+
+
+_mtmlBandwidthModels = dict()  # tuple of UUIDs -> MtmlBandwidthModel
+_mtmlBandwidthModelsLock = threading.Lock()
+
+
+def mtmlBandwidthModelGet(devices=None, refresh=False):
+    """
+    The shared MtmlBandwidthModel for `devices` (all devices by default), built on first use
+    and rebuilt with refresh=True.
+    """
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    devices = list(devices)
+    key = tuple(d.uuid for d in devices)
+    model = None if refresh else _mtmlBandwidthModels.get(key)
+    if model is None:
+        model = MtmlBandwidthModel(devices)
+        with _mtmlBandwidthModelsLock:
+            _mtmlBandwidthModels[key] = model
+    return model
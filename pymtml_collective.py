@@ -0,0 +1,285 @@
+##
+# Collective ring and tree orderings from MtLink wiring
+#
+# Ring and tree collectives run at the speed of their slowest hop, so rank order matters:
+# a ring that follows physical MtLinks can be several times faster than one that crosses
+# PCIe. mtmlCollectiveRing finds the ring over a device set whose slowest hop is as fast as
+# possible (exactly for up to MTML_COLLECTIVE_EXACT_LIMIT devices, greedily above that), and
+# mtmlCollectiveTree builds a degree-limited maximum-bottleneck spanning tree. Hop bandwidths
+# come from the shared MtmlBandwidthModel: active MtLinks where a pair has them, the PCIe
+# path scaled by topology level where it has not, so partial MtLink wiring still yields a
+# usable order. Each result carries estimated algorithm bandwidths per collective.
+##
+from pymtml import *
+from pymtml_bandwidth import MTML_LATENCY_MTLINK, mtmlBandwidthModelGet
+
+# above this many devices the exact bottleneck-ring search (2^n states) gives way to greedy
+MTML_COLLECTIVE_EXACT_LIMIT = 16
+
+
+def mtmlCollectiveLinkGraph(devices):
+    """
+    Unidirectional GB/s between every pair of `devices` as an n x n list, and whether each
+    hop is an MtLink, taken from the shared MtmlBandwidthModel.
+    """
+    devices = list(devices)
+    model = mtmlBandwidthModelGet()
+    slots = [model.slot(d) for d in devices]
+    graph = [[model.unidirectional[i][j] for j in slots] for i in slots]
+    mtlink = [
+        [model.latencyClass[i][j] == MTML_LATENCY_MTLINK for j in slots] for i in slots
+    ]
+    return graph, mtlink
+
+
+class MtmlCollectivePlan(object):
+    """
+    A rank order over `devices` (MtmlDevice list). `hops` lists the (i, j) positions data
+    moves between, `bottleneck` the slowest hop in GB/s, `mtlinkOnly` whether every hop is an
+    MtLink, and `estimates` the estimated algorithm bandwidth (GB/s of payload) for
+    allreduce, allgather, reducescatter and broadcast.
+    """
+
+    def __init__(self, kind, devices, hops, graph, mtlink):
+        self.kind = kind
+        self.devices = devices
+        self.hops = hops
+        self.hopBandwidth = [graph[i][j] for i, j in hops]
+        self.bottleneck = min(self.hopBandwidth) if hops else 0.0
+        self.mtlinkOnly = all(mtlink[i][j] for i, j in hops)
+        self.estimates = self._estimate(len(devices))
+
+    @property
+    def order(self):
+        return [d.index for d in self.devices]
+
+    def _estimate(self, n):
+        b = self.bottleneck
+        if n < 2 or not b:
+            return {
+                "allreduce": 0.0,
+                "allgather": 0.0,
+                "reducescatter": 0.0,
+                "broadcast": 0.0,
+            }
+        if self.kind == "ring":
+            # bytes each rank moves per payload byte: 2(n-1)/n for allreduce, (n-1)/n otherwise
+            return {
+                "allreduce": b * n / (2.0 * (n - 1)),
+                "allgather": b * n / (n - 1.0),
+                "reducescatter": b * n / (n - 1.0),
+                "broadcast": b,
+            }
+        # pipelined tree: reduce up and broadcast down use opposite directions of each link
+        return {
+            "allreduce": b,
+            "allgather": b / 2.0,
+            "reducescatter": b / 2.0,
+            "broadcast": b,
+        }
+
+    def __repr__(self):
+        return (
+            "MtmlCollectivePlan(%s, order=%r, bottleneck=%.1f GB/s, mtlinkOnly=%s)"
+            % (
+                self.kind,
+                self.order,
+                self.bottleneck,
+                self.mtlinkOnly,
+            )
+        )
+
+
+def _hamiltonianCycle(n, adjacent):
+    """A Hamiltonian cycle through 0..n-1 over bitmask adjacency, or None (Held-Karp)."""
+    full = (1 << n) - 1
+    # reach[mask]: bitmask of vertices v such that a path from 0 through exactly mask ends at v
+    reach = [0] * (1 << n)
+    reach[1] = 1
+    for mask in range(1, full + 1, 2):
+        ends = reach[mask]
+        while ends:
+            v = (ends & -ends).bit_length() - 1
+            ends &= ends - 1
+            step = adjacent[v] & ~mask
+            while step:
+                w = (step & -step).bit_length() - 1
+                step &= step - 1
+                reach[mask | 1 << w] |= 1 << w
+    last = reach[full] & adjacent[0]
+    if not last:
+        return None
+    # walk back from any end that closes the cycle
+    cycle, mask, v = [], full, (last & -last).bit_length() - 1
+    while v != 0:
+        cycle.append(v)
+        mask &= ~(1 << v)
+        prev = reach[mask] & adjacent[v]
+        v = (prev & -prev).bit_length() - 1
+    cycle.append(0)
+    return cycle[::-1]
+
+
+def _slowest(graph, ring):
+    n = len(ring)
+    return min(
+        min(graph[ring[k]][ring[(k + 1) % n]], graph[ring[(k + 1) % n]][ring[k]])
+        for k in range(n)
+    )
+
+
+def _greedyRing(graph):
+    """Fastest-next-hop ring, then 2-opt moves that raise the slowest hop."""
+    n = len(graph)
+    ring, left = [0], set(range(1, n))
+    while left:
+        last = ring[-1]
+        nxt = max(left, key=lambda j: (min(graph[last][j], graph[j][last]), -j))
+        ring.append(nxt)
+        left.remove(nxt)
+
+    best = _slowest(graph, ring)
+    improved = True
+    while improved:
+        improved = False
+        for a in range(1, n - 1):
+            for b in range(a + 1, n):
+                candidate = ring[:a] + ring[a : b + 1][::-1] + ring[b + 1 :]
+                slowest = _slowest(graph, candidate)
+                if slowest > best:
+                    ring, best, improved = candidate, slowest, True
+    return ring
+
+
+def _exactRing(graph):
+    """
+    The greedy ring, unless a ring with a faster slowest hop exists. Every device needs two
+    ring hops, so no ring beats the smallest second-fastest hop of any device; only the
+    thresholds between the greedy result and that bound are searched, usually none.
+    """
+    n = len(graph)
+    ring = _greedyRing(graph)
+    found = _slowest(graph, ring)
+    bound = min(
+        sorted(min(graph[i][j], graph[j][i]) for j in range(n) if j != i)[-2]
+        for i in range(n)
+    )
+    thresholds = sorted(
+        {
+            min(graph[i][j], graph[j][i])
+            for i in range(n)
+            for j in range(n)
+            if i != j and found < min(graph[i][j], graph[j][i]) <= bound
+        }
+    )
+    lo, hi = 0, len(thresholds) - 1
+    # the largest threshold whose "hops at least this fast" graph still has a ring
+    while lo <= hi:
+        mid = (lo + hi) // 2
+        t = thresholds[mid]
+        adjacent = [
+            sum(
+                1 << j
+                for j in range(n)
+                if j != i and min(graph[i][j], graph[j][i]) >= t
+            )
+            for i in range(n)
+        ]
+        cycle = _hamiltonianCycle(n, adjacent)
+        if cycle is None:
+            hi = mid - 1
+        else:
+            ring, lo = cycle, mid + 1
+    return ring
+
+
+def _devices(devices):
+    registry = mtmlGetDeviceRegistry()
+    if devices is None:
+        return list(registry.devices)
+    return [
+        (
+            d
+            if isinstance(d, MtmlDevice)
+            else (
+                registry.byIndex(d)
+                if isinstance(d, int)
+                else registry.byUuid(d) if isinstance(d, str) else registry.byHandle(d)
+            )
+        )
+        for d in devices
+    ]
+
+
+def mtmlCollectiveRing(devices=None):
+    """
+    Ring order over `devices` (MtmlDevice, handle, index or UUID; all devices by default)
+    that maximizes the bandwidth of its slowest hop.
+    """
+    devices = _devices(devices)
+    graph, mtlink = mtmlCollectiveLinkGraph(devices)
+    n = len(devices)
+    if n < 3:
+        ring = list(range(n))
+    elif n <= MTML_COLLECTIVE_EXACT_LIMIT:
+        ring = _exactRing(graph)
+    else:
+        ring = _greedyRing(graph)
+    # renumber so the plan's positions follow the ring
+    ordered = [devices[i] for i in ring]
+    graph = [[graph[i][j] for j in ring] for i in ring]
+    mtlink = [[mtlink[i][j] for j in ring] for i in ring]
+    hops = [(k, (k + 1) % n) for k in range(n)] if n > 1 else []
+    return MtmlCollectivePlan("ring", ordered, hops, graph, mtlink)
+
+
+def mtmlCollectiveTree(devices=None, root=None, maxChildren=2):
+    """
+    Spanning tree over `devices` rooted at `root` (the first device by default) in which no
+    device has more than `maxChildren` children, built Prim-style by always attaching the
+    device reachable over the fastest hop. The plan's devices are in breadth-first order
+    from the root; `parents[k]` is the position of device k's parent (-1 for the root).
+    """
+    devices = _devices(devices)
+    if root is not None:
+        root = _devices([root])[0]
+        devices.remove(root)
+        devices.insert(0, root)
+    graph, mtlink = mtmlCollectiveLinkGraph(devices)
+    n = len(devices)
+    parent = [-1] * n
+    children = [0] * n
+    inTree = [0]
+    while len(inTree) < n:
+        best = None
+        for i in inTree:
+            if children[i] >= maxChildren:
+                continue
+            for j in range(n):
+                if j in inTree or parent[j] >= 0:
+                    continue
+                bw = min(graph[i][j], graph[j][i])
+                if best is None or bw > best[0]:
+                    best = (bw, i, j)
+        if best is None:
+            raise ValueError("maxChildren must be at least 1")
+        _, i, j = best
+        parent[j] = i
+        children[i] += 1
+        inTree.append(j)
+
+    # breadth-first renumbering keeps every parent before its children
+    order, k = [0], 0
+    while k < len(order):
+        order += [j for j in range(n) if parent[j] == order[k]]
+        k += 1
+    position = {v: p for p, v in enumerate(order)}
+    plan = MtmlCollectivePlan(
+        "tree",
+        [devices[v] for v in order],
+        [(position[parent[v]], position[v]) for v in order[1:]],
+        [[graph[i][j] for j in order] for i in order],
+        [[mtlink[i][j] for j in order] for i in order],
+    )
+    plan.parents = [-1] + [position[parent[v]] for v in order[1:]]
+    return plan
@@ -0,0 +1,445 @@
+#!/usr/bin/env python3
+##
+# Prometheus exporter for pymtml
+#
+# Serves /metrics from bytes rendered once per sampler tick, so scrapes never reach the
+# driver: any number of Prometheus replicas cost the same driver load as none. Per-tick
+# metrics come from the sampler snapshot; MtLink, ECC, page retirement and MPC state change
+# slowly and are refreshed on their own thread every `slowInterval` seconds.
+#
+# MtmlPushExporter is the push-mode counterpart: it sends each tick over UDP in StatsD or
+# InfluxDB line protocol.
+##
+import argparse
+import socket
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+from pymtml import *
+
+# snapshot metric -> (Prometheus name, help)
+MTML_EXPORTER_SNAPSHOT_METRICS = (
+    ("gpuUtil", "mtml_gpu_utilization_percent", "GPU utilization"),
+    ("gpuClock", "mtml_gpu_clock_mhz", "GPU clock"),
+    ("temperature", "mtml_gpu_temperature_celsius", "GPU temperature"),
+    ("powerUsage", "mtml_power_usage_milliwatts", "Board power draw"),
+    ("memoryUtil", "mtml_memory_utilization_percent", "Memory utilization"),
+    ("memoryTotal", "mtml_memory_total_bytes", "Total device memory"),
+    ("memoryUsed", "mtml_memory_used_bytes", "Used device memory"),
+    ("memoryClock", "mtml_memory_clock_mhz", "Memory clock"),
+    ("vpuClock", "mtml_vpu_clock_mhz", "VPU clock"),
+    ("encodeUtil", "mtml_vpu_encoder_utilization_percent", "VPU encoder utilization"),
+    ("decodeUtil", "mtml_vpu_decoder_utilization_percent", "VPU decoder utilization"),
+)
+
+CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8"
+
+
+def _escape(value):
+    return value.replace("\\", "\\\\").replace('"', '\\"').replace("\n", "\\n")
+
+
+def _escapeTag(value):
+    return (
+        value.replace("\\", "\\\\")
+        .replace(",", "\\,")
+        .replace("=", "\\=")
+        .replace(" ", "\\ ")
+    )
+
+
+def _labels(**labels):
+    return ",".join('%s="%s"' % (k, _escape(str(v))) for k, v in labels.items())
+
+
+class MtmlPrometheusExporter(object):
+    """
+    Renders the exposition text for `sampler` after every poll and serves it over HTTP on
+    `address`:`port`. Each series carries uuid, index, name and sbdf labels.
+    """
+
+    def __init__(self, sampler, port=9400, address="", slowInterval=10.0):
+        self.sampler = sampler
+        self.port = port
+        self.address = address
+        self.slowInterval = slowInterval
+        registry = mtmlGetDeviceRegistry()
+        self._devices = []
+        for handle in sampler.snapshot.handles:
+            device = registry.byHandle(handle)
+            try:
+                name = mtmlDeviceGetName(handle)
+            except MTMLError:
+                name = ""
+            labels = _labels(
+                uuid=device.uuid, index=device.index, name=name, sbdf=device.sbdf or ""
+            )
+            self._devices.append((device, labels))
+
+        # per-tick lines are "<prefix><value>\n"; prefixes are built once
+        self._families = []
+        for metric, name, help in MTML_EXPORTER_SNAPSHOT_METRICS:
+            header = "# HELP %s %s\n# TYPE %s gauge\n" % (name, help, name)
+            prefixes = ["%s{%s} " % (name, labels) for _, labels in self._devices]
+            self._families.append((metric, header, prefixes))
+
+        self._slowText = ""
+        self._body = b""
+        self._lock = threading.Lock()
+        self._memories = {}
+        self._stop = threading.Event()
+        self._threads = []
+        self._server = None
+        self.refreshSlow()
+        self.render(sampler.snapshot)
+        sampler.addListener(self._onSample)
+
+    ## Rendering
+    def _onSample(self, sampler, snapshot):
+        self.render(snapshot)
+
+    def render(self, snapshot):
+        """Renders the exposition for `snapshot` and caches it as the /metrics body."""
+        out = []
+        for metric, header, prefixes in self._families:
+            out.append(header)
+            column = snapshot.column(metric)
+            for slot, prefix in enumerate(prefixes):
+                if snapshot[slot].status(metric) == MTML_SUCCESS:
+                    out.append("%s%d\n" % (prefix, column[slot]))
+        out.append(
+            "# HELP mtml_exporter_sample_timestamp_seconds Time of the last poll\n"
+            "# TYPE mtml_exporter_sample_timestamp_seconds gauge\n"
+            "mtml_exporter_sample_timestamp_seconds %.3f\n" % snapshot.timestamp
+        )
+        out.append(self._slowText)
+        body = "".join(out).encode()
+        with self._lock:
+            self._body = body
+        return body
+
+    @property
+    def body(self):
+        with self._lock:
+            return self._body
+
+    def _memory(self, device):
+        memory = self._memories.get(device.uuid)
+        if memory is None:
+            memory = self._memories[device.uuid] = mtmlDeviceInitMemory(device.handle)
+        return memory
+
+    def refreshSlow(self):
+        """Re-reads MtLink, ECC, page retirement and MPC state into the cached text."""
+        families = {
+            "mtml_mtlink_state": ("gauge", "MtLink state (0 down, 1 up, 2 downgraded)"),
+            "mtml_ecc_errors": ("gauge", "ECC error count in DRAM"),
+            "mtml_retired_pages": ("gauge", "Retired memory pages"),
+            "mtml_retired_pages_pending": ("gauge", "Page retirement pending a reset"),
+            "mtml_mpc_mode": ("gauge", "MPC mode (0 disabled, 1 enabled)"),
+            "mtml_mpc_instances": ("gauge", "Number of MPC instances"),
+        }
+        samples = {name: [] for name in families}
+
+        def add(name, labels, value):
+            samples[name].append("%s{%s} %d\n" % (name, labels, value))
+
+        for device, labels in self._devices:
+            handle = device.handle
+            try:
+                links = mtmlDeviceGetMtLinkSpec(handle).linkNum
+                for link in range(links):
+                    state = mtmlDeviceGetMtLinkState(handle, link)
+                    add("mtml_mtlink_state", labels + ',link="%d"' % link, state)
+            except MTMLError:
+                pass
+            try:
+                memory = self._memory(device)
+                for errorType, kind in (
+                    (MTML_MEMORY_ERROR_TYPE_CORRECTED, "corrected"),
+                    (MTML_MEMORY_ERROR_TYPE_UNCORRECTED, "uncorrected"),
+                ):
+                    for counterType, counter in (
+                        (MTML_VOLATILE_ECC, "volatile"),
+                        (MTML_AGGREGATE_ECC, "aggregate"),
+                    ):
+                        count = mtmlMemoryGetEccErrorCounter(
+                            memory, errorType, counterType, MTML_MEMORY_LOCATION_DRAM
+                        )
+                        add(
+                            "mtml_ecc_errors",
+                            labels + ',type="%s",counter="%s"' % (kind, counter),
+                            count,
+                        )
+            except MTMLError:
+                pass
+            try:
+                retired = mtmlMemoryGetRetiredPagesCount(self._memory(device))
+                add("mtml_retired_pages", labels + ',cause="sbe"', retired.singleBitEcc)
+                add("mtml_retired_pages", labels + ',cause="dbe"', retired.doubleBitEcc)
+                pending = mtmlMemoryGetRetiredPagesPendingStatus(self._memory(device))
+                add("mtml_retired_pages_pending", labels, pending)
+            except MTMLError:
+                pass
+            try:
+                add("mtml_mpc_mode", labels, mtmlDeviceGetMpcMode(handle))
+                add("mtml_mpc_instances", labels, mtmlDeviceCountMpcInstances(handle))
+            except MTMLError:
+                pass
+
+        out = []
+        for name, (kind, help) in families.items():
+            if samples[name]:
+                out.append("# HELP %s %s\n# TYPE %s %s\n" % (name, help, name, kind))
+                out.extend(samples[name])
+        self._slowText = "".join(out)
+
+    def _slowLoop(self):
+        while not self._stop.wait(self.slowInterval):
+            self.refreshSlow()
+
+    ## Serving
+    def start(self):
+        """Starts the HTTP server and the slow-metric refresh thread."""
+        exporter = self
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                if self.path.split("?")[0] != "/metrics":
+                    self.send_error(404)
+                    return
+                body = exporter.body
+                self.send_response(200)
+                self.send_header("Content-Type", CONTENT_TYPE)
+                self.send_header("Content-Length", str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def log_message(self, format, *args):
+                pass
+
+        self._server = ThreadingHTTPServer((self.address, self.port), Handler)
+        self._server.daemon_threads = True
+        self.port = self._server.server_address[1]
+        self._stop.clear()
+        self._threads = [
+            threading.Thread(
+                target=self._server.serve_forever, name="mtml-exporter", daemon=True
+            ),
+            threading.Thread(
+                target=self._slowLoop, name="mtml-exporter-slow", daemon=True
+            ),
+        ]
+        for thread in self._threads:
+            thread.start()
+        return self
+
+    def close(self):
+        try:
+            self.sampler.removeListener(self._onSample)
+        except ValueError:
+            pass
+        self._stop.set()
+        if self._server is not None:
+            self._server.shutdown()
+            self._server.server_close()
+            self._server = None
+        for thread in self._threads:
+            thread.join()
+        self._threads = []
+        memories, self._memories = self._memories, {}
+        for memory in memories.values():
+            try:
+                mtmlDeviceFreeMemory(memory)
+            except MTMLError:
+                pass
+
+
+class MtmlPushExporter(object):
+    """
+    Pushes every poll of `sampler` to `host`:`port` over UDP, as StatsD gauges
+    ("<prefix>.gpu<index>.<metric>:<value>|g") or InfluxDB line protocol (one line per device,
+    measurement `prefix` tagged with uuid, index, name and sbdf).
+
+    Only values that changed since they were last sent go out, except on every
+    `fullRefresh`-th tick which sends everything so a restarted collector catches up. Lines
+    are packed into as few datagrams of at most `mtu` bytes as possible, and the name and tag
+    prefixes are encoded once, so a tick only formats the numbers.
+    """
+
+    PROTOCOLS = ("statsd", "influx")
+
+    def __init__(
+        self,
+        sampler,
+        host="127.0.0.1",
+        port=8125,
+        protocol="statsd",
+        prefix="mtml",
+        mtu=1432,
+        fullRefresh=60,
+    ):
+        if protocol not in self.PROTOCOLS:
+            raise ValueError("protocol must be one of %s" % (self.PROTOCOLS,))
+        self.sampler = sampler
+        self.protocol = protocol
+        self.mtu = mtu
+        self.fullRefresh = fullRefresh
+        self.ticks = 0
+        self.datagrams = 0
+        self.values = 0
+        self.errors = 0
+
+        registry = mtmlGetDeviceRegistry()
+        devices = [registry.byHandle(h) for h in sampler.snapshot.handles]
+        # field names without the mtml_ family prefix, e.g. gpu_utilization_percent
+        fields = [(m, n[len("mtml_") :]) for m, n, _ in MTML_EXPORTER_SNAPSHOT_METRICS]
+        self._metrics = [m for m, _ in fields]
+        if protocol == "statsd":
+            # [metric][slot] -> b"mtml.gpu0.gpu_utilization_percent:"
+            self._prefixes = [
+                [("%s.gpu%d.%s:" % (prefix, d.index, f)).encode() for d in devices]
+                for _, f in fields
+            ]
+        else:
+            self._fields = [("%s=" % f).encode() for _, f in fields]
+            self._measurements = []
+            for d in devices:
+                try:
+                    name = mtmlDeviceGetName(d.handle)
+                except MTMLError:
+                    name = ""
+                tags = [("uuid", d.uuid), ("index", d.index), ("name", name)]
+                tags.append(("sbdf", d.sbdf or ""))
+                self._measurements.append(
+                    (
+                        prefix
+                        + "".join(
+                            ",%s=%s" % (k, _escapeTag(str(v)))
+                            for k, v in tags
+                            if v != ""
+                        )
+                        + " "
+                    ).encode()
+                )
+        self._last = [[None] * len(devices) for _ in self._metrics]
+
+        family = socket.AF_INET6 if ":" in host else socket.AF_INET
+        self._socket = socket.socket(family, socket.SOCK_DGRAM)
+        self._socket.connect((host, port))
+        sampler.addListener(self._onSample)
+
+    def _onSample(self, sampler, snapshot):
+        for datagram in self.encode(snapshot):
+            try:
+                self._socket.send(datagram)
+                self.datagrams += 1
+            except OSError:
+                # collector down or buffer full: drop, resend on refresh
+                self.errors += 1
+
+    def encode(self, snapshot):
+        """Datagrams carrying the changed (or, on a refresh tick, all) values of `snapshot`."""
+        full = self.ticks % self.fullRefresh == 0
+        self.ticks += 1
+        if self.protocol == "statsd":
+            lines = self._statsdLines(snapshot, full)
+        else:
+            lines = self._influxLines(snapshot, full)
+
+        datagrams = []
+        current = bytearray()
+        for line in lines:
+            if current and len(current) + len(line) > self.mtu:
+                datagrams.append(bytes(current[:-1]))  # drop the trailing newline
+                current = bytearray()
+            current += line
+        if current:
+            datagrams.append(bytes(current[:-1]))
+        return datagrams
+
+    def _changed(self, snapshot, full):
+        """Yields (metric position, slot, value) to send and records them as sent."""
+        for i, metric in enumerate(self._metrics):
+            column = snapshot.column(metric)
+            last = self._last[i]
+            for slot in range(len(last)):
+                if snapshot[slot].status(metric) != MTML_SUCCESS:
+                    continue
+                value = column[slot]
+                if full or value != last[slot]:
+                    last[slot] = value
+                    self.values += 1
+                    yield i, slot, value
+
+    def _statsdLines(self, snapshot, full):
+        prefixes = self._prefixes
+        return [
+            b"%s%d|g\n" % (prefixes[i][slot], value)
+            for i, slot, value in self._changed(snapshot, full)
+        ]
+
+    def _influxLines(self, snapshot, full):
+        perDevice = {}
+        for i, slot, value in self._changed(snapshot, full):
+            perDevice.setdefault(slot, []).append(b"%s%di" % (self._fields[i], value))
+        ts = snapshot.buffer.timestamp
+        stamp = b" %d\n" % (ts.tv_sec * 1000000000 + ts.tv_nsec)
+        return [
+            self._measurements[slot] + b",".join(fields) + stamp
+            for slot, fields in sorted(perDevice.items())
+        ]
+
+    def close(self):
+        try:
+            self.sampler.removeListener(self._onSample)
+        except ValueError:
+            pass
+        self._socket.close()
+
+
+def main():
+    from pymtml_sampler import MtmlSampler
+
+    parser = argparse.ArgumentParser(description="Metrics exporter for MTML devices")
+    parser.add_argument("--port", type=int, default=9400)
+    parser.add_argument("--address", default="")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds per poll")
+    parser.add_argument(
+        "--push", metavar="HOST:PORT", help="push over UDP instead of serving /metrics"
+    )
+    parser.add_argument(
+        "--protocol", choices=MtmlPushExporter.PROTOCOLS, default="statsd"
+    )
+    args = parser.parse_args()
+
+    mtmlLibraryInit()
+    sampler = MtmlSampler(interval=args.interval, capacity=16)
+    if args.push:
+        host, _, port = args.push.rpartition(":")
+        exporter = MtmlPushExporter(
+            sampler, host.strip("[]"), int(port), protocol=args.protocol
+        )
+        print("Pushing %s to %s" % (args.protocol, args.push))
+    else:
+        exporter = MtmlPrometheusExporter(sampler, args.port, args.address).start()
+        print(
+            "Serving http://%s:%d/metrics" % (args.address or "0.0.0.0", exporter.port)
+        )
+    sampler.start()
+    try:
+        while True:
+            time.sleep(3600)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        exporter.close()
+        sampler.close()
+        mtmlLibraryShutDown()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
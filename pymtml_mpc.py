@@ -0,0 +1,487 @@
+##
+# MPC configuration planner
+#
+# mtmlMpcPlan turns workload demands (GPU cores and memory MB per instance) into one
+# MtmlMpcConfiguration id per device. Each demand goes to the smallest supported profile
+# slot it fits, and devices are filled one at a time with the configuration that serves the
+# most remaining demands while stranding the least capacity, so demands pack onto as few
+# devices as possible and the rest stay whole. MtmlMpcPlan.apply() sends every change in one
+# mtmlLibrarySetMpcConfigurationInBatch call and checks the result with
+# mtmlDeviceGetMpcInstances and mtmlDeviceGetMpcProfileInfo.
+#
+# Supported profiles and configurations only change with the driver, so they are read once
+# per device (by UUID) into an MtmlMpcCatalog.
+#
+# MtmlMpcInventory keeps the parent -> instance tree of a set of devices. It is read once
+# (instance handles, indexes, UUIDs and profiles) and afterwards refresh() costs one
+# mtmlDeviceGetMpcConfiguration call per parent, rereading only parents whose configuration
+# changed. The instance handles go into an MtmlSnapshot like any device handle, and rollup()
+# folds a polled snapshot back into per-parent totals.
+##
+import threading
+
+from pymtml import *
+
+_MB = 1 << 20
+
+
+class MtmlMpcDemand(object):
+    """`count` instances of at least `cores` GPU cores and `memoryMB` MB of memory each."""
+
+    __slots__ = ("cores", "memoryMB", "count", "name")
+
+    def __init__(self, cores, memoryMB, count=1, name=None):
+        self.cores = cores
+        self.memoryMB = memoryMB
+        self.count = count
+        self.name = name
+
+    def __repr__(self):
+        return "MtmlMpcDemand(cores=%d, memoryMB=%d, count=%d, name=%r)" % (
+            self.cores,
+            self.memoryMB,
+            self.count,
+            self.name,
+        )
+
+
+class MtmlMpcCatalog(object):
+    """
+    Supported MPC profiles and configurations of one device. `profiles` maps profile id to
+    (name, cores, memoryMB), `configurations` maps configuration id to (name, profile ids),
+    and `cores` / `memoryMB` is the whole device, which a configuration without profiles
+    leaves unpartitioned.
+    """
+
+    def __init__(self, uuid, cores, memoryMB, profiles, configurations):
+        self.uuid = uuid
+        self.cores = cores
+        self.memoryMB = memoryMB
+        self.profiles = profiles
+        self.configurations = configurations
+
+    def slots(self, configurationId):
+        """(profile id, cores, memoryMB) of each instance `configurationId` creates."""
+        profileIds = self.configurations[configurationId][1]
+        if not profileIds:
+            return [(0, self.cores, self.memoryMB)]
+        return [(p,) + self.profiles[p][1:] for p in profileIds]
+
+    def size(self, cores, memoryMB):
+        """Share of the whole device, averaging the core and memory fractions."""
+        return (
+            cores / float(self.cores or 1) + memoryMB / float(self.memoryMB or 1)
+        ) / 2.0
+
+
+def _readCatalog(device):
+    handle = device.handle
+    cores = mtmlDeviceCountGpuCores(handle)
+    memory = mtmlDeviceInitMemory(handle)
+    try:
+        memoryMB = mtmlMemoryGetTotal(memory) // _MB
+    finally:
+        mtmlDeviceFreeMemory(memory)
+    profiles = {
+        p.profileId: (p.name, p.gpuCores, p.memSize // _MB)
+        for p in mtmlDeviceGetSupportedMpcProfiles(
+            handle, mtmlDeviceCountSupportedMpcProfiles(handle)
+        )
+    }
+    configurations = {
+        c.id: (c.name, tuple(c.profileIds[: c.profileNum]))
+        for c in mtmlDeviceGetSupportedMpcConfigurations(
+            handle, mtmlDeviceCountSupportedMpcConfigurations(handle)
+        )
+    }
+    return MtmlMpcCatalog(device.uuid, cores, memoryMB, profiles, configurations)
+
+
+_mtmlMpcCatalogs = dict()  # device UUID -> MtmlMpcCatalog
+_mtmlMpcCatalogsLock = threading.Lock()
+
+
+def mtmlMpcCatalogGet(device):
+    """The MtmlMpcCatalog of `device` (MtmlDevice), read once and cached by UUID."""
+    catalog = _mtmlMpcCatalogs.get(device.uuid)
+    if catalog is None:
+        catalog = _readCatalog(device)
+        with _mtmlMpcCatalogsLock:
+            catalog = _mtmlMpcCatalogs.setdefault(device.uuid, catalog)
+    return catalog
+
+
+class MtmlMpcVerifyError(RuntimeError):
+    """Raised by MtmlMpcPlan.apply when a device did not end up as planned."""
+
+    def __init__(self, mismatches):
+        RuntimeError.__init__(
+            self, "MPC configuration not applied on %s" % ", ".join(sorted(mismatches))
+        )
+        self.mismatches = mismatches
+
+
+class MtmlMpcPlan(object):
+    """
+    Target configuration per device. `targets` and `current` map device UUID to
+    configuration id; `assignments` lists (demand index, device UUID, slot, profile id) for
+    every placed instance, where slot is the instance's position in the configuration (the
+    profile id is 0 for a whole device); `unplaced` lists the demand index of every instance
+    that did not fit. `fragmentation` is the share of the partitioned devices' capacity that
+    no demand uses, from 0 (packed tight) to 1.
+    """
+
+    def __init__(self, devices, targets, current, assignments, unplaced, fragmentation):
+        self.devices = devices
+        self.targets = targets
+        self.current = current
+        self.assignments = assignments
+        self.unplaced = unplaced
+        self.fragmentation = fragmentation
+
+    @property
+    def complete(self):
+        return not self.unplaced
+
+    @property
+    def changes(self):
+        """(UUID, configuration id) of every device whose configuration changes."""
+        return [
+            (d.uuid, self.targets[d.uuid])
+            for d in self.devices
+            if d.uuid in self.targets and self.targets[d.uuid] != self.current[d.uuid]
+        ]
+
+    def apply(self, verify=True, partial=False):
+        """
+        Applies every change in one mtmlLibrarySetMpcConfigurationInBatch call, then (with
+        `verify`) raises MtmlMpcVerifyError unless every device reports the planned instances.
+        Refuses an incomplete plan with ValueError unless `partial`. Device handles are
+        invalid afterwards; fetch them again from mtmlGetDeviceRegistry().
+        """
+        if self.unplaced and not partial:
+            raise ValueError("%d demanded instances do not fit" % len(self.unplaced))
+        changes = self.changes
+        if changes:
+            registry = mtmlGetDeviceRegistry()
+            mtmlLibrarySetMpcConfigurationInBatch(
+                [registry.byUuid(uuid).handle for uuid, _ in changes],
+                [configurationId for _, configurationId in changes],
+            )
+        if verify:
+            mismatches = self.verify()
+            if mismatches:
+                raise MtmlMpcVerifyError(mismatches)
+
+    def verify(self):
+        """
+        Devices whose configuration or MPC instances differ from the plan, as UUID ->
+        ((planned configuration, profile ids), (actual configuration, profile ids)).
+        """
+        registry = mtmlGetDeviceRegistry()
+        mismatches = {}
+        for uuid, target in self.targets.items():
+            device = registry.byUuid(uuid)
+            planned = mtmlMpcCatalogGet(device).configurations[target][1]
+            count = mtmlDeviceCountMpcInstances(device.handle)
+            instances = mtmlDeviceGetMpcInstances(device.handle, count) if count else []
+            expected = (target, sorted(planned))
+            actual = (
+                mtmlDeviceGetMpcConfiguration(device.handle).id,
+                sorted(mtmlDeviceGetMpcProfileInfo(i).profileId for i in instances),
+            )
+            if actual != expected:
+                mismatches[uuid] = (expected, actual)
+        return mismatches
+
+    def __repr__(self):
+        return "MtmlMpcPlan(targets=%r, unplaced=%d, fragmentation=%.2f)" % (
+            self.targets,
+            len(self.unplaced),
+            self.fragmentation,
+        )
+
+
+def _fit(catalog, configurationId, pending):
+    """
+    Best-fit of `pending` instances (demand index, cores, memoryMB, copy), largest first,
+    into the slots of one configuration: [(instance, slot, profile id)], the stranded
+    capacity inside used slots and in unused slots, and the capacity of all slots.
+    """
+    slots = sorted(
+        (catalog.size(cores, memory), k, profileId, cores, memory)
+        for k, (profileId, cores, memory) in enumerate(catalog.slots(configurationId))
+    )
+    capacity = sum(slot[0] for slot in slots)
+    placed, waste = [], 0.0
+    for instance in pending:
+        _, cores, memory, _ = instance
+        for s, slot in enumerate(slots):
+            if slot[3] >= cores and slot[4] >= memory:
+                placed.append((instance, slot[1], slot[2]))
+                waste += slot[0] - catalog.size(cores, memory)
+                del slots[s]
+                break
+    return placed, waste, sum(slot[0] for slot in slots), capacity
+
+
+def mtmlMpcPlan(demands, devices=None, resetIdle=False):
+    """
+    Plans configurations over `devices` (MtmlDevice list, all devices by default) for
+    `demands` (MtmlMpcDemand list). Devices no demand needs keep their configuration, or go
+    back to the unpartitioned one with `resetIdle`. Returns an MtmlMpcPlan.
+    """
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    devices = list(devices)
+    catalogs = {d.uuid: mtmlMpcCatalogGet(d) for d in devices}
+    current = {d.uuid: mtmlDeviceGetMpcConfiguration(d.handle).id for d in devices}
+
+    # one entry per instance, largest first so big demands are not crowded out
+    pending = sorted(
+        (
+            (i, demand.cores, demand.memoryMB, copy)
+            for i, demand in enumerate(demands)
+            for copy in range(demand.count)
+        ),
+        key=lambda p: (-p[1], -p[2], p[0], p[3]),
+    )
+    targets, assignments, stranded, capacity = {}, [], 0.0, 0.0
+    free = list(devices)
+    while pending and free:
+        best = None
+        for device in free:
+            catalog = catalogs[device.uuid]
+            for configurationId in catalog.configurations:
+                placed, waste, unused, size = _fit(catalog, configurationId, pending)
+                # most instances served, then least capacity stranded in used and unused
+                # slots, then no reconfiguration, then the lowest configuration id
+                score = (
+                    len(placed),
+                    -round(waste, 9),
+                    -round(unused, 9),
+                    configurationId == current[device.uuid],
+                    -configurationId,
+                )
+                if placed and (best is None or score > best[0]):
+                    best = (
+                        score,
+                        device,
+                        configurationId,
+                        placed,
+                        waste + unused,
+                        size,
+                    )
+        if best is None:
+            break
+        _, device, configurationId, placed, waste, size = best
+        targets[device.uuid] = configurationId
+        assignments += [(inst[0], device.uuid, slot, p) for inst, slot, p in placed]
+        stranded += waste
+        capacity += size
+        free.remove(device)
+        done = set(inst for inst, _, _ in placed)
+        pending = [p for p in pending if p not in done]
+
+    if resetIdle:
+        for device in free:
+            catalog = catalogs[device.uuid]
+            whole = [c for c, (_, ids) in catalog.configurations.items() if not ids]
+            if whole:
+                targets[device.uuid] = whole[0]
+    assignments.sort()
+    return MtmlMpcPlan(
+        devices,
+        targets,
+        current,
+        assignments,
+        sorted(p[0] for p in pending),
+        stranded / capacity if capacity else 0.0,
+    )
+
+
+class MtmlMpcInstance(object):
+    """One MPC instance: its parent MtmlDevice, index on the parent, handle and profile."""
+
+    __slots__ = (
+        "parent",
+        "index",
+        "uuid",
+        "handle",
+        "address",
+        "profileId",
+        "profileName",
+        "cores",
+        "memoryMB",
+    )
+
+    def __init__(self, parent, index, uuid, handle, profile):
+        self.parent = parent
+        self.index = index
+        self.uuid = uuid
+        self.handle = handle
+        self.address = cast(handle, c_void_p).value
+        self.profileId = profile.profileId
+        self.profileName = profile.name
+        self.cores = profile.gpuCores
+        self.memoryMB = profile.memSize // _MB
+
+    def __repr__(self):
+        return "MtmlMpcInstance(parent=%d, index=%d, uuid=%r, profile=%r)" % (
+            self.parent.index,
+            self.index,
+            self.uuid,
+            self.profileName,
+        )
+
+
+# how rollup() folds instance values into a parent value: totals add up, utilizations are
+# averaged weighted by instance cores, temperatures and clocks take the highest instance.
+# Every instance reports its parent board's power, so power is not added up either.
+MTML_MPC_ROLLUP = {
+    "gpuUtil": "weighted",
+    "gpuClock": "max",
+    "temperature": "max",
+    "memoryUtil": "weighted",
+    "memoryTotal": "sum",
+    "memoryUsed": "sum",
+    "memoryClock": "max",
+    "powerUsage": "max",
+    "vpuClock": "max",
+    "encodeUtil": "weighted",
+    "decodeUtil": "weighted",
+}
+
+
+class MtmlMpcInventory(object):
+    """
+    MPC instances of `devices` (MtmlDevice list, all devices by default). `parents` lists
+    the devices, `instances` maps parent UUID to its MtmlMpcInstance list in index order (empty
+    when not partitioned) and `generation` counts the refreshes that changed the tree.
+    """
+
+    def __init__(self, devices=None):
+        if devices is None:
+            devices = mtmlGetDeviceRegistry().devices
+        self._uuids = [d.uuid for d in devices]
+        self._registry = None
+        self._configurations = {}
+        self._rollupPlans = {}
+        self.parents = []
+        self.instances = {}
+        self.generation = 0
+        self.refresh()
+
+    def refresh(self):
+        """
+        Rereads the instances of every parent whose MPC configuration changed since the last
+        refresh, and of all parents after the device handles were invalidated. Returns whether
+        the tree changed.
+        """
+        registry = mtmlGetDeviceRegistry()
+        if registry is not self._registry:
+            # handles from before a reconfiguration or a library restart are all stale
+            self._registry = registry
+            self._configurations = {}
+            self.parents = [registry.byUuid(uuid) for uuid in self._uuids]
+        changed = False
+        for parent in self.parents:
+            try:
+                configurationId = mtmlDeviceGetMpcConfiguration(parent.handle).id
+            except MTMLError as e:
+                if e.value != MTML_ERROR_NOT_SUPPORTED:
+                    raise
+                configurationId = None  # no MPC on this device: never partitioned
+            if (
+                parent.uuid in self._configurations
+                and self._configurations[parent.uuid] == configurationId
+            ):
+                continue
+            self._configurations[parent.uuid] = configurationId
+            self.instances[parent.uuid] = (
+                self._readInstances(parent) if configurationId is not None else []
+            )
+            changed = True
+        if changed:
+            self.generation += 1
+            self._rollupPlans = {}
+        return changed
+
+    @staticmethod
+    def _readInstances(parent):
+        count = mtmlDeviceCountMpcInstances(parent.handle)
+        if not count:
+            return []
+        instances = [
+            MtmlMpcInstance(
+                parent,
+                mtmlDeviceGetMpcInstanceIndex(handle),
+                mtmlDeviceGetUUID(handle),
+                handle,
+                mtmlDeviceGetMpcProfileInfo(handle),
+            )
+            for handle in mtmlDeviceGetMpcInstances(parent.handle, count)
+        ]
+        instances.sort(key=lambda instance: instance.index)
+        return instances
+
+    def configuration(self, parent):
+        """
+        Configuration id of `parent` (MtmlDevice) as of the last refresh, None if it does not
+        support MPC.
+        """
+        return self._configurations[parent.uuid]
+
+    @property
+    def handles(self):
+        """Every instance handle, grouped by parent, for MtmlSnapshot or MtmlSampler."""
+        return [i.handle for p in self.parents for i in self.instances[p.uuid]]
+
+    def _rollupPlan(self, snapshot):
+        # (parent UUID, [(snapshot slot, cores)]) per parent, cached per snapshot layout
+        key = tuple(cast(h, c_void_p).value for h in snapshot.handles)
+        plan = self._rollupPlans.get(key)
+        if plan is None:
+            slots = {address: slot for slot, address in enumerate(key)}
+            plan = [
+                (
+                    p.uuid,
+                    [
+                        (slots[i.address], i.cores)
+                        for i in self.instances[p.uuid]
+                        if i.address in slots
+                    ],
+                )
+                for p in self.parents
+            ]
+            self._rollupPlans[key] = plan
+        return plan
+
+    def rollup(self, snapshot):
+        """
+        Per-parent totals from a polled MtmlSnapshot over instance handles, as parent UUID ->
+        {metric: value}, folded as MTML_MPC_ROLLUP says. Only successful reads count; a
+        metric no instance of a parent could read is None.
+        """
+        plan = self._rollupPlan(snapshot)
+        totals = {uuid: {} for uuid, _ in plan}
+        views = snapshot.devices
+        for metric, fold in MTML_MPC_ROLLUP.items():
+            column = snapshot.column(metric)
+            for uuid, slots in plan:
+                read = [
+                    (column[slot], cores)
+                    for slot, cores in slots
+                    if views[slot].status(metric) == MTML_SUCCESS
+                ]
+                if not read:
+                    value = None
+                elif fold == "sum":
+                    value = sum(v for v, _ in read)
+                elif fold == "max":
+                    value = max(v for v, _ in read)
+                else:
+                    weight = sum(cores for _, cores in read) or len(read)
+                    value = sum(v * (cores or 1) for v, cores in read) / float(weight)
+                totals[uuid][metric] = value
+        return totals
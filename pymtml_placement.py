@@ -0,0 +1,523 @@
+##
+# Bin-packing placement of vGPU and MPC requests
+#
+# mtmlPlacementSolve places requests for vGPU types or MPC profiles onto GPUs ("bins").
+# Bins are plain data: mtmlPlacementBins builds them for this node from the vGPU inventory
+# (MtmlVirtType framebuffer sizes and per-type available counts) and the MPC catalogs
+# (profile cores and memory, supported configurations), and toDict/fromDict carry them
+# between nodes, so an exported inventory of many nodes can be solved in one call.
+#
+# A GPU hosts either vGPUs or MPC instances. vGPUs of a type fit while the type still has
+# available devices and the GPU framebuffer lasts; MPC profiles fit while some supported
+# configuration holds every profile placed. The heuristic is first-fit decreasing with a
+# topology-aware choice of bin: requests of one group stay on their node, then on opened
+# GPUs, then near their group (same GPU, then same NUMA node), then in the tightest fit.
+# Small cases can be solved exactly with a branch-and-bound over the same constraints.
+##
+import socket
+
+from pymtml import *
+from pymtml_affinity import mtmlAffinityGet
+from pymtml_mpc import MtmlMpcInventory, mtmlMpcCatalogGet
+from pymtml_virt import mtmlVirtInventoryGet
+
+_MB = 1 << 20
+
+MTML_PLACEMENT_VGPU = "vgpu"
+MTML_PLACEMENT_MPC = "mpc"
+
+# above this many requested instances mode="auto" uses the heuristic
+MTML_PLACEMENT_EXACT_LIMIT = 12
+# branch-and-bound gives up (keeping its best placement so far) after this many nodes
+_EXACT_NODE_LIMIT = 200000
+
+
+class MtmlPlacementRequest(object):
+    """
+    `count` instances of vGPU type id or MPC profile id `type` (`kind` MTML_PLACEMENT_VGPU
+    or MTML_PLACEMENT_MPC). Requests sharing a `group` are placed close together; `numaNode`
+    prefers GPUs local to that NUMA node.
+    """
+
+    __slots__ = ("kind", "type", "count", "group", "numaNode", "name")
+
+    def __init__(self, kind, type, count=1, group=None, numaNode=None, name=None):
+        if kind not in (MTML_PLACEMENT_VGPU, MTML_PLACEMENT_MPC):
+            raise ValueError("kind must be 'vgpu' or 'mpc'")
+        self.kind = kind
+        self.type = type
+        self.count = count
+        self.group = group
+        self.numaNode = numaNode
+        self.name = name
+
+    def __repr__(self):
+        return "MtmlPlacementRequest(%s, %r, count=%d, group=%r)" % (
+            self.kind,
+            self.type,
+            self.count,
+            self.group,
+        )
+
+
+class MtmlPlacementBin(object):
+    """
+    Free capacity of one GPU. `vgpuTypes` maps vGPU type id to (available devices,
+    framebuffer MB) and `framebufferMB` is the framebuffer left for new vGPUs; `mpcProfiles`
+    maps MPC profile id to (cores, memory MB), `mpcConfigurations` maps configuration id to
+    the profile ids it still has room for, and `cores` / `memoryMB` is the whole GPU.
+    """
+
+    def __init__(
+        self,
+        node,
+        uuid,
+        numaNodes=(),
+        vgpuTypes=None,
+        framebufferMB=0,
+        mpcProfiles=None,
+        mpcConfigurations=None,
+        cores=0,
+        memoryMB=0,
+    ):
+        self.node = node
+        self.uuid = uuid
+        self.numaNodes = tuple(numaNodes)
+        self.vgpuTypes = dict(vgpuTypes or {})
+        self.framebufferMB = framebufferMB
+        self.mpcProfiles = dict(mpcProfiles or {})
+        self.mpcConfigurations = dict(mpcConfigurations or {})
+        self.cores = cores
+        self.memoryMB = memoryMB
+
+    @property
+    def key(self):
+        return (self.node, self.uuid)
+
+    def signature(self):
+        """Everything but identity, so interchangeable empty GPUs are only tried once."""
+        return (
+            self.node,
+            self.numaNodes,
+            tuple(sorted(self.vgpuTypes.items())),
+            self.framebufferMB,
+            tuple(sorted(self.mpcProfiles.items())),
+            tuple(sorted(self.mpcConfigurations.items())),
+        )
+
+    def toDict(self):
+        return {
+            "node": self.node,
+            "uuid": self.uuid,
+            "numaNodes": list(self.numaNodes),
+            "vgpuTypes": {k: list(v) for k, v in self.vgpuTypes.items()},
+            "framebufferMB": self.framebufferMB,
+            "mpcProfiles": {str(k): list(v) for k, v in self.mpcProfiles.items()},
+            "mpcConfigurations": {
+                str(k): list(v) for k, v in self.mpcConfigurations.items()
+            },
+            "cores": self.cores,
+            "memoryMB": self.memoryMB,
+        }
+
+    @classmethod
+    def fromDict(cls, data):
+        return cls(
+            data["node"],
+            data["uuid"],
+            data.get("numaNodes", ()),
+            {k: tuple(v) for k, v in data.get("vgpuTypes", {}).items()},
+            data.get("framebufferMB", 0),
+            {int(k): tuple(v) for k, v in data.get("mpcProfiles", {}).items()},
+            {int(k): tuple(v) for k, v in data.get("mpcConfigurations", {}).items()},
+            data.get("cores", 0),
+            data.get("memoryMB", 0),
+        )
+
+    def __repr__(self):
+        return "MtmlPlacementBin(node=%r, uuid=%r)" % (self.node, self.uuid)
+
+
+def _freeFramebufferMB(device):
+    memory = mtmlDeviceInitMemory(device.handle)
+    try:
+        return (mtmlMemoryGetTotal(memory) - mtmlMemoryGetUsed(memory)) // _MB
+    finally:
+        mtmlDeviceFreeMemory(memory)
+
+
+def _freeConfigurations(catalog, instances):
+    """
+    The profile ids each configuration of `catalog` has left once it holds the profiles of
+    `instances` (MtmlMpcInstance list), for the configurations that hold them all and leave
+    room for more.
+    """
+    configurations = {}
+    for configurationId, (_, ids) in catalog.configurations.items():
+        left = list(ids)
+        try:
+            for instance in instances:
+                left.remove(instance.profileId)
+        except ValueError:
+            continue
+        if left:
+            configurations[configurationId] = tuple(left)
+    return configurations
+
+
+def mtmlPlacementBins(devices=None, node=None):
+    """
+    MtmlPlacementBin list for `devices` (MtmlDevice list, all devices by default) of this
+    node, named `node` (the host name by default). A GPU already running MPC instances only
+    offers the configurations holding their profiles, less those instances, so a placement
+    never tears down a live instance; GPUs with active vGPUs offer no MPC capacity. The
+    vGPU framebuffer is the most any one type could still hand out, capped by the free
+    framebuffer the driver reports.
+    """
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    devices = list(devices)
+    if node is None:
+        node = socket.gethostname()
+    inventory = mtmlVirtInventoryGet(devices)
+    bins = []
+    for device in devices:
+        state = inventory.devices[device.uuid]
+        # a GPU whose state could not be read offers nothing until it reads again
+        vgpuTypes = {
+            t.id: (n, t.memoryMB) for t, n in zip(state.types, state.available or ())
+        }
+        # the framebuffer that the most generous type could still hand out, which mixed
+        # types could overcommit without the driver's count of what is actually free
+        framebufferMB = max([n * mb for n, mb in vgpuTypes.values()] or [0])
+        if framebufferMB:
+            try:
+                framebufferMB = min(framebufferMB, _freeFramebufferMB(device))
+            except MTMLError:
+                pass
+        profiles, configurations, cores, memoryMB = {}, {}, 0, 0
+        if state.known and not state.active:
+            try:
+                catalog = mtmlMpcCatalogGet(device)
+                profiles = {p: v[1:] for p, v in catalog.profiles.items()}
+                configurations = _freeConfigurations(
+                    catalog, MtmlMpcInventory([device]).instances[device.uuid]
+                )
+                cores, memoryMB = catalog.cores, catalog.memoryMB
+            except MTMLError:
+                pass
+        bins.append(
+            MtmlPlacementBin(
+                node,
+                device.uuid,
+                mtmlAffinityGet(device).numaNodes,
+                vgpuTypes,
+                framebufferMB,
+                profiles,
+                configurations,
+                cores,
+                memoryMB,
+            )
+        )
+    return bins
+
+
+class _BinState(object):
+    """What has been placed on one bin so far."""
+
+    __slots__ = ("bin", "kind", "placed", "framebufferMB", "groups")
+
+    def __init__(self, bin):
+        self.bin = bin
+        self.kind = None
+        self.placed = []  # type ids / profile ids
+        self.framebufferMB = 0
+        self.groups = {}
+
+    def fits(self, kind, type):
+        if self.kind not in (None, kind):
+            return False
+        bin = self.bin
+        if kind == MTML_PLACEMENT_VGPU:
+            spec = bin.vgpuTypes.get(type)
+            return (
+                spec is not None
+                and self.placed.count(type) < spec[0]
+                and self.framebufferMB + spec[1] <= bin.framebufferMB
+            )
+        if type not in bin.mpcProfiles:
+            return False
+        return self.configuration(self.placed + [type]) is not None
+
+    def configuration(self, profileIds):
+        """The supported configuration with fewest instances that holds `profileIds`."""
+        best = None
+        for configurationId, ids in sorted(self.bin.mpcConfigurations.items()):
+            left = list(ids)
+            try:
+                for p in profileIds:
+                    left.remove(p)
+            except ValueError:
+                continue
+            if best is None or len(ids) < best[1]:
+                best = (configurationId, len(ids))
+        return best[0] if best else None
+
+    def used(self):
+        """Share of the bin's capacity in use, from 0 to 1."""
+        bin = self.bin
+        if self.kind == MTML_PLACEMENT_VGPU:
+            return self.framebufferMB / float(bin.framebufferMB or 1)
+        if self.kind == MTML_PLACEMENT_MPC:
+            cores = sum(bin.mpcProfiles[p][0] for p in self.placed)
+            memory = sum(bin.mpcProfiles[p][1] for p in self.placed)
+            return (
+                cores / float(bin.cores or 1) + memory / float(bin.memoryMB or 1)
+            ) / 2.0
+        return 0.0
+
+    def push(self, kind, type, group):
+        self.kind = kind
+        self.placed.append(type)
+        if kind == MTML_PLACEMENT_VGPU:
+            self.framebufferMB += self.bin.vgpuTypes[type][1]
+        if group is not None:
+            self.groups[group] = self.groups.get(group, 0) + 1
+
+    def pop(self, kind, type, group):
+        self.placed.pop()
+        if kind == MTML_PLACEMENT_VGPU:
+            self.framebufferMB -= self.bin.vgpuTypes[type][1]
+        if group is not None:
+            self.groups[group] -= 1
+            if not self.groups[group]:
+                del self.groups[group]
+        if not self.placed:
+            self.kind = None
+
+
+def _affinity(states, state, request):
+    """
+    How well `state` suits `request`'s topology preferences: 3 when a group member is on the
+    same GPU, 2 when one is on a GPU sharing a NUMA node, 1 on the same node; plus 1 when
+    the GPU is local to the preferred NUMA node.
+    """
+    score = 0
+    if request.group is not None:
+        for other in states:
+            if request.group not in other.groups:
+                continue
+            if other is state:
+                score = max(score, 3)
+            elif other.bin.node == state.bin.node:
+                shared = set(other.bin.numaNodes) & set(state.bin.numaNodes)
+                score = max(score, 2 if shared else 1)
+    if request.numaNode is not None and request.numaNode in state.bin.numaNodes:
+        score += 1
+    return score
+
+
+def _groupNodes(states, request):
+    if request.group is None:
+        return None
+    return {s.bin.node for s in states if request.group in s.groups}
+
+
+class MtmlPlacement(object):
+    """
+    Result of mtmlPlacementSolve. `assignments` lists (request index, bin key) per placed
+    instance, bin key being (node, GPU UUID); `unplaced` lists the request index of every
+    instance that did not fit; `mpcConfigurations` maps the key of each bin holding MPC
+    instances to the configuration id to apply (see pymtml_mpc); `fragmentation` is the
+    share of the used bins' capacity left unused, from 0 to 1; `exact` tells whether the
+    placement is proven optimal.
+    """
+
+    def __init__(self, assignments, unplaced, states, affinity, exact):
+        self.assignments = assignments
+        self.unplaced = unplaced
+        used = [s for s in states if s.placed]
+        self.binsUsed = len(used)
+        self.affinity = affinity
+        self.fragmentation = (
+            sum(1.0 - s.used() for s in used) / len(used) if used else 0.0
+        )
+        self.mpcConfigurations = {
+            s.bin.key: s.configuration(s.placed)
+            for s in used
+            if s.kind == MTML_PLACEMENT_MPC
+        }
+        self.exact = exact
+
+    @property
+    def complete(self):
+        return not self.unplaced
+
+    def __repr__(self):
+        return (
+            "MtmlPlacement(placed=%d, unplaced=%d, binsUsed=%d, fragmentation=%.2f, exact=%s)"
+            % (
+                len(self.assignments),
+                len(self.unplaced),
+                self.binsUsed,
+                self.fragmentation,
+                self.exact,
+            )
+        )
+
+
+def _instances(requests, bins):
+    # largest first: the framebuffer or memory a type takes on the first bin offering it
+    def size(request):
+        for bin in bins:
+            if request.kind == MTML_PLACEMENT_VGPU and request.type in bin.vgpuTypes:
+                return bin.vgpuTypes[request.type][1]
+            if request.kind == MTML_PLACEMENT_MPC and request.type in bin.mpcProfiles:
+                return bin.mpcProfiles[request.type][1]
+        return 0
+
+    sizes = [size(r) for r in requests]
+    return sorted(
+        ((i, r) for i, r in enumerate(requests) for _ in range(r.count)),
+        key=lambda item: (-sizes[item[0]], item[0]),
+    )
+
+
+def _heuristic(instances, states):
+    assignments, unplaced, affinity = [], [], 0
+    for i, request in instances:
+        nodes = _groupNodes(states, request)
+        best = None
+        for state in states:
+            if not state.fits(request.kind, request.type):
+                continue
+            state.push(request.kind, request.type, None)
+            tightness = state.used()
+            state.pop(request.kind, request.type, None)
+            score = _affinity(states, state, request)
+            key = (
+                not nodes or state.bin.node in nodes,
+                bool(state.placed),
+                score,
+                tightness,
+            )
+            if best is None or key > best[0]:
+                best = (key, state, score)
+        if best is None:
+            unplaced.append(i)
+            continue
+        _, state, score = best
+        state.push(request.kind, request.type, request.group)
+        assignments.append((i, state.bin.key))
+        affinity += score
+    return assignments, unplaced, affinity
+
+
+def _exact(instances, states, incumbent):
+    """
+    Branch-and-bound over bin choices, minimizing (unplaced, bins used, -affinity,
+    fragmentation) and starting from the heuristic's placement `incumbent`.
+    """
+    best = {"cost": incumbent[0], "solution": incumbent[1]}
+    trail = []
+    visited, unplacedCount, affinity = [0], [0], [0]
+
+    def cost():
+        used = [s for s in states if s.placed]
+        fragmentation = sum(1.0 - s.used() for s in used)
+        return (unplacedCount[0], len(used), -affinity[0], round(fragmentation, 9))
+
+    def search(k, floor):
+        visited[0] += 1
+        if visited[0] > _EXACT_NODE_LIMIT:
+            return False
+        opened = sum(1 for s in states if s.placed)
+        if (unplacedCount[0], opened) > best["cost"][:2]:
+            return True
+        if k == len(instances):
+            c = cost()
+            if c < best["cost"]:
+                best["cost"], best["solution"] = c, list(trail)
+            return True
+        i, request = instances[k]
+        if k and instances[k - 1][0] != i:
+            floor = 0
+        # copies of one request are interchangeable: place them in bin order, unplaced last
+        tried = set()
+        for position in range(floor, len(states)):
+            state = states[position]
+            if not state.fits(request.kind, request.type):
+                continue
+            if not state.placed:
+                signature = state.bin.signature()
+                if signature in tried:
+                    continue  # an identical empty GPU was already tried
+                tried.add(signature)
+            score = _affinity(states, state, request)
+            state.push(request.kind, request.type, request.group)
+            trail.append((i, state.bin.key))
+            affinity[0] += score
+            finished = search(k + 1, position)
+            affinity[0] -= score
+            trail.pop()
+            state.pop(request.kind, request.type, request.group)
+            if not finished:
+                return False
+        # leaving this instance unplaced is always an option
+        unplacedCount[0] += 1
+        trail.append((i, None))
+        finished = search(k + 1, len(states))
+        trail.pop()
+        unplacedCount[0] -= 1
+        return finished
+
+    proven = search(0, 0)
+    return best["solution"], proven
+
+
+def mtmlPlacementSolve(requests, bins=None, mode="auto"):
+    """
+    Places `requests` (MtmlPlacementRequest list) on `bins` (MtmlPlacementBin list, this
+    node's GPUs by default). `mode` is "heuristic", "exact" (branch-and-bound, for small
+    cases) or "auto" (exact up to MTML_PLACEMENT_EXACT_LIMIT instances). Returns an
+    MtmlPlacement.
+    """
+    if mode not in ("auto", "heuristic", "exact"):
+        raise ValueError("mode must be 'auto', 'heuristic' or 'exact'")
+    if bins is None:
+        bins = mtmlPlacementBins()
+    bins = list(bins)
+    instances = _instances(requests, bins)
+    states = [_BinState(b) for b in bins]
+    assignments, unplaced, affinity = _heuristic(instances, states)
+    exact = False
+    if mode == "exact" or (
+        mode == "auto" and len(instances) <= MTML_PLACEMENT_EXACT_LIMIT
+    ):
+        used = [s for s in states if s.placed]
+        incumbent = (
+            (
+                len(unplaced),
+                len(used),
+                -affinity,
+                round(sum(1.0 - s.used() for s in used), 9),
+            ),
+            assignments + [(i, None) for i in unplaced],
+        )
+        solution, exact = _exact(instances, [_BinState(b) for b in bins], incumbent)
+        # replay the winner to rebuild bin states and affinity
+        states = [_BinState(b) for b in bins]
+        byKey = {s.bin.key: s for s in states}
+        requestOf = dict(instances)
+        assignments, unplaced, affinity = [], [], 0
+        for i, key in solution:
+            if key is None:
+                unplaced.append(i)
+                continue
+            request, state = requestOf[i], byKey[key]
+            affinity += _affinity(states, state, request)
+            state.push(request.kind, request.type, request.group)
+            assignments.append((i, key))
+    assignments.sort()
+    unplaced.sort()
+    return MtmlPlacement(assignments, unplaced, states, affinity, exact)
@@ -0,0 +1,226 @@
+##
+# Tiered rollups for pymtml sampler output
+#
+# MtmlRollup keeps min/max/sum/last/count per device and metric in fixed-size bucket rings, one
+# ring per tier (1 s, 1 min and 1 h by default). Raw polls only touch the finest tier; when one
+# of its buckets closes, the bucket is merged into the tier above, so each poll costs the same
+# however many tiers there are and a day of dashboards reads a few thousand buckets at most.
+##
+import array
+import threading
+
+from pymtml import MTML_SNAPSHOT_METRICS, MTML_SUCCESS
+
+# (bucket seconds, buckets kept): 1 s for 1 hour, 1 min for 1 day, 1 h for 30 days
+MTML_ROLLUP_DEFAULT_TIERS = ((1, 3600), (60, 1440), (3600, 720))
+
+_NS = 1000000000
+
+
+class MtmlRollupTier(object):
+    """
+    One resolution: a ring of `retention` buckets of `resolution` seconds. Bucket statistics
+    are stored per metric in flat arrays indexed by ring position * deviceCount + device.
+    """
+
+    def __init__(self, resolution, retention, metrics, deviceCount):
+        self.resolution = resolution
+        self.retention = retention
+        self.metrics = metrics
+        self.deviceCount = deviceCount
+        self._width = int(round(resolution * _NS))
+        size = retention * deviceCount
+        # bucket number held by each ring slot
+        self._bucket = array.array("q", [-1] * retention)
+        self._count = {m: array.array("I", bytes(4 * size)) for m in metrics}
+        self._min = {m: array.array("d", bytes(8 * size)) for m in metrics}
+        self._max = {m: array.array("d", bytes(8 * size)) for m in metrics}
+        self._sum = {m: array.array("d", bytes(8 * size)) for m in metrics}
+        self._last = {m: array.array("d", bytes(8 * size)) for m in metrics}
+        self.current = -1  # newest bucket number, -1 before the first sample
+
+    def _open(self, bucket):
+        """
+        Makes `bucket` current and clears its ring slot. The slot may hold the bucket being
+        closed, so that bucket has to be merged upward first (MtmlRollup._advance).
+        """
+        self.current = bucket
+        pos = bucket % self.retention
+        self._bucket[pos] = bucket
+        base = pos * self.deviceCount
+        for m in self.metrics:
+            count = self._count[m]
+            for i in range(base, base + self.deviceCount):
+                count[i] = 0
+
+    def add(self, timestamp, metric, device, value):
+        """Adds one raw sample (timestamp in ns) to the bucket covering it."""
+        i = (timestamp // self._width) % self.retention * self.deviceCount + device
+        count = self._count[metric]
+        if count[i]:
+            if value < self._min[metric][i]:
+                self._min[metric][i] = value
+            if value > self._max[metric][i]:
+                self._max[metric][i] = value
+            self._sum[metric][i] += value
+        else:
+            self._min[metric][i] = self._max[metric][i] = self._sum[metric][i] = value
+        self._last[metric][i] = value
+        count[i] += 1
+
+    def merge(self, source, bucket):
+        """
+        Folds bucket number `bucket` of the finer tier `source` into this tier, whose current
+        bucket must be the one covering it.
+        """
+        own = bucket * source._width // self._width
+        src = bucket % source.retention * source.deviceCount
+        dst = own % self.retention * self.deviceCount
+        for m in self.metrics:
+            count, srcCount = self._count[m], source._count[m]
+            for d in range(self.deviceCount):
+                n = srcCount[src + d]
+                if not n:
+                    continue
+                i = dst + d
+                j = src + d
+                if count[i]:
+                    self._min[m][i] = min(self._min[m][i], source._min[m][j])
+                    self._max[m][i] = max(self._max[m][i], source._max[m][j])
+                    self._sum[m][i] += source._sum[m][j]
+                else:
+                    self._min[m][i] = source._min[m][j]
+                    self._max[m][i] = source._max[m][j]
+                    self._sum[m][i] = source._sum[m][j]
+                self._last[m][i] = source._last[m][j]
+                count[i] += n
+
+    def series(self, metric, device, start=None, end=None):
+        """
+        Buckets of `device` holding samples of `metric`, oldest first, as a dict of arrays:
+        timestamp (bucket start, ns), min, max, mean, last and count.
+        """
+        result = {
+            "timestamp": array.array("q"),
+            "min": array.array("d"),
+            "max": array.array("d"),
+            "mean": array.array("d"),
+            "last": array.array("d"),
+            "count": array.array("I"),
+        }
+        if self.current < 0:
+            return result
+        count = self._count[metric]
+        for bucket in range(self.current - self.retention + 1, self.current + 1):
+            pos = bucket % self.retention
+            i = pos * self.deviceCount + device
+            if bucket < 0 or self._bucket[pos] != bucket or not count[i]:
+                continue
+            timestamp = bucket * self._width
+            if (start is not None and timestamp + self._width <= start) or (
+                end is not None and timestamp > end
+            ):
+                continue
+            result["timestamp"].append(timestamp)
+            result["min"].append(self._min[metric][i])
+            result["max"].append(self._max[metric][i])
+            result["mean"].append(self._sum[metric][i] / count[i])
+            result["last"].append(self._last[metric][i])
+            result["count"].append(count[i])
+        return result
+
+
+class MtmlRollup(object):
+    """
+    Maintains rollup tiers for every poll of `sampler` (or, without a sampler, for the polls
+    passed to record() for the device UUIDs in `devices`). `tiers` is a sequence of
+    (bucket seconds, buckets kept) from finest to coarsest; each resolution must be a multiple
+    of the one before. Coarser tiers are fed with closed buckets of the tier below, so their
+    newest bucket lags the raw data by at most one bucket of the finer tier. Failed reads
+    (non-success status in the snapshot) are not counted.
+    """
+
+    def __init__(
+        self, sampler=None, tiers=MTML_ROLLUP_DEFAULT_TIERS, metrics=None, devices=None
+    ):
+        self.sampler = sampler
+        self.devices = list(
+            sampler.deviceDictionary if sampler is not None else devices
+        )
+        self.metrics = tuple(metrics or MTML_SNAPSHOT_METRICS)
+        self.tiers = []
+        for resolution, retention in tiers:
+            tier = MtmlRollupTier(
+                resolution, retention, self.metrics, len(self.devices)
+            )
+            if self.tiers:
+                finer = self.tiers[-1]
+                if tier._width <= finer._width or tier._width % finer._width:
+                    raise ValueError(
+                        "tier resolution %s is not a multiple of %s"
+                        % (resolution, finer.resolution)
+                    )
+            self.tiers.append(tier)
+        self._lock = threading.Lock()
+        if sampler is not None:
+            sampler.addListener(self._onSample)
+
+    def tier(self, resolution):
+        for tier in self.tiers:
+            if tier.resolution == resolution:
+                return tier
+        raise KeyError(resolution)
+
+    def _onSample(self, sampler, snapshot):
+        ts = snapshot.buffer.timestamp
+        values = {}
+        for metric in self.metrics:
+            column = snapshot.column(metric)
+            values[metric] = [
+                column[d] if device.status(metric) == MTML_SUCCESS else None
+                for d, device in enumerate(snapshot.devices)
+            ]
+        self.record(ts.tv_sec * _NS + ts.tv_nsec, values)
+
+    def _advance(self, level, bucket):
+        """Moves tier `level` to `bucket`, folding its closed bucket into the tier above first."""
+        tier = self.tiers[level]
+        closed = tier.current
+        if closed >= 0 and level + 1 < len(self.tiers):
+            coarser = self.tiers[level + 1]
+            own = closed * tier._width // coarser._width
+            if own > coarser.current:
+                self._advance(level + 1, own)
+            coarser.merge(tier, closed)
+        tier._open(bucket)
+
+    def record(self, timestamp, values):
+        """
+        Adds one poll taken at `timestamp` (ns since the epoch). `values` maps a metric to one
+        value per device; None marks a failed read.
+        """
+        finest = self.tiers[0]
+        with self._lock:
+            bucket = timestamp // finest._width
+            if bucket > finest.current:
+                self._advance(0, bucket)
+            elif bucket < finest.current:
+                return  # clock stepped back: drop rather than corrupt a reused slot
+            for metric, column in values.items():
+                for d, value in enumerate(column):
+                    if value is not None:
+                        finest.add(timestamp, metric, d, value)
+
+    def series(self, resolution, metric, device, start=None, end=None):
+        """See MtmlRollupTier.series; `device` is a sampler slot or UUID."""
+        if isinstance(device, str):
+            device = self.devices.index(device)
+        with self._lock:
+            return self.tier(resolution).series(metric, device, start, end)
+
+    def close(self):
+        if self.sampler is not None:
+            try:
+                self.sampler.removeListener(self._onSample)
+            except ValueError:
+                pass
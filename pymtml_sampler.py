@@ -0,0 +1,263 @@
+##
+# Background telemetry sampler for pymtml
+#
+# MtmlSampler polls an MtmlSnapshot at a fixed cadence and appends every poll to columnar ring
+# buffers. Windows of the ring are exported without copying, through the buffer protocol (for
+# NumPy) and the Arrow C Data Interface (for pyarrow, polars, ...).
+##
+import threading
+import time
+from ctypes import *
+
+import pymtml_arrow
+from pymtml import *
+
+# ring column name -> (ctypes type, Arrow format); one row per device per poll
+MTML_SAMPLER_COLUMNS = (
+    ("timestamp", c_int64, pymtml_arrow.ARROW_TIMESTAMP_NS_UTC),
+    ("device", c_int32, b"i"),
+    ("gpuUtil", c_uint32, b"I"),
+    ("gpuClock", c_uint32, b"I"),
+    ("temperature", c_int32, b"i"),
+    ("memoryUtil", c_uint32, b"I"),
+    ("memoryTotal", c_uint64, b"L"),
+    ("memoryUsed", c_uint64, b"L"),
+    ("memoryClock", c_uint32, b"I"),
+    ("powerUsage", c_uint32, b"I"),
+    ("vpuClock", c_uint32, b"I"),
+    ("encodeUtil", c_uint32, b"I"),
+    ("decodeUtil", c_uint32, b"I"),
+)
+
+
+class MtmlSampleChunk(object):
+    """
+    A contiguous run of ring rows. column(name) is a ctypes array laid over the ring memory,
+    so numpy.asarray(chunk.column("gpuUtil")) is a zero-copy view; the chunk itself is an
+    Arrow record batch via __arrow_c_array__. The "device" column holds slots into
+    MtmlSampler.deviceDictionary. valid(name) flags the rows whose read succeeded (see
+    mtmlSnapshotValid); in the Arrow export the others are null.
+    """
+
+    __slots__ = ("_sampler", "start", "length")
+
+    def __init__(self, sampler, start, length):
+        self._sampler = sampler
+        self.start = start
+        self.length = length
+
+    def __len__(self):
+        return self.length
+
+    def column(self, name):
+        ring = self._sampler._ring[name]
+        return (ring._type_ * self.length).from_buffer(
+            ring, self.start * sizeof(ring._type_)
+        )
+
+    def valid(self, name):
+        if name not in MTML_SNAPSHOT_METRICS:
+            return b"\x01" * self.length
+        return mtmlSnapshotValid(
+            self._sampler._statusRing, name, self.length, start=self.start
+        )
+
+    def _arrowColumns(self):
+        sampler = self._sampler
+        return [
+            pymtml_arrow.ArrowColumn(
+                name,
+                ctype,
+                sampler._ring[name],
+                offset=self.start,
+                format=format,
+                dictionary=sampler.deviceDictionary if name == "device" else None,
+                validity=(
+                    pymtml_arrow.validityBitmap(self.valid(name))
+                    if name in MTML_SNAPSHOT_METRICS
+                    else (None, 0)
+                ),
+            )
+            for name, ctype, format in MTML_SAMPLER_COLUMNS
+        ]
+
+    def __arrow_c_schema__(self):
+        return pymtml_arrow.toCapsule(
+            pymtml_arrow.recordBatchSchema(self._arrowColumns())
+        )
+
+    def __arrow_c_array__(self, requested_schema=None):
+        return pymtml_arrow.exportRecordBatch(self._arrowColumns(), self.length)
+
+
+class MtmlSampleWindow(object):
+    """
+    The newest polls of a sampler, in time order, as one or two chunks (two when the window
+    wraps around the end of the ring). The views share memory with the ring, so they stay
+    valid until the sampler has written `capacity` more polls; copy them to keep data longer.
+    """
+
+    def __init__(self, sampler, chunks):
+        self._sampler = sampler
+        self.chunks = chunks
+
+    def __len__(self):
+        return sum(c.length for c in self.chunks)
+
+    def column(self, name):
+        """List of per-chunk views of `name` (see MtmlSampleChunk.column)."""
+        return [c.column(name) for c in self.chunks]
+
+    def __arrow_c_schema__(self):
+        return self._sampler.chunk(0, 0).__arrow_c_schema__()
+
+    def __arrow_c_stream__(self, requested_schema=None):
+        """Arrow PyCapsule export: one record batch per chunk."""
+        return pymtml_arrow.exportStream(
+            self._sampler.chunk(0, 0)._arrowColumns,
+            [(c._arrowColumns(), c.length) for c in self.chunks],
+        )
+
+
+class MtmlSampler(object):
+    """
+    Polls `devices` (all registered devices by default) every `interval` seconds on a
+    background thread and keeps the last `capacity` polls in typed ring columns.
+
+    Deadlines are computed from the start time rather than the previous wakeup, so the
+    cadence does not drift; when a poll overruns, the missed deadlines are skipped. Listeners
+    added with addListener(fn) run on the sampler thread as fn(sampler, snapshot) after each
+    poll has been appended. A listener that raises does not stop the sampler or the other
+    listeners; listenerErrors counts such failures and lastListenerError keeps the newest.
+    """
+
+    def __init__(self, interval=0.1, devices=None, capacity=3600):
+        self.interval = interval
+        self.capacity = capacity
+        self.snapshot = MtmlSnapshot(devices)
+        self.deviceCount = len(self.snapshot)
+        self.deviceDictionary = [mtmlDeviceGetUUID(h) for h in self.snapshot.handles]
+
+        rows = capacity * self.deviceCount
+        self._ring = {name: (ctype * rows)() for name, ctype, _ in MTML_SAMPLER_COLUMNS}
+        device = self._ring["device"]
+        for row in range(rows):
+            device[row] = row % self.deviceCount
+        # the status codes of every poll, laid out like MtmlSnapshot.buffer.status
+        status = self.snapshot.buffer.status
+        self._statusRing = (status._type_ * (capacity * len(status)))()
+        # (ring column address, snapshot column address, bytes per poll)
+        self._copies = [
+            (addressof(self._statusRing), addressof(status), sizeof(status))
+        ]
+        for name, ctype, _ in MTML_SAMPLER_COLUMNS:
+            if name in MTML_SNAPSHOT_METRICS:
+                self._copies.append(
+                    (
+                        addressof(self._ring[name]),
+                        addressof(self.snapshot.column(name)),
+                        sizeof(ctype) * self.deviceCount,
+                    )
+                )
+
+        self.polls = 0  # total polls appended; the newest is at (polls - 1) % capacity
+        self._listeners = []
+        # a raising listener is skipped for that poll, not allowed to stop the sampler
+        self.listenerErrors = 0
+        self.lastListenerError = None  # (listener, exception)
+        self._lock = threading.Lock()
+        self._stop = threading.Event()
+        self._thread = None
+
+    def addListener(self, fn):
+        self._listeners.append(fn)
+
+    def removeListener(self, fn):
+        self._listeners.remove(fn)
+
+    def sample(self):
+        """Polls once on the calling thread and appends the result to the ring."""
+        mtmlPollInto(self.snapshot)
+        position = self.polls % self.capacity
+        row = position * self.deviceCount
+        ts = self.snapshot.buffer.timestamp
+        stamp = ts.tv_sec * 1000000000 + ts.tv_nsec
+        timestamps = self._ring["timestamp"]
+        with self._lock:
+            for dst, src, size in self._copies:
+                memmove(dst + position * size, src, size)
+            for i in range(row, row + self.deviceCount):
+                timestamps[i] = stamp
+            self.polls += 1
+        for fn in list(self._listeners):
+            try:
+                fn(self, self.snapshot)
+            except Exception as e:
+                self.listenerErrors += 1
+                self.lastListenerError = (fn, e)
+
+    def chunk(self, start, length):
+        return MtmlSampleChunk(self, start, length)
+
+    def window(self, polls=None):
+        """The newest `polls` polls (everything retained by default) as an MtmlSampleWindow."""
+        with self._lock:
+            available = min(self.polls, self.capacity)
+            head = self.polls % self.capacity
+        if polls is None or polls > available:
+            polls = available
+        n = self.deviceCount
+        first = (head - polls) % self.capacity if polls else head
+        if first + polls <= self.capacity:
+            chunks = [self.chunk(first * n, polls * n)]
+        else:
+            tail = self.capacity - first
+            chunks = [
+                self.chunk(first * n, tail * n),
+                self.chunk(0, (polls - tail) * n),
+            ]
+        return MtmlSampleWindow(self, [c for c in chunks if c.length])
+
+    def _run(self):
+        deadline = time.monotonic()
+        while not self._stop.is_set():
+            self.sample()
+            deadline += self.interval
+            now = time.monotonic()
+            if now > deadline:
+                # overran: skip the missed ticks and stay on the original grid
+                deadline += (now - deadline) // self.interval * self.interval
+                deadline += self.interval
+            self._stop.wait(deadline - now)
+
+    def start(self):
+        if self._thread is None:
+            self._stop.clear()
+            self._thread = threading.Thread(
+                target=self._run, name="mtml-sampler", daemon=True
+            )
+            self._thread.start()
+        return self
+
+    @property
+    def running(self):
+        """Whether the sampling thread is alive; False after stop() or if it died."""
+        thread = self._thread
+        return thread is not None and thread.is_alive()
+
+    def stop(self):
+        thread, self._thread = self._thread, None
+        if thread is not None:
+            self._stop.set()
+            thread.join()
+
+    def close(self):
+        """Stops sampling and frees the snapshot's sub-handles."""
+        self.stop()
+        self.snapshot.close()
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *exc):
+        self.close()
@@ -0,0 +1,270 @@
+##
+# Mergeable quantile sketches for pymtml sampler output
+#
+# MtmlDDSketch is a DDSketch (Masson, Rim, Lee; VLDB 2019): values are counted in logarithmic
+# buckets, so any quantile is answered within a fixed relative error, sketches with the same
+# accuracy merge by adding bucket counts, and memory is bounded by collapsing the lowest
+# buckets once `maxBuckets` is reached (keeping the high quantiles SLOs care about exact).
+#
+# MtmlSketchSet maintains one sketch per device, metric and time window for a sampler and
+# answers quantiles over any span of windows and any set of devices by merging.
+##
+import array
+import math
+import threading
+
+from pymtml import MTML_SUCCESS
+
+MTML_SKETCH_DEFAULT_METRICS = ("gpuUtil", "temperature", "powerUsage")
+
+
+class _MtmlDenseStore(object):
+    """Bucket counts for keys [offset, offset + len(counts)), at most maxBuckets of them."""
+
+    __slots__ = ("counts", "offset", "maxBuckets")
+
+    def __init__(self, maxBuckets):
+        self.counts = array.array("Q")
+        self.offset = 0
+        self.maxBuckets = maxBuckets
+
+    def add(self, key, count):
+        counts = self.counts
+        if not counts:
+            self.offset = key
+            counts.append(0)
+        elif key < self.offset:
+            if self.offset + len(counts) - key > self.maxBuckets:
+                # collapse: everything below the lowest representable key lands there
+                key = max(key, self.offset + len(counts) - self.maxBuckets)
+            if key < self.offset:
+                counts[0:0] = array.array("Q", bytes(8 * (self.offset - key)))
+                self.offset = key
+        elif key >= self.offset + len(counts):
+            counts.extend(
+                array.array("Q", bytes(8 * (key - self.offset - len(counts) + 1)))
+            )
+            excess = len(counts) - self.maxBuckets
+            if excess > 0:
+                counts[excess] += sum(counts[:excess])
+                del counts[:excess]
+                self.offset += excess
+        counts[max(key, self.offset) - self.offset] += count
+
+    def merge(self, other):
+        for i, count in enumerate(other.counts):
+            if count:
+                self.add(other.offset + i, count)
+
+    def keyAtRank(self, rank):
+        """Smallest key whose cumulative count exceeds `rank`."""
+        total = 0
+        for i, count in enumerate(self.counts):
+            total += count
+            if total > rank:
+                return self.offset + i
+        return self.offset + len(self.counts) - 1
+
+
+class MtmlDDSketch(object):
+    """
+    Quantile sketch with relative error `relativeAccuracy` and at most `maxBuckets` buckets
+    per sign (about 8 bytes each). Zero is tracked exactly; negative values use a mirrored
+    store.
+    """
+
+    def __init__(self, relativeAccuracy=0.01, maxBuckets=2048):
+        if not 0 < relativeAccuracy < 1:
+            raise ValueError("relativeAccuracy must be in (0, 1)")
+        self.relativeAccuracy = relativeAccuracy
+        self.maxBuckets = maxBuckets
+        self._gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy)
+        self._logGamma = math.log(self._gamma)
+        self._positive = _MtmlDenseStore(maxBuckets)
+        self._negative = _MtmlDenseStore(maxBuckets)
+        self.zeroCount = 0
+        self.count = 0
+        self.sum = 0.0
+        self.min = math.inf
+        self.max = -math.inf
+
+    def _key(self, value):
+        return math.ceil(math.log(value) / self._logGamma)
+
+    def _value(self, key):
+        # midpoint of the bucket (gamma^(key-1), gamma^key] with relative error <= accuracy
+        return 2 * self._gamma**key / (1 + self._gamma)
+
+    def add(self, value, count=1):
+        if value > 0:
+            self._positive.add(self._key(value), count)
+        elif value < 0:
+            self._negative.add(self._key(-value), count)
+        else:
+            self.zeroCount += count
+        self.count += count
+        self.sum += value * count
+        if value < self.min:
+            self.min = value
+        if value > self.max:
+            self.max = value
+
+    def merge(self, other):
+        """Adds the samples of `other`, which must have the same relativeAccuracy."""
+        if other._gamma != self._gamma:
+            raise ValueError("cannot merge sketches with different accuracies")
+        if not other.count:
+            return self
+        self._positive.merge(other._positive)
+        self._negative.merge(other._negative)
+        self.zeroCount += other.zeroCount
+        self.count += other.count
+        self.sum += other.sum
+        self.min = min(self.min, other.min)
+        self.max = max(self.max, other.max)
+        return self
+
+    def quantile(self, q):
+        """Value at quantile q (0 <= q <= 1), or None for an empty sketch."""
+        if not self.count:
+            return None
+        if q <= 0:
+            return self.min
+        if q >= 1:
+            return self.max
+        rank = int(q * (self.count - 1))
+        negatives = sum(self._negative.counts)
+        if rank < negatives:
+            # negative keys are stored mirrored, so count from the most negative bucket
+            key = self._negative.keyAtRank(negatives - 1 - rank)
+            value = -self._value(key)
+        elif rank < negatives + self.zeroCount:
+            value = 0.0
+        else:
+            key = self._positive.keyAtRank(rank - negatives - self.zeroCount)
+            value = self._value(key)
+        return min(max(value, self.min), self.max)
+
+    @property
+    def mean(self):
+        return self.sum / self.count if self.count else None
+
+    def copy(self):
+        return MtmlDDSketch(self.relativeAccuracy, self.maxBuckets).merge(self)
+
+    def __len__(self):
+        return self.count
+
+
+class MtmlSketchSet(object):
+    """
+    One MtmlDDSketch per device, metric and `window`-second interval, for the last `windows`
+    intervals of `sampler` (or of polls passed to record() for the UUIDs in `devices`).
+    quantile() merges the sketches of the requested devices and windows, so p50/p99 over any
+    window-aligned span and any device group cost one merge per sketch touched.
+    """
+
+    def __init__(
+        self,
+        sampler=None,
+        metrics=MTML_SKETCH_DEFAULT_METRICS,
+        window=60,
+        windows=60,
+        relativeAccuracy=0.01,
+        maxBuckets=2048,
+        devices=None,
+    ):
+        self.sampler = sampler
+        self.devices = list(
+            sampler.deviceDictionary if sampler is not None else devices
+        )
+        self.metrics = tuple(metrics)
+        self.window = window
+        self.windows = windows
+        self.relativeAccuracy = relativeAccuracy
+        self.maxBuckets = maxBuckets
+        self._width = int(round(window * 1000000000))
+        # ring slot -> (window number, {metric: [sketch per device]})
+        self._ring = [None] * windows
+        self._lock = threading.Lock()
+        if sampler is not None:
+            sampler.addListener(self._onSample)
+
+    def _onSample(self, sampler, snapshot):
+        ts = snapshot.buffer.timestamp
+        values = {}
+        for metric in self.metrics:
+            column = snapshot.column(metric)
+            values[metric] = [
+                column[d] if device.status(metric) == MTML_SUCCESS else None
+                for d, device in enumerate(snapshot.devices)
+            ]
+        self.record(ts.tv_sec * 1000000000 + ts.tv_nsec, values)
+
+    def _sketches(self, number):
+        slot = number % self.windows
+        entry = self._ring[slot]
+        if entry is None or entry[0] != number:
+            if entry is not None and entry[0] > number:
+                return None  # older than the retained windows
+            entry = (
+                number,
+                {
+                    m: [
+                        MtmlDDSketch(self.relativeAccuracy, self.maxBuckets)
+                        for _ in self.devices
+                    ]
+                    for m in self.metrics
+                },
+            )
+            self._ring[slot] = entry
+        return entry[1]
+
+    def record(self, timestamp, values):
+        """
+        Adds one poll taken at `timestamp` (ns since the epoch). `values` maps a metric to one
+        value per device; None marks a failed read.
+        """
+        with self._lock:
+            sketches = self._sketches(timestamp // self._width)
+            if sketches is None:
+                return
+            for metric, column in values.items():
+                for sketch, value in zip(sketches[metric], column):
+                    if value is not None:
+                        sketch.add(value)
+
+    def merged(self, metric, devices=None, start=None, end=None):
+        """
+        One sketch holding `metric` for `devices` (slots or UUIDs, all by default) over the
+        retained windows overlapping [start, end] (ns since the epoch).
+        """
+        if devices is None:
+            slots = range(len(self.devices))
+        else:
+            slots = [
+                self.devices.index(d) if isinstance(d, str) else d for d in devices
+            ]
+        result = MtmlDDSketch(self.relativeAccuracy, self.maxBuckets)
+        with self._lock:
+            for entry in self._ring:
+                if entry is None:
+                    continue
+                first = entry[0] * self._width
+                if (start is not None and first + self._width <= start) or (
+                    end is not None and first > end
+                ):
+                    continue
+                for slot in slots:
+                    result.merge(entry[1][metric][slot])
+        return result
+
+    def quantile(self, metric, q, devices=None, start=None, end=None):
+        return self.merged(metric, devices, start, end).quantile(q)
+
+    def close(self):
+        if self.sampler is not None:
+            try:
+                self.sampler.removeListener(self._onSample)
+            except ValueError:
+                pass
@@ -0,0 +1,684 @@
+#!/usr/bin/env python3
+##
+# mtml-smi: nvidia-smi style command line tool on top of pymtml
+#
+#   mtml-smi -L
+#   mtml-smi --query-gpu=index,name,utilization.gpu,memory.used --format=csv -lms 100
+#   mtml-smi dmon -s puce -d 0.1
+#   mtml-smi topo -m
+#
+# The requested fields are compiled once into an MtmlQueryPlan: identity fields are read once,
+# telemetry fields become columns of one MtmlSnapshot refreshed by a single mtmlPollInto per
+# iteration, and the library stays initialized across loop iterations. dmon is driven by an
+# MtmlSampler, so its lines follow the sampler's fixed grid.
+##
+import argparse
+import sys
+import threading
+import time
+
+from pymtml import *
+
+_MIB = 1024 * 1024
+
+# Subcommand name -> (argument parser factory, entry point taking the parsed arguments)
+_SUBCOMMANDS = {}
+
+
+class _Field(object):
+    """
+    One --query-gpu field. `kind` is "static" (read once per device when the plan is
+    compiled), "snapshot" (a column of the plan's MtmlSnapshot) or "dynamic" (read per
+    iteration). `read` takes an _MtmlPlanDevice; `convert` maps raw snapshot values.
+    """
+
+    __slots__ = ("name", "unit", "kind", "read", "metric", "convert")
+
+    def __init__(self, name, unit, kind, read=None, metric=None, convert=None):
+        self.name = name
+        self.unit = unit
+        self.kind = kind
+        self.read = read
+        self.metric = metric
+        self.convert = convert
+
+
+def _static(name, read, unit=""):
+    return _Field(name, unit, "static", read=read)
+
+
+def _snapshot(name, metric, unit="", convert=None):
+    return _Field(name, unit, "snapshot", metric=metric, convert=convert)
+
+
+def _dynamic(name, read, unit=""):
+    return _Field(name, unit, "dynamic", read=read)
+
+
+def _eccCounter(errorType, counterType):
+    return lambda d: mtmlMemoryGetEccErrorCounter(
+        d.memory, errorType, counterType, MTML_MEMORY_LOCATION_DRAM
+    )
+
+
+def _memoryFree(d):
+    total, used = d.snapshot.memoryTotal, d.snapshot.memoryUsed
+    if MTML_SUCCESS != d.snapshot.status("memoryTotal"):
+        raise MTMLError(d.snapshot.status("memoryTotal"))
+    if MTML_SUCCESS != d.snapshot.status("memoryUsed"):
+        raise MTMLError(d.snapshot.status("memoryUsed"))
+    return (total - used) // _MIB
+
+
+def _mib(value):
+    return value // _MIB
+
+
+def _watts(value):
+    return "%.2f" % (value / 1000.0)
+
+
+# nvidia-smi compatible names first, aliases after
+MTML_SMI_FIELDS = {
+    f.name: f
+    for f in (
+        _Field("timestamp", "", "time"),
+        _static("index", lambda d: d.device.index),
+        _static("uuid", lambda d: d.device.uuid),
+        _static("name", lambda d: mtmlDeviceGetName(d.handle)),
+        _static("serial", lambda d: mtmlDeviceGetSerialNumber(d.handle)),
+        _static("pci.bus_id", lambda d: d.device.sbdf),
+        _static("driver_version", lambda d: d.plan.driverVersion()),
+        _static("vbios_version", lambda d: mtmlDeviceGetVbiosVersion(d.handle)),
+        _static("clocks.max.graphics", lambda d: mtmlGpuGetMaxClock(d.gpu), "MHz"),
+        _static("clocks.max.memory", lambda d: mtmlMemoryGetMaxClock(d.memory), "MHz"),
+        _static("clocks.max.video", lambda d: mtmlVpuGetMaxClock(d.vpu), "MHz"),
+        _snapshot("memory.total", "memoryTotal", "MiB", _mib),
+        _snapshot("memory.used", "memoryUsed", "MiB", _mib),
+        _Field("memory.free", "MiB", "snapshot", read=_memoryFree),
+        _snapshot("utilization.gpu", "gpuUtil", "%"),
+        _snapshot("utilization.memory", "memoryUtil", "%"),
+        _snapshot("utilization.encoder", "encodeUtil", "%"),
+        _snapshot("utilization.decoder", "decodeUtil", "%"),
+        _snapshot("temperature.gpu", "temperature"),
+        _snapshot("power.draw", "powerUsage", "W", _watts),
+        _snapshot("clocks.current.graphics", "gpuClock", "MHz"),
+        _snapshot("clocks.current.memory", "memoryClock", "MHz"),
+        _snapshot("clocks.current.video", "vpuClock", "MHz"),
+        _dynamic("fan.speed", lambda d: mtmlDeviceGetFanSpeed(d.handle, 0), "%"),
+        _dynamic("mpc.mode", lambda d: mtmlDeviceGetMpcMode(d.handle)),
+        _dynamic(
+            "ecc.errors.corrected.volatile.total",
+            _eccCounter(MTML_MEMORY_ERROR_TYPE_CORRECTED, MTML_VOLATILE_ECC),
+        ),
+        _dynamic(
+            "ecc.errors.uncorrected.volatile.total",
+            _eccCounter(MTML_MEMORY_ERROR_TYPE_UNCORRECTED, MTML_VOLATILE_ECC),
+        ),
+        _dynamic(
+            "ecc.errors.corrected.aggregate.total",
+            _eccCounter(MTML_MEMORY_ERROR_TYPE_CORRECTED, MTML_AGGREGATE_ECC),
+        ),
+        _dynamic(
+            "ecc.errors.uncorrected.aggregate.total",
+            _eccCounter(MTML_MEMORY_ERROR_TYPE_UNCORRECTED, MTML_AGGREGATE_ECC),
+        ),
+    )
+}
+for _alias, _name in (
+    ("gpu_name", "name"),
+    ("gpu_uuid", "uuid"),
+    ("gpu_serial", "serial"),
+    ("gpu_bus_id", "pci.bus_id"),
+    ("clocks.gr", "clocks.current.graphics"),
+    ("clocks.mem", "clocks.current.memory"),
+    ("clocks.video", "clocks.current.video"),
+    ("clocks.max.gr", "clocks.max.graphics"),
+    ("clocks.max.mem", "clocks.max.memory"),
+):
+    MTML_SMI_FIELDS[_alias] = MTML_SMI_FIELDS[_name]
+del _alias, _name
+
+
+def _errorText(code):
+    return "[Not Supported]" if code == MTML_ERROR_NOT_SUPPORTED else "[N/A]"
+
+
+class _MtmlPlanDevice(object):
+    """Per-device handles a plan reads from; sub-handles are initialized on first use."""
+
+    def __init__(self, plan, device, snapshotSlot):
+        self.plan = plan
+        self.device = device
+        self.handle = device.handle
+        self.snapshotSlot = snapshotSlot
+        self._subHandles = {}
+
+    @property
+    def snapshot(self):
+        return self.plan.snapshot[self.snapshotSlot]
+
+    def _sub(self, kind, init):
+        handle = self._subHandles.get(kind)
+        if handle is None:
+            handle = self._subHandles[kind] = init(self.handle)
+        return handle
+
+    @property
+    def gpu(self):
+        return self._sub("gpu", mtmlDeviceInitGpu)
+
+    @property
+    def memory(self):
+        return self._sub("memory", mtmlDeviceInitMemory)
+
+    @property
+    def vpu(self):
+        return self._sub("vpu", mtmlDeviceInitVpu)
+
+    def close(self):
+        for kind, free in (
+            ("gpu", mtmlDeviceFreeGpu),
+            ("memory", mtmlDeviceFreeMemory),
+            ("vpu", mtmlDeviceFreeVpu),
+        ):
+            handle = self._subHandles.pop(kind, None)
+            if handle is not None:
+                try:
+                    free(handle)
+                except MTMLError:
+                    pass
+
+
+class MtmlQueryPlan(object):
+    """
+    A compiled --query-gpu field list for `devices` (MtmlDevice entries). collect() returns
+    one list of formatted values per device; static values are computed here once, telemetry
+    is read with one mtmlPollInto, and only "dynamic" fields issue per-device calls.
+    """
+
+    def __init__(self, fieldNames, devices, units=True):
+        unknown = [f for f in fieldNames if f not in MTML_SMI_FIELDS]
+        if unknown:
+            raise ValueError("unknown field(s): %s" % ", ".join(unknown))
+        self.fields = [MTML_SMI_FIELDS[f] for f in fieldNames]
+        self.fieldNames = list(fieldNames)
+        self.units = units
+        self._driverVersion = None
+        self.snapshot = None
+        if any(f.kind == "snapshot" for f in self.fields):
+            self.snapshot = MtmlSnapshot([d.handle for d in devices])
+        self.devices = [_MtmlPlanDevice(self, d, i) for i, d in enumerate(devices)]
+        # per device: a fixed string for static fields, None where a value is read per row
+        self._static = [
+            [
+                self._format(f, self._read(f, d)) if f.kind == "static" else None
+                for f in self.fields
+            ]
+            for d in self.devices
+        ]
+
+    def driverVersion(self):
+        if self._driverVersion is None:
+            system = mtmlLibraryInitSystem()
+            try:
+                self._driverVersion = mtmlSystemGetDriverVersion(system)
+            finally:
+                mtmlLibraryFreeSystem(system)
+        return self._driverVersion
+
+    def header(self):
+        return [
+            "%s [%s]" % (name, f.unit) if f.unit and self.units else name
+            for name, f in zip(self.fieldNames, self.fields)
+        ]
+
+    def _read(self, field, device):
+        try:
+            if field.read is not None:
+                return field.read(device)
+            entry = device.snapshot
+            status = entry.status(field.metric)
+            if status != MTML_SUCCESS:
+                return MTMLError(status)
+            value = getattr(entry, field.metric)
+            return field.convert(value) if field.convert else value
+        except MTMLError as e:
+            return e
+
+    def _format(self, field, value):
+        if isinstance(value, MTMLError):
+            return _errorText(value.value)
+        if isinstance(value, bytes):
+            value = value.decode(errors="replace")
+        if field.unit and self.units and field.unit != "%":
+            return "%s %s" % (value, field.unit)
+        if field.unit == "%" and self.units:
+            return "%s %%" % value
+        return str(value)
+
+    def collect(self):
+        if self.snapshot is not None:
+            mtmlPollInto(self.snapshot)
+        now = None
+        rows = []
+        for device, static in zip(self.devices, self._static):
+            row = []
+            for field, fixed in zip(self.fields, static):
+                if fixed is not None:
+                    row.append(fixed)
+                elif field.kind == "time":
+                    if now is None:
+                        t = time.time()
+                        now = time.strftime("%Y/%m/%d %H:%M:%S", time.localtime(t))
+                        now += ".%03d" % (t % 1 * 1000)
+                    row.append(now)
+                else:
+                    row.append(self._format(field, self._read(field, device)))
+            rows.append(row)
+        return rows
+
+    def close(self):
+        for device in self.devices:
+            device.close()
+        if self.snapshot is not None:
+            self.snapshot.close()
+
+
+def _selectDevices(ids):
+    """Registry entries for a comma-separated list of indexes, UUIDs or PCI bus ids."""
+    registry = mtmlGetDeviceRegistry()
+    if not ids:
+        return list(registry.devices)
+    devices = []
+    for token in ids.split(","):
+        token = token.strip()
+        try:
+            if token.isdigit():
+                device = registry.byIndex(int(token))
+            else:
+                try:
+                    device = registry.byUuid(token)
+                except MTMLError:
+                    device = registry.bySbdf(token)
+        except MTMLError:
+            raise ValueError("no device matches %r" % token)
+        devices.append(device)
+    return devices
+
+
+def _loopInterval(args):
+    if args.loop_ms is not None:
+        return args.loop_ms / 1000.0
+    return args.loop
+
+
+def runLoop(interval, emit, stdout=None):
+    """
+    Calls emit() now and then every `interval` seconds on a fixed grid (if interval is set),
+    writing each returned string with a single write and flush. Stops on Ctrl-C.
+    """
+    stdout = stdout or sys.stdout
+    deadline = time.monotonic()
+    try:
+        while True:
+            stdout.write(emit())
+            stdout.flush()
+            if not interval:
+                return 0
+            deadline += interval
+            delay = deadline - time.monotonic()
+            if delay < 0:
+                deadline -= delay // interval * interval  # skip missed ticks
+                delay = deadline - time.monotonic()
+            time.sleep(max(delay, 0))
+    except KeyboardInterrupt:
+        return 0
+    except BrokenPipeError:
+        return 0
+
+
+def _csv(values):
+    return ", ".join(values) + "\n"
+
+
+def queryGpu(args):
+    formats = [f.strip() for f in args.format.split(",")]
+    if "csv" not in formats:
+        raise ValueError("only --format=csv is supported")
+    fieldNames = [f.strip() for f in args.query_gpu.split(",") if f.strip()]
+    plan = MtmlQueryPlan(
+        fieldNames, _selectDevices(args.id), units="nounits" not in formats
+    )
+    header = "" if "noheader" in formats else _csv(plan.header())
+
+    def emit():
+        return "".join(_csv(row) for row in plan.collect())
+
+    try:
+        if header:
+            sys.stdout.write(header)
+        return runLoop(_loopInterval(args), emit)
+    finally:
+        plan.close()
+
+
+def listGpus(args):
+    out = []
+    for device in _selectDevices(args.id):
+        try:
+            name = mtmlDeviceGetName(device.handle)
+        except MTMLError:
+            name = "Unknown"
+        out.append("GPU %d: %s (UUID: %s)\n" % (device.index, name, device.uuid))
+    sys.stdout.write("".join(out))
+    return 0
+
+
+## dmon
+# (group, header, unit, width, snapshot metric or None, convert)
+_DMON_COLUMNS = (
+    ("p", "pwr", "W", 5, "powerUsage", lambda v: v // 1000),
+    ("p", "gtemp", "C", 5, "temperature", None),
+    ("u", "gpu", "%", 4, "gpuUtil", None),
+    ("u", "mem", "%", 4, "memoryUtil", None),
+    ("u", "enc", "%", 4, "encodeUtil", None),
+    ("u", "dec", "%", 4, "decodeUtil", None),
+    ("c", "gclk", "MHz", 5, "gpuClock", None),
+    ("c", "mclk", "MHz", 5, "memoryClock", None),
+    ("c", "vclk", "MHz", 5, "vpuClock", None),
+    ("m", "fb", "MB", 6, "memoryUsed", _mib),
+    ("e", "sbecc", "errs", 6, None, None),
+    ("e", "dbecc", "errs", 6, None, None),
+)
+MTML_DMON_GROUPS = "pucme"
+
+
+class MtmlDeviceMonitor(object):
+    """
+    Formats one fixed-width line per device per sampler tick for the metric `groups`
+    (p power/temperature, u utilization, c clocks, m framebuffer, e ECC error deltas) and
+    writes each tick's lines to `stdout` with one write. ECC counters are not part of the
+    snapshot and are read per tick only when the e group is selected.
+    """
+
+    def __init__(
+        self, sampler, devices, groups="puc", timestamps="", count=None, stdout=None
+    ):
+        unknown = set(groups) - set(MTML_DMON_GROUPS)
+        if unknown:
+            raise ValueError("unknown dmon group(s): %s" % "".join(sorted(unknown)))
+        self.sampler = sampler
+        self.devices = devices
+        self.stdout = stdout or sys.stdout
+        self.timestamps = timestamps
+        self.columns = [c for c in _DMON_COLUMNS if c[0] in groups]
+        self.count = count
+        self.lines = 0
+        self.done = threading.Event()
+        self.error = None  # what stopped the monitor, if it failed
+        self._ecc = "e" in groups
+        self._lastEcc = [None] * len(devices)
+        self._memories = [None] * len(devices)
+
+        prefix = [("Date", "YYYYMMDD", 8)] if "D" in timestamps else []
+        prefix += [("Time", "HH:MM:SS", 8)] if "T" in timestamps else []
+        heads = [(h, u, w) for h, u, w in prefix]
+        heads.append(("gpu", "Idx", 3))
+        heads += [(c[1], c[2], c[3]) for c in self.columns]
+        self.header = "#%s\n#%s\n" % (
+            " ".join(h.rjust(w) for h, _, w in heads),
+            " ".join(u.rjust(w) for _, u, w in heads),
+        )
+        # "%5s %4s ..." for the data columns, filled per tick
+        self._format = " " + " ".join("%%%ds" % c[3] for c in self.columns) + "\n"
+
+    def _eccDeltas(self, slot):
+        device = self.devices[slot]
+        try:
+            if self._memories[slot] is None:
+                self._memories[slot] = mtmlDeviceInitMemory(device.handle)
+            counts = tuple(
+                mtmlMemoryGetEccErrorCounter(
+                    self._memories[slot],
+                    t,
+                    MTML_VOLATILE_ECC,
+                    MTML_MEMORY_LOCATION_DRAM,
+                )
+                for t in (
+                    MTML_MEMORY_ERROR_TYPE_CORRECTED,
+                    MTML_MEMORY_ERROR_TYPE_UNCORRECTED,
+                )
+            )
+        except MTMLError:
+            return ("-", "-")
+        last, self._lastEcc[slot] = self._lastEcc[slot], counts
+        if last is None:
+            return (0, 0)
+        return (counts[0] - last[0], counts[1] - last[1])
+
+    def render(self, snapshot):
+        stamp = ""
+        if self.timestamps:
+            now = time.localtime(snapshot.timestamp)
+            parts = []
+            if "D" in self.timestamps:
+                parts.append(time.strftime("%Y%m%d", now))
+            if "T" in self.timestamps:
+                parts.append(time.strftime("%H:%M:%S", now))
+            stamp = " " + " ".join(parts)
+        out = []
+        for slot, device in enumerate(self.devices):
+            values = []
+            ecc = self._eccDeltas(slot) if self._ecc else None
+            for column in self.columns:
+                metric, convert = column[4], column[5]
+                if metric is None:
+                    values.append(ecc[0] if column[1] == "sbecc" else ecc[1])
+                elif snapshot[slot].status(metric) != MTML_SUCCESS:
+                    values.append("-")
+                else:
+                    value = getattr(snapshot[slot], metric)
+                    values.append(convert(value) if convert else value)
+            out.append("%s %3d" % (stamp, device.index) + self._format % tuple(values))
+        return "".join(out)
+
+    def _onSample(self, sampler, snapshot):
+        if self.done.is_set():
+            return
+        try:
+            self.stdout.write(self.render(snapshot))
+            self.stdout.flush()
+        except BrokenPipeError:
+            self.done.set()
+        except Exception as e:
+            # raising would kill the sampler thread and leave wait() polling forever
+            self.error = e
+            self.done.set()
+            return
+        self.lines += 1
+        if self.count is not None and self.lines >= self.count:
+            self.done.set()
+
+    def wait(self):
+        """Blocks until the monitor is done, or the sampler thread has exited."""
+        # short waits keep Ctrl-C responsive on the main thread
+        while not self.done.wait(0.25):
+            if not self.sampler.running:
+                if self.error is None:
+                    self.error = RuntimeError("sampler stopped")
+                self.done.set()
+
+    def close(self):
+        for memory in self._memories:
+            if memory is not None:
+                try:
+                    mtmlDeviceFreeMemory(memory)
+                except MTMLError:
+                    pass
+
+
+def _dmonParser():
+    parser = argparse.ArgumentParser(
+        prog="mtml-smi dmon",
+        description="Stream per-device metrics, one line per device",
+    )
+    parser.add_argument(
+        "-i", "--id", help="comma-separated device indexes, UUIDs or bus ids"
+    )
+    parser.add_argument(
+        "-s",
+        "--select",
+        default="puc",
+        help="metric groups: p power/temp, u utilization, c clocks, m memory, "
+        "e ECC deltas (default: puc)",
+    )
+    parser.add_argument(
+        "-d", "--delay", type=float, default=1.0, help="seconds per line"
+    )
+    parser.add_argument("-c", "--count", type=int, help="stop after COUNT intervals")
+    parser.add_argument(
+        "-o", "--options", default="", help="D to prepend the date, T the time"
+    )
+    return parser
+
+
+def dmon(args):
+    from pymtml_sampler import MtmlSampler
+
+    devices = _selectDevices(args.id)
+    sampler = MtmlSampler(
+        interval=args.delay, devices=[d.handle for d in devices], capacity=2
+    )
+    monitor = MtmlDeviceMonitor(
+        sampler,
+        devices,
+        args.select,
+        timestamps=args.options.upper(),
+        count=args.count,
+    )
+    sys.stdout.write(monitor.header)
+    sys.stdout.flush()
+    sampler.addListener(monitor._onSample)
+    try:
+        sampler.start()
+        monitor.wait()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sampler.close()
+        monitor.close()
+    if monitor.error is not None:
+        sys.stderr.write("mtml-smi dmon: %s\n" % monitor.error)
+        return 1
+    return 0
+
+
+_SUBCOMMANDS["dmon"] = (_dmonParser, dmon)
+
+
+## topo
+def _topoParser():
+    parser = argparse.ArgumentParser(
+        prog="mtml-smi topo", description="Show the GPU topology matrix"
+    )
+    mode = parser.add_mutually_exclusive_group(required=True)
+    mode.add_argument(
+        "-m", "--matrix", action="store_true", help="link matrix with CPU/NUMA affinity"
+    )
+    mode.add_argument(
+        "-p2p", "--p2p", choices=("r", "w"), help="P2P read (r) or write (w) status"
+    )
+    parser.add_argument(
+        "-i", "--id", help="comma-separated device indexes, UUIDs or bus ids"
+    )
+    parser.add_argument("--cache-dir", help="topology cache directory")
+    parser.add_argument(
+        "--no-cache", action="store_true", help="neither read nor write the cache"
+    )
+    parser.add_argument(
+        "--refresh", action="store_true", help="rediscover and rewrite the cache"
+    )
+    return parser
+
+
+def topo(args):
+    from pymtml_topology import mtmlTopologyGet
+
+    topology = mtmlTopologyGet(
+        _selectDevices(args.id),
+        cacheDir=False if args.no_cache else args.cache_dir,
+        refresh=args.refresh,
+    )
+    sys.stdout.write(topology.matrix() if args.matrix else topology.p2pMatrix(args.p2p))
+    return 0
+
+
+_SUBCOMMANDS["topo"] = (_topoParser, topo)
+
+
+def _parser():
+    parser = argparse.ArgumentParser(
+        prog="mtml-smi",
+        description="Moore Threads System Management Interface",
+        epilog=(
+            "subcommands: %s" % ", ".join(sorted(_SUBCOMMANDS))
+            if _SUBCOMMANDS
+            else None
+        ),
+    )
+    parser.add_argument("-L", "--list-gpus", action="store_true", help="list devices")
+    parser.add_argument(
+        "-i", "--id", help="comma-separated device indexes, UUIDs or PCI bus ids"
+    )
+    parser.add_argument(
+        "--query-gpu",
+        metavar="FIELDS",
+        help="comma-separated fields, see --help-query-gpu",
+    )
+    parser.add_argument("--help-query-gpu", action="store_true", help="list fields")
+    parser.add_argument(
+        "--format", default="csv", help="csv[,noheader][,nounits] (default: csv)"
+    )
+    loop = parser.add_mutually_exclusive_group()
+    loop.add_argument(
+        "-l", "--loop", type=float, metavar="SEC", help="repeat every SEC"
+    )
+    loop.add_argument(
+        "-lms",
+        "--loop-ms",
+        type=float,
+        metavar="MS",
+        help="repeat every MS milliseconds",
+    )
+    return parser
+
+
+def main(argv=None):
+    argv = sys.argv[1:] if argv is None else argv
+    if argv and argv[0] in _SUBCOMMANDS:
+        parser, command = _SUBCOMMANDS[argv[0]]
+        args = parser().parse_args(argv[1:])
+    else:
+        args = _parser().parse_args(argv)
+        if args.help_query_gpu:
+            sys.stdout.write("".join("%s\n" % name for name in MTML_SMI_FIELDS))
+            return 0
+        command = queryGpu if args.query_gpu else listGpus
+
+    try:
+        mtmlLibraryInit()
+    except MTMLError as e:
+        sys.stderr.write("mtml-smi: failed to initialize MTML: %s\n" % e)
+        return 2
+    try:
+        return command(args)
+    except ValueError as e:
+        sys.stderr.write("mtml-smi: %s\n" % e)
+        return 2
+    finally:
+        mtmlLibraryShutDown()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
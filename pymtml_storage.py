@@ -0,0 +1,462 @@
+##
+# Append-only columnar telemetry store for pymtml
+#
+# MtmlTelemetryWriter appends MtmlSampler polls to a chunked file; MtmlTelemetryReader mmaps it
+# and answers time-range, per-device and value-range queries, decoding only the chunks whose
+# min/max index can match.
+#
+# File layout (little-endian):
+#   header   "MTMLTS01", version u16, column count u16, devices per poll u32,
+#            per column: name (16 bytes, NUL padded), array typecode (1 byte), encoding (1 byte)
+#            per device: UUID length u16, UUID (utf-8)
+#   chunk*   "MTCK", rows u32, payload bytes u32,
+#            per column: min (8 bytes), max (8 bytes), encoded offset u32, encoded length u32
+#            payload: the encoded columns
+#
+# Each flush writes one chunk per device, holding that device's rows of the flushed polls in
+# time order, so the "device" min/max of a chunk names its device and per-device queries skip
+# the other devices' chunks. Columns are encoded against the previous row and written as
+# LEB128 varints: delta-of-delta for timestamps, XOR for 64-bit memory counters (Gorilla
+# style) and zigzag delta for everything else. The "valid" column has bit k set when the read
+# of the k-th metric column succeeded; a failed read keeps the sampler's stale value.
+##
+import array
+import mmap
+import os
+import queue
+import struct
+import threading
+from ctypes import c_int32, c_int64, c_uint32, c_uint64
+
+from pymtml_sampler import MTML_SAMPLER_COLUMNS
+
+MTML_STORAGE_MAGIC = b"MTMLTS02"
+MTML_STORAGE_VERSION = 2
+
+MTML_ENCODING_DELTA = 0
+MTML_ENCODING_DOD = 1
+MTML_ENCODING_XOR = 2
+
+_CHUNK_MAGIC = b"MTCK"
+_HEADER = struct.Struct("<8sHHI")
+_COLUMN = struct.Struct("<16scB")
+_CHUNK = struct.Struct("<4sII")
+_STATS = {"q": struct.Struct("<qqII"), "Q": struct.Struct("<QQII")}
+
+# sampler ctypes column -> array typecode
+_TYPECODES = {c_int64: "q", c_int32: "i", c_uint32: "I", c_uint64: "Q"}
+# columns that are not metrics, so have no bit in "valid"
+_KEYS = ("timestamp", "device", "valid")
+
+
+def _encoding(name, typecode):
+    if name == "timestamp":
+        return MTML_ENCODING_DOD
+    if typecode == "Q":
+        return MTML_ENCODING_XOR
+    return MTML_ENCODING_DELTA
+
+
+## Varint codecs ##
+def _encodeColumn(values, encoding, out):
+    previous = previousDelta = 0
+    for value in values:
+        if encoding == MTML_ENCODING_XOR:
+            n = value ^ previous
+        else:
+            n = value - previous
+            if encoding == MTML_ENCODING_DOD:
+                n, previousDelta = n - previousDelta, n
+            n = (n << 1) if n >= 0 else ((-n) << 1) - 1
+        previous = value
+        while n >= 0x80:
+            out.append((n & 0x7F) | 0x80)
+            n >>= 7
+        out.append(n)
+
+
+def _decodeColumn(data, rows, encoding, typecode):
+    values = array.array(typecode, bytes(rows * array.array(typecode).itemsize))
+    previous = previousDelta = 0
+    pos = 0
+    for i in range(rows):
+        n = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            n |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                break
+            shift += 7
+        if encoding == MTML_ENCODING_XOR:
+            value = n ^ previous
+        else:
+            n = (n >> 1) if not n & 1 else -((n + 1) >> 1)
+            if encoding == MTML_ENCODING_DOD:
+                n += previousDelta
+                previousDelta = n
+            value = previous + n
+        previous = value
+        values[i] = value
+    return values
+
+
+## Schema ##
+class _Schema(object):
+    """Columns, devices per poll and device dictionary shared by the header and chunks."""
+
+    def __init__(self, columns, devices):
+        self.columns = columns  # [(name, typecode, encoding)]
+        self.devices = devices
+        self.stride = len(devices)
+        # bit k of the "valid" column is the k-th metric
+        self.metrics = [name for name, _, _ in columns if name not in _KEYS]
+        self.statsSize = sum(_STATS[_statsCode(t)].size for _, t, _ in columns)
+
+    def pack(self):
+        out = bytearray(
+            _HEADER.pack(
+                MTML_STORAGE_MAGIC, MTML_STORAGE_VERSION, len(self.columns), self.stride
+            )
+        )
+        for name, typecode, encoding in self.columns:
+            out += _COLUMN.pack(name.encode(), typecode.encode(), encoding)
+        for uuid in self.devices:
+            encoded = uuid.encode()
+            out += struct.pack("<H", len(encoded)) + encoded
+        return bytes(out)
+
+    @classmethod
+    def unpack(cls, data):
+        magic, version, columnCount, stride = _HEADER.unpack_from(data, 0)
+        if magic != MTML_STORAGE_MAGIC or version != MTML_STORAGE_VERSION:
+            raise ValueError("not an MTML telemetry file (version %d)" % version)
+        pos = _HEADER.size
+        columns = []
+        for _ in range(columnCount):
+            name, typecode, encoding = _COLUMN.unpack_from(data, pos)
+            columns.append((name.rstrip(b"\0").decode(), typecode.decode(), encoding))
+            pos += _COLUMN.size
+        devices = []
+        for _ in range(stride):
+            (length,) = struct.unpack_from("<H", data, pos)
+            devices.append(bytes(data[pos + 2 : pos + 2 + length]).decode())
+            pos += 2 + length
+        return cls(columns, devices), pos
+
+
+def _statsCode(typecode):
+    return "Q" if typecode == "Q" else "q"
+
+
+class MtmlChunkInfo(object):
+    """Index entry of one chunk: row count, byte offsets and per-column (min, max)."""
+
+    __slots__ = ("offset", "rows", "payload", "stats", "end")
+
+    @property
+    def device(self):
+        """Slot of the device whose rows the chunk holds."""
+        return self.stats["device"][0]
+
+    def __init__(self, offset, rows, payload, stats, end):
+        self.offset = offset
+        self.rows = rows
+        self.payload = payload
+        self.stats = stats  # name -> (min, max, encoded offset, encoded length)
+        self.end = end
+
+    def overlaps(self, name, low, high):
+        minimum, maximum = self.stats[name][:2]
+        return (low is None or maximum >= low) and (high is None or minimum <= high)
+
+
+def _scanChunks(data, schema, pos):
+    """Indexes the complete chunks from `pos`; stops at a truncated or corrupt tail."""
+    chunks = []
+    size = len(data)
+    while pos + _CHUNK.size + schema.statsSize <= size:
+        magic, rows, payloadSize = _CHUNK.unpack_from(data, pos)
+        payload = pos + _CHUNK.size + schema.statsSize
+        if magic != _CHUNK_MAGIC or payload + payloadSize > size:
+            break
+        stats = {}
+        statsPos = pos + _CHUNK.size
+        for name, typecode, _ in schema.columns:
+            entry = _STATS[_statsCode(typecode)]
+            stats[name] = entry.unpack_from(data, statsPos)
+            statsPos += entry.size
+        end = payload + payloadSize
+        chunks.append(MtmlChunkInfo(pos, rows, payload, stats, end))
+        pos = end
+    return chunks, pos
+
+
+## Writer ##
+class MtmlTelemetryWriter(object):
+    """
+    Appends every poll of `sampler` to `path`, `pollsPerChunk` polls per chunk and device.
+    Chunks are encoded and written on a background thread so the sampler cadence is not
+    disturbed. Without a sampler, pass the device UUIDs as `devices` and feed polls through
+    append().
+
+    An existing file is appended to if its columns and devices match the sampler; a chunk
+    left incomplete by a crash is truncated away first.
+    """
+
+    def __init__(
+        self, path, sampler=None, pollsPerChunk=1024, fsync=False, devices=None
+    ):
+        self.path = path
+        self.sampler = sampler
+        self.pollsPerChunk = pollsPerChunk
+        self.fsync = fsync
+        self.schema = _Schema(
+            [
+                (name, _TYPECODES[ctype], _encoding(name, _TYPECODES[ctype]))
+                for name, ctype, _ in MTML_SAMPLER_COLUMNS
+            ]
+            + [("valid", "I", MTML_ENCODING_DELTA)],
+            list(sampler.deviceDictionary if sampler is not None else devices),
+        )
+        self._allValid = (1 << len(self.schema.metrics)) - 1
+        self._file = self._open(path)
+        self._pending = self._emptyChunk()
+        self._pendingPolls = 0
+        self._queue = queue.Queue()
+        self._thread = threading.Thread(
+            target=self._run, name="mtml-storage", daemon=True
+        )
+        self._thread.start()
+        if sampler is not None:
+            sampler.addListener(self._onSample)
+
+    def _open(self, path):
+        header = self.schema.pack()
+        if not os.path.exists(path) or os.path.getsize(path) == 0:
+            f = open(path, "wb")
+            f.write(header)
+            f.flush()
+            return f
+        f = open(path, "r+b")
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as data:
+            schema, pos = _Schema.unpack(data)
+            if (schema.columns, schema.devices) != (
+                self.schema.columns,
+                self.schema.devices,
+            ):
+                f.close()
+                raise ValueError("%s was written for other columns or devices" % path)
+            _, end = _scanChunks(data, schema, pos)
+        f.truncate(end)
+        f.seek(end)
+        return f
+
+    def _emptyChunk(self):
+        return {name: array.array(t) for name, t, _ in self.schema.columns}
+
+    def _onSample(self, sampler, snapshot):
+        newest = sampler.window(1).chunks[0]
+        for name, column in self._pending.items():
+            if name != "valid":
+                column.frombytes(memoryview(newest.column(name)).cast("B"))
+        masks = [0] * self.schema.stride
+        for bit, name in enumerate(self.schema.metrics):
+            masks = [m | (flag << bit) for m, flag in zip(masks, newest.valid(name))]
+        self._pending["valid"].extend(masks)
+        self._pendingPolls += 1
+        if self._pendingPolls >= self.pollsPerChunk:
+            self.flush()
+
+    def append(self, columns):
+        """
+        Appends whole polls given as {column name: values}, one value per device per poll in
+        sampler row order. Every column of the file must be present, except "valid", which
+        defaults to every read having succeeded.
+        """
+        stride = self.schema.stride
+        polls = len(columns["timestamp"]) // stride
+        if "valid" not in columns:
+            columns = dict(columns, valid=[self._allValid] * (polls * stride))
+        done = 0
+        while done < polls:
+            take = min(polls - done, self.pollsPerChunk - self._pendingPolls)
+            for name, column in self._pending.items():
+                column.extend(columns[name][done * stride : (done + take) * stride])
+            done += take
+            self._pendingPolls += take
+            if self._pendingPolls >= self.pollsPerChunk:
+                self.flush()
+
+    def flush(self):
+        """Queues the polls gathered so far, as one chunk per device."""
+        if self._pendingPolls:
+            pending, self._pending = self._pending, self._emptyChunk()
+            self._pendingPolls = 0
+            self._queue.put(pending)
+
+    def _encode(self, columns):
+        stats = bytearray()
+        payload = bytearray()
+        rows = 0
+        for name, typecode, encoding in self.schema.columns:
+            values = columns[name]
+            rows = len(values)
+            start = len(payload)
+            _encodeColumn(values, encoding, payload)
+            stats += _STATS[_statsCode(typecode)].pack(
+                min(values), max(values), start, len(payload) - start
+            )
+        return _CHUNK.pack(_CHUNK_MAGIC, rows, len(payload)) + stats + payload
+
+    def _run(self):
+        while True:
+            columns = self._queue.get()
+            if columns is None:
+                break
+            stride = self.schema.stride
+            self._file.write(
+                b"".join(
+                    self._encode({name: c[slot::stride] for name, c in columns.items()})
+                    for slot in range(stride)
+                )
+            )
+            self._file.flush()
+            if self.fsync:
+                os.fsync(self._file.fileno())
+
+    def close(self):
+        """Detaches from the sampler and writes the remaining polls."""
+        if self.sampler is not None:
+            try:
+                self.sampler.removeListener(self._onSample)
+            except ValueError:
+                pass
+        self.flush()
+        self._queue.put(None)
+        self._thread.join()
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+## Reader ##
+class MtmlTelemetryReader(object):
+    """
+    Memory-maps a telemetry file. query() decodes only the chunks whose timestamp, device and
+    `where` ranges can match; `lastScan` reports (chunks decoded, chunks skipped) of the last
+    query. Call refresh() to pick up chunks appended since the file was opened. Bit k of the
+    "valid" column is set when the read of metrics[k] succeeded.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self._file = open(path, "rb")
+        self._map = None
+        self.chunks = []
+        self.lastScan = (0, 0)
+        self.refresh()
+        self.devices = self.schema.devices
+        self.metrics = self.schema.metrics
+        self._bits = {name: 1 << k for k, name in enumerate(self.metrics)}
+
+    def refresh(self):
+        size = os.fstat(self._file.fileno()).st_size
+        if self._map is not None:
+            if len(self._map) == size:
+                return
+            self._map.close()
+        self._map = mmap.mmap(self._file.fileno(), size, access=mmap.ACCESS_READ)
+        self.schema, pos = _Schema.unpack(self._map)
+        if self.chunks:
+            pos = self.chunks[-1].end
+        chunks, _ = _scanChunks(self._map, self.schema, pos)
+        self.chunks.extend(chunks)
+
+    def _deviceSlots(self, devices):
+        slots = set()
+        for device in devices:
+            slots.add(self.devices.index(device) if isinstance(device, str) else device)
+        return slots
+
+    def query(self, start=None, end=None, devices=None, columns=None, where=None):
+        """
+        Rows with start <= timestamp <= end (ns since the epoch), of `devices` (slots or
+        UUIDs) and with `where` = {column: (low, high)} ranges satisfied by successful reads,
+        as a dict of column name -> array.array. `columns` limits the decoded columns; the
+        timestamp, device and valid columns are always returned. Rows come chunk by chunk:
+        in time order per device, one device after the other within each flush.
+        """
+        where = dict(where or {})
+        slots = None
+        if devices is not None:
+            slots = self._deviceSlots(devices)
+        wanted = [
+            c
+            for c in self.schema.columns
+            if columns is None or c[0] in columns or c[0] in _KEYS
+        ]
+        result = {name: array.array(t) for name, t, _ in wanted}
+        decoded = skipped = 0
+        view = memoryview(self._map)
+        for chunk in self.chunks:
+            if (
+                (slots is not None and chunk.device not in slots)
+                or not chunk.overlaps("timestamp", start, end)
+                or not all(
+                    chunk.overlaps(name, low, high)
+                    for name, (low, high) in where.items()
+                )
+            ):
+                skipped += 1
+                continue
+            decoded += 1
+            values = {}
+            for name, typecode, encoding in self.schema.columns:
+                if name not in result and name not in where:
+                    continue
+                _, _, offset, length = chunk.stats[name]
+                data = view[chunk.payload + offset : chunk.payload + offset + length]
+                values[name] = _decodeColumn(data, chunk.rows, encoding, typecode)
+            self._select(values, result, start, end, slots, where)
+        view.release()
+        self.lastScan = (decoded, skipped)
+        return result
+
+    def _select(self, values, result, start, end, slots, where):
+        timestamps = values["timestamp"]
+        device = values["device"]
+        valid = values["valid"]
+        bits = self._bits
+        for i in range(len(timestamps)):
+            if (start is not None and timestamps[i] < start) or (
+                end is not None and timestamps[i] > end
+            ):
+                continue
+            if slots is not None and device[i] not in slots:
+                continue
+            if any(
+                (name in bits and not valid[i] & bits[name])
+                or (low is not None and values[name][i] < low)
+                or (high is not None and values[name][i] > high)
+                for name, (low, high) in where.items()
+            ):
+                continue
+            for name, column in result.items():
+                column.append(values[name][i])
+
+    def close(self):
+        if self._map is not None:
+            self._map.close()
+            self._map = None
+        self._file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
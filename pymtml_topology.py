@@ -0,0 +1,647 @@
+##
+# GPU topology matrix for pymtml
+#
+# MtmlTopology holds, for every ordered device pair, the topology level, P2P read and write
+# status and the number of MtLink links between them, plus each device's CPU and NUMA
+# affinity. Discovery is O(n^2) driver calls (hundreds on a 16-GPU node), so the pairwise
+# calls are spread over a thread pool, and the result can be saved to a small JSON file keyed
+# by the driver version and the set of device UUIDs: any driver upgrade or device swap
+# produces a different key and forces a fresh discovery.
+#
+# MtmlStaticSnapshot adds the static per-device attributes (name, serial, memory size, max
+# clocks, MtLink spec and link states...) to the topology. mtmlStaticInit() loads it from a
+# file keyed by the driver version, the library version and the device UUIDs and SBDFs, so a
+# restarted service skips both discovery passes. A background thread then re-reads only the
+# MtLink states and rediscovers the devices, and device pairs, whose links changed.
+##
+import hashlib
+import json
+import os
+import threading
+from concurrent.futures import ThreadPoolExecutor
+
+from pymtml import *
+from pymtml_affinity import mtmlAffinityGet
+
+MTML_TOPOLOGY_FORMAT = 1
+MTML_STATIC_FORMAT = 2
+
+# cell text for each topology level, as in nvidia-smi topo -m
+MTML_TOPOLOGY_LEVEL_NAMES = {
+    MTML_TOPOLOGY_INTERNAL: "INT",
+    MTML_TOPOLOGY_SINGLE: "PIX",
+    MTML_TOPOLOGY_MULTIPLE: "PXB",
+    MTML_TOPOLOGY_HOSTBRIDGE: "PHB",
+    MTML_TOPOLOGY_NODE: "NODE",
+    MTML_TOPOLOGY_SYSTEM: "SYS",
+}
+
+MTML_P2P_STATUS_NAMES = {
+    MTML_P2P_STATUS_OK: "OK",
+    MTML_P2P_STATUS_CHIPSET_NOT_SUPPORTED: "CNS",
+    MTML_P2P_STATUS_GPU_NOT_SUPPORTED: "GNS",
+    MTML_P2P_STATUS_UNKNOWN: "U",
+}
+
+
+def _driverVersion():
+    system = mtmlLibraryInitSystem()
+    try:
+        version = mtmlSystemGetDriverVersion(system)
+    finally:
+        mtmlLibraryFreeSystem(system)
+    return version.decode() if isinstance(version, bytes) else version
+
+
+def _libraryVersion():
+    version = mtmlLibraryGetVersion()
+    return version.decode() if isinstance(version, bytes) else version
+
+
+def _ranges(ids):
+    """[0, 1, 2, 3, 8] -> "0-3,8"."""
+    out = []
+    for i in ids:
+        if out and out[-1][1] == i - 1:
+            out[-1][1] = i
+        else:
+            out.append([i, i])
+    return ",".join(str(a) if a == b else "%d-%d" % (a, b) for a, b in out)
+
+
+def mtmlTopologyCacheKey(driverVersion, uuids):
+    digest = hashlib.sha256()
+    digest.update(driverVersion.encode())
+    for uuid in sorted(uuids):
+        digest.update(b"\0" + uuid.encode())
+    return digest.hexdigest()[:32]
+
+
+def mtmlTopologyCacheDir():
+    base = os.environ.get("XDG_CACHE_HOME") or os.path.join(
+        os.path.expanduser("~"), ".cache"
+    )
+    return os.path.join(base, "pymtml")
+
+
+class MtmlTopology(object):
+    """
+    Pairwise topology of `uuids` (in device index order). level, p2pRead, p2pWrite and
+    mtlinks are n x n lists indexed [i][j]; an entry is None when the driver call failed and
+    the diagonal is None. cpus and numaNodes list the CPU and NUMA node ids local to each
+    device.
+    """
+
+    def __init__(
+        self,
+        driverVersion,
+        uuids,
+        level,
+        p2pRead,
+        p2pWrite,
+        mtlinks,
+        cpus,
+        numaNodes,
+    ):
+        self.driverVersion = driverVersion
+        self.uuids = list(uuids)
+        self.level = level
+        self.p2pRead = p2pRead
+        self.p2pWrite = p2pWrite
+        self.mtlinks = mtlinks
+        self.cpus = cpus
+        self.numaNodes = numaNodes
+
+    def __len__(self):
+        return len(self.uuids)
+
+    @property
+    def key(self):
+        return mtmlTopologyCacheKey(self.driverVersion, self.uuids)
+
+    def toDict(self):
+        return {
+            "format": MTML_TOPOLOGY_FORMAT,
+            "driverVersion": self.driverVersion,
+            "uuids": self.uuids,
+            "level": self.level,
+            "p2pRead": self.p2pRead,
+            "p2pWrite": self.p2pWrite,
+            "mtlinks": self.mtlinks,
+            "cpus": self.cpus,
+            "numaNodes": self.numaNodes,
+        }
+
+    @classmethod
+    def fromDict(cls, data):
+        if data.get("format") != MTML_TOPOLOGY_FORMAT:
+            raise ValueError("unsupported topology format %r" % data.get("format"))
+        return cls(
+            data["driverVersion"],
+            data["uuids"],
+            data["level"],
+            data["p2pRead"],
+            data["p2pWrite"],
+            data["mtlinks"],
+            data["cpus"],
+            data["numaNodes"],
+        )
+
+    def save(self, path):
+        """Writes the topology atomically, so a concurrent reader never sees a partial file."""
+        directory = os.path.dirname(path)
+        if directory:
+            os.makedirs(directory, exist_ok=True)
+        tmp = "%s.%d.tmp" % (path, os.getpid())
+        with open(tmp, "w") as f:
+            json.dump(self.toDict(), f, separators=(",", ":"))
+        os.replace(tmp, path)
+
+    @classmethod
+    def load(cls, path):
+        with open(path) as f:
+            return cls.fromDict(json.load(f))
+
+    def reordered(self, uuids):
+        """The same topology with devices in the order of `uuids`."""
+        if uuids == self.uuids:
+            return self
+        order = [self.uuids.index(u) for u in uuids]
+
+        def pairs(m):
+            return [[m[i][j] for j in order] for i in order]
+
+        return MtmlTopology(
+            self.driverVersion,
+            uuids,
+            pairs(self.level),
+            pairs(self.p2pRead),
+            pairs(self.p2pWrite),
+            pairs(self.mtlinks),
+            [self.cpus[i] for i in order],
+            [self.numaNodes[i] for i in order],
+        )
+
+    def cell(self, i, j):
+        """Text of one topo -m cell: X, ML<links> for MtLink peers, else the level name."""
+        if i == j:
+            return "X"
+        if self.mtlinks[i][j]:
+            return "ML%d" % self.mtlinks[i][j]
+        return MTML_TOPOLOGY_LEVEL_NAMES.get(self.level[i][j], "N/A")
+
+    def labels(self):
+        """GPU<index> for each device: its registry index, or its position if unregistered."""
+        labels = []
+        for position, uuid in enumerate(self.uuids):
+            try:
+                index = mtmlGetDeviceRegistry().byUuid(uuid).index
+            except MTMLError:
+                index = position
+            labels.append("GPU%d" % index)
+        return labels
+
+    def matrix(self):
+        """nvidia-smi topo -m style text: link matrix plus CPU and NUMA affinity columns."""
+        n = len(self)
+        labels = self.labels()
+        rows = [["", *labels, "CPU Affinity", "NUMA Affinity"]]
+        for i in range(n):
+            rows.append(
+                [labels[i]]
+                + [self.cell(i, j) for j in range(n)]
+                + [_ranges(self.cpus[i]) or "N/A", _ranges(self.numaNodes[i]) or "N/A"]
+            )
+        return _table(rows) + _LEGEND
+
+    def p2pMatrix(self, mode="r"):
+        """P2P read ("r") or write ("w") status matrix, as in nvidia-smi topo -p2p."""
+        status = self.p2pRead if mode == "r" else self.p2pWrite
+        n = len(self)
+        labels = self.labels()
+        rows = [["", *labels]]
+        for i in range(n):
+            rows.append(
+                [labels[i]]
+                + [
+                    "X" if i == j else MTML_P2P_STATUS_NAMES.get(status[i][j], "N/A")
+                    for j in range(n)
+                ]
+            )
+        return _table(rows) + _P2P_LEGEND
+
+
+def _table(rows):
+    widths = [max(len(row[c]) for row in rows) for c in range(len(rows[0]))]
+    return "".join(
+        " ".join(cell.ljust(w) for cell, w in zip(row, widths)).rstrip() + "\n"
+        for row in rows
+    )
+
+
+_LEGEND = """
+Legend:
+
+  X    = Self
+  ML#  = Connection traversing a bonded set of # MtLinks
+  SYS  = Connection traversing PCIe as well as the interconnect between NUMA nodes
+  NODE = Connection traversing PCIe and host bridges within a NUMA node
+  PHB  = Connection traversing PCIe as well as a PCIe host bridge
+  PXB  = Connection traversing multiple PCIe bridges
+  PIX  = Connection traversing at most a single PCIe bridge
+  INT  = Devices on the same board
+"""
+
+_P2P_LEGEND = """
+Legend:
+
+  X   = Self
+  OK  = Status Ok
+  CNS = Chipset not supported
+  GNS = GPU not supported
+  U   = Unknown
+"""
+
+
+def _call(fn, *args):
+    try:
+        return fn(*args)
+    except MTMLError:
+        return None
+
+
+def _pair(a, b):
+    """Every pairwise call for the ordered pair (a, b)."""
+    return (
+        _call(mtmlDeviceGetTopologyLevel, a, b),
+        _call(mtmlDeviceGetP2PStatus, a, b, MTML_P2P_CAPS_READ),
+        _call(mtmlDeviceGetP2PStatus, a, b, MTML_P2P_CAPS_WRITE),
+        _call(mtmlDeviceCountMtLinkLayouts, a, b),
+    )
+
+
+def mtmlTopologyDiscover(devices=None, workers=16):
+    """
+    Queries the topology of `devices` (MtmlDevice list, all devices by default) with the
+    pairwise calls spread over `workers` threads. The calls only read driver state, so they
+    take no device locks and run concurrently.
+    """
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    devices = list(devices)
+    n = len(devices)
+    pairs = [(i, j) for i in range(n) for j in range(n) if i != j]
+    with ThreadPoolExecutor(max_workers=max(1, workers)) as pool:
+        affinity = pool.map(mtmlAffinityGet, devices)
+        results = pool.map(
+            lambda p: _pair(devices[p[0]].handle, devices[p[1]].handle), pairs
+        )
+        affinity = list(affinity)
+        results = list(results)
+
+    level, p2pRead, p2pWrite, mtlinks = (
+        [[None] * n for _ in range(n)] for _ in range(4)
+    )
+    for (i, j), (lv, read, write, links) in zip(pairs, results):
+        level[i][j], p2pRead[i][j], p2pWrite[i][j], mtlinks[i][j] = (
+            lv,
+            read,
+            write,
+            links,
+        )
+    return MtmlTopology(
+        _driverVersion(),
+        [d.uuid for d in devices],
+        level,
+        p2pRead,
+        p2pWrite,
+        mtlinks,
+        [list(a.cpus) for a in affinity],
+        [list(a.numaNodes) for a in affinity],
+    )
+
+
+def mtmlTopologyGet(devices=None, cacheDir=None, refresh=False, workers=16):
+    """
+    Returns the topology of `devices`, from `cacheDir` (mtmlTopologyCacheDir() by default)
+    when a file for the current driver version and UUID set exists, otherwise by discovery,
+    saving the result. Pass cacheDir=False to always discover without touching the disk.
+    """
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    devices = list(devices)
+    path = None
+    if cacheDir is not False:
+        key = mtmlTopologyCacheKey(_driverVersion(), [d.uuid for d in devices])
+        path = os.path.join(
+            cacheDir or mtmlTopologyCacheDir(), "topology-%s.json" % key
+        )
+        static = _mtmlStaticSnapshot
+        if not refresh and static is not None:
+            topology = static.topology
+            if topology.driverVersion == _driverVersion() and sorted(
+                topology.uuids
+            ) == sorted(d.uuid for d in devices):
+                return topology.reordered([d.uuid for d in devices])
+        if not refresh:
+            try:
+                topology = MtmlTopology.load(path)
+            except (OSError, ValueError, KeyError):
+                pass
+            else:
+                # the key covers the UUID set, not its order
+                uuids = [d.uuid for d in devices]
+                if sorted(topology.uuids) == sorted(uuids):
+                    return topology.reordered(uuids)
+    topology = mtmlTopologyDiscover(devices, workers)
+    if path is not None:
+        try:
+            topology.save(path)
+        except OSError:
+            pass  # a read-only home is not an error, just no cache
+    return topology
+
+
+## Static snapshot
+# name, handle the getter takes ("device", "gpu", "memory" or "vpu"), getter
+MTML_STATIC_ATTRIBUTES = (
+    ("name", "device", mtmlDeviceGetName),
+    ("serial", "device", mtmlDeviceGetSerialNumber),
+    ("vbiosVersion", "device", mtmlDeviceGetVbiosVersion),
+    ("gpuCores", "device", mtmlDeviceCountGpuCores),
+    ("gpuMaxClock", "gpu", mtmlGpuGetMaxClock),
+    ("memoryTotal", "memory", mtmlMemoryGetTotal),
+    ("memoryBusWidth", "memory", mtmlMemoryGetBusWidth),
+    ("memoryMaxClock", "memory", mtmlMemoryGetMaxClock),
+    ("vpuMaxClock", "vpu", mtmlVpuGetMaxClock),
+)
+
+_SUB_HANDLES = {
+    "gpu": (mtmlDeviceInitGpu, mtmlDeviceFreeGpu),
+    "memory": (mtmlDeviceInitMemory, mtmlDeviceFreeMemory),
+    "vpu": (mtmlDeviceInitVpu, mtmlDeviceFreeVpu),
+}
+
+
+def mtmlStaticSnapshotKey(driverVersion, libraryVersion, devices):
+    """`devices` is a sequence of (uuid, sbdf)."""
+    digest = hashlib.sha256()
+    digest.update(driverVersion.encode() + b"\0" + libraryVersion.encode())
+    for uuid, sbdf in sorted(devices, key=lambda d: d[0]):
+        digest.update(b"\0%s/%s" % (uuid.encode(), (sbdf or "").encode()))
+    return digest.hexdigest()[:32]
+
+
+def _mtlinkStates(device, spec):
+    """State of each MtLink of `device`, the input revalidation compares; None without."""
+    if spec is None:
+        return None
+    return [
+        _call(mtmlDeviceGetMtLinkState, device.handle, link)
+        for link in range(spec.linkNum)
+    ]
+
+
+def _staticAttributes(device):
+    attributes = {"uuid": device.uuid, "sbdf": device.sbdf}
+    subHandles = {"device": device.handle}
+    try:
+        for name, kind, getter in MTML_STATIC_ATTRIBUTES:
+            if kind not in subHandles:
+                subHandles[kind] = _call(_SUB_HANDLES[kind][0], device.handle)
+            handle = subHandles[kind]
+            value = None if handle is None else _call(getter, handle)
+            attributes[name] = value.decode() if isinstance(value, bytes) else value
+        spec = _call(mtmlDeviceGetMtLinkSpec, device.handle)
+        attributes["mtlinkVersion"] = spec.version if spec else None
+        attributes["mtlinkBandwidth"] = spec.bandWidth if spec else None
+        attributes["mtlinkCount"] = spec.linkNum if spec else None
+        attributes["mtlinkStates"] = _mtlinkStates(device, spec)
+    finally:
+        for kind, (_, free) in _SUB_HANDLES.items():
+            if subHandles.get(kind) is not None:
+                _call(free, subHandles[kind])
+    return attributes
+
+
+class MtmlStaticSnapshot(object):
+    """
+    Everything about a node that only changes with the driver, the library or the hardware:
+    `devices` holds one dict of MTML_STATIC_ATTRIBUTES (plus uuid, sbdf and the MtLink spec)
+    per device in index order, and `topology` the MtmlTopology of those devices.
+    `revalidation` is the background thread started by mtmlStaticInit, if any.
+    """
+
+    def __init__(self, driverVersion, libraryVersion, devices, topology):
+        self.driverVersion = driverVersion
+        self.libraryVersion = libraryVersion
+        self.devices = devices
+        self.topology = topology
+        self.revalidation = None
+
+    @property
+    def key(self):
+        return mtmlStaticSnapshotKey(
+            self.driverVersion,
+            self.libraryVersion,
+            [(d["uuid"], d["sbdf"]) for d in self.devices],
+        )
+
+    def device(self, uuid):
+        for attributes in self.devices:
+            if attributes["uuid"] == uuid:
+                return attributes
+        raise MTMLError(MTML_ERROR_NOT_FOUND)
+
+    def toDict(self):
+        return {
+            "format": MTML_STATIC_FORMAT,
+            "driverVersion": self.driverVersion,
+            "libraryVersion": self.libraryVersion,
+            "devices": self.devices,
+            "topology": self.topology.toDict(),
+        }
+
+    @classmethod
+    def fromDict(cls, data):
+        if data.get("format") != MTML_STATIC_FORMAT:
+            raise ValueError(
+                "unsupported static snapshot format %r" % data.get("format")
+            )
+        return cls(
+            data["driverVersion"],
+            data["libraryVersion"],
+            data["devices"],
+            MtmlTopology.fromDict(data["topology"]),
+        )
+
+    save = MtmlTopology.save
+
+    @classmethod
+    def load(cls, path):
+        with open(path) as f:
+            return cls.fromDict(json.load(f))
+
+
+def mtmlStaticSnapshotDiscover(devices=None, workers=16):
+    """Reads the static attributes and topology of `devices` (all devices by default)."""
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    devices = list(devices)
+    with ThreadPoolExecutor(max_workers=max(1, workers)) as pool:
+        attributes = list(pool.map(_staticAttributes, devices))
+    return MtmlStaticSnapshot(
+        _driverVersion(),
+        _libraryVersion(),
+        attributes,
+        mtmlTopologyDiscover(devices, workers),
+    )
+
+
+_mtmlStaticSnapshot = None
+_mtmlStaticLock = threading.Lock()  # guards installing _mtmlStaticSnapshot
+
+
+def mtmlGetStaticSnapshot():
+    """The snapshot installed by mtmlStaticInit, or None."""
+    return _mtmlStaticSnapshot
+
+
+def _lostReads(fresh, cached):
+    """Whether `fresh` holds a failed read (None) where `cached` holds a value."""
+    if fresh is None:
+        return cached is not None
+    if isinstance(fresh, dict) and isinstance(cached, dict):
+        return any(_lostReads(v, cached.get(k)) for k, v in fresh.items())
+    if isinstance(fresh, list) and isinstance(cached, list):
+        return len(fresh) == len(cached) and any(map(_lostReads, fresh, cached))
+    return False
+
+
+def _revalidate(snapshot, path, devices, onChange):
+    global _mtmlStaticSnapshot
+
+    # the key already matched the driver, library, UUIDs and SBDFs; MtLink state is the one
+    # input left that changes under it, and reading it is O(links), not O(n^2)
+    try:
+        states = [
+            _mtlinkStates(d, _call(mtmlDeviceGetMtLinkSpec, d.handle)) for d in devices
+        ]
+    except MTMLError:
+        return  # library shut down or devices reset meanwhile; the next start retries
+    changed = {
+        i
+        for i, attributes in enumerate(snapshot.devices)
+        if states[i] != attributes.get("mtlinkStates")
+    }
+    if not changed:
+        return
+    try:
+        attributes = list(snapshot.devices)
+        for i in changed:
+            attributes[i] = _staticAttributes(devices[i])
+        n = len(devices)
+        pairs = [
+            (i, j)
+            for i in range(n)
+            for j in range(n)
+            if i != j and (i in changed or j in changed)
+        ]
+        # a couple of workers: this runs beside a service that has already started
+        with ThreadPoolExecutor(max_workers=2) as pool:
+            results = list(
+                pool.map(
+                    lambda p: _pair(devices[p[0]].handle, devices[p[1]].handle), pairs
+                )
+            )
+    except MTMLError:
+        return
+    cached = snapshot.topology
+    level, p2pRead, p2pWrite, mtlinks = (
+        [list(row) for row in m]
+        for m in (cached.level, cached.p2pRead, cached.p2pWrite, cached.mtlinks)
+    )
+    for (i, j), (lv, read, write, links) in zip(pairs, results):
+        level[i][j], p2pRead[i][j], p2pWrite[i][j], mtlinks[i][j] = (
+            lv,
+            read,
+            write,
+            links,
+        )
+    fresh = MtmlStaticSnapshot(
+        snapshot.driverVersion,
+        snapshot.libraryVersion,
+        attributes,
+        MtmlTopology(
+            cached.driverVersion,
+            cached.uuids,
+            level,
+            p2pRead,
+            p2pWrite,
+            mtlinks,
+            cached.cpus,
+            cached.numaNodes,
+        ),
+    )
+    data = fresh.toDict()
+    if _lostReads(data, snapshot.toDict()):
+        return  # a call failed this time; keep the good snapshot, the next start retries
+    try:
+        fresh.save(path)
+    except OSError:
+        pass
+    with _mtmlStaticLock:
+        if _mtmlStaticSnapshot is snapshot:
+            _mtmlStaticSnapshot = fresh
+    if onChange is not None:
+        onChange(fresh)
+
+
+def mtmlStaticInit(cacheDir=None, revalidate=True, onChange=None):
+    """
+    Installs the static snapshot for the current devices, to be called after mtmlLibraryInit.
+
+    The key needs only the driver and library versions and the registry (whose UUIDs and
+    SBDFs are read anyway), so a service restarted on an unchanged node loads the snapshot
+    from `cacheDir` (mtmlTopologyCacheDir() by default) instead of discovering it. With
+    `revalidate`, a background thread re-reads the MtLink states of a loaded snapshot. For
+    the devices whose states changed it rediscovers their attributes and every pair they
+    are part of; the file is rewritten, the new snapshot is installed and
+    onChange(snapshot) is called. A rediscovery in which a call failed that had succeeded
+    before changes nothing. mtmlTopologyGet serves matching device sets from the installed
+    snapshot.
+    """
+    global _mtmlStaticSnapshot
+
+    devices = list(mtmlGetDeviceRegistry().devices)
+    key = mtmlStaticSnapshotKey(
+        _driverVersion(), _libraryVersion(), [(d.uuid, d.sbdf) for d in devices]
+    )
+    path = os.path.join(cacheDir or mtmlTopologyCacheDir(), "static-%s.json" % key)
+    loaded = True
+    try:
+        snapshot = MtmlStaticSnapshot.load(path)
+        if snapshot.key != key:
+            raise ValueError("static snapshot key mismatch")
+    except (OSError, ValueError, KeyError):
+        loaded = False
+        snapshot = mtmlStaticSnapshotDiscover(devices)
+        try:
+            snapshot.save(path)
+        except OSError:
+            pass
+    else:
+        snapshot.topology = snapshot.topology.reordered([d.uuid for d in devices])
+        snapshot.devices = [snapshot.device(d.uuid) for d in devices]
+    # installed before revalidation starts, which only replaces what it was given
+    with _mtmlStaticLock:
+        _mtmlStaticSnapshot = snapshot
+    if loaded and revalidate:
+        snapshot.revalidation = threading.Thread(
+            target=_revalidate,
+            args=(snapshot, path, devices, onChange),
+            name="mtml-static-revalidate",
+            daemon=True,
+        )
+        snapshot.revalidation.start()
+    return snapshot
@@ -0,0 +1,266 @@
+##
+# vGPU inventory snapshots and diffs
+#
+# mtmlVirtInventoryGet reads the virtualization state of every physical device in one pass:
+# for each device the active virtual device count and UUIDs, and how many more virtual
+# devices of each supported type can still be created. Supported MtmlVirtType tables only
+# change with the driver, so they are read once per device (by UUID) and their structures
+# are reused for every mtmlDeviceCountAvailVirtDevices call. A type is available when at
+# least one more device of it fits, so the available type list comes from those counts
+# instead of separate mtmlDeviceCountAvailVirtTypes/GetAvailVirtTypes calls.
+#
+# MtmlVirtInventory.diff(previous) compares two snapshots with one set difference per
+# physical device and returns only the virtual devices added or removed in between. A device
+# whose read failed is unknown in that snapshot (active is None), not empty, so a transient
+# error never shows up as every vGPU on it being removed. The active UUIDs are read into a
+# string buffer kept per device, so repeated inventories do not allocate one per read.
+##
+import threading
+import time
+
+from pymtml import *
+
+_MB = 1 << 20
+
+
+class MtmlVirtType(object):
+    """
+    One supported vGPU type. `struct` is the c_mtmlVirtType_t the driver returned, passed
+    back by reference to the per-type count calls.
+    """
+
+    __slots__ = (
+        "id",
+        "deviceClass",
+        "name",
+        "maxInstances",
+        "memoryMB",
+        "gpuCores",
+        "maxResWidth",
+        "maxResHeight",
+        "apiType",
+        "encoderNum",
+        "decoderNum",
+        "struct",
+    )
+
+    def __init__(self, struct):
+        self.id = struct.id
+        self.deviceClass = struct.deviceClass
+        self.name = struct.name
+        self.maxInstances = struct.maxInstances
+        self.memoryMB = struct.memSize // _MB
+        self.gpuCores = struct.gpuCores
+        self.maxResWidth = struct.maxResWidth
+        self.maxResHeight = struct.maxResHeight
+        self.apiType = struct.apiType
+        self.encoderNum = struct.encoderNum
+        self.decoderNum = struct.decoderNum
+        self.struct = struct
+
+    def __repr__(self):
+        return "MtmlVirtType(id=%r, name=%r, maxInstances=%d, memoryMB=%d)" % (
+            self.id,
+            self.name,
+            self.maxInstances,
+            self.memoryMB,
+        )
+
+
+_mtmlVirtTypes = dict()  # physical device UUID -> tuple of MtmlVirtType
+_mtmlVirtTypesLock = threading.Lock()
+
+
+def mtmlVirtTypesGet(device):
+    """
+    Supported vGPU types of `device` (MtmlDevice), read once and cached by UUID. Empty when
+    the device does not support virtualization. Other failures raise MTMLError and cache
+    nothing, so the next call reads again.
+    """
+    types = _mtmlVirtTypes.get(device.uuid)
+    if types is None:
+        try:
+            count = mtmlDeviceCountSupportedVirtTypes(device.handle)
+            structs = (
+                mtmlDeviceGetSupportedVirtTypes(device.handle, count) if count else []
+            )
+        except MTMLError as e:
+            if e.value != MTML_ERROR_NOT_SUPPORTED:
+                raise
+            structs = []
+        types = tuple(MtmlVirtType(s) for s in structs)
+        with _mtmlVirtTypesLock:
+            types = _mtmlVirtTypes.setdefault(device.uuid, types)
+    return types
+
+
+class MtmlVirtDeviceState(object):
+    """
+    Virtualization state of one physical device: its supported `types`, `available` (the
+    number of further devices of each type, in the same order) and `active` (frozenset of
+    active virtual device UUIDs). When the read failed, `available` and `active` are None
+    and `error` is the MtmlReturn code.
+    """
+
+    __slots__ = ("device", "types", "available", "active", "error")
+
+    def __init__(self, device, types, available, active, error=None):
+        self.device = device
+        self.types = types
+        self.available = available
+        self.active = active
+        self.error = error
+
+    @property
+    def known(self):
+        return self.active is not None
+
+    @property
+    def availableTypes(self):
+        """The types of which at least one more virtual device can be created."""
+        if self.available is None:
+            return []
+        return [t for t, n in zip(self.types, self.available) if n]
+
+    def __repr__(self):
+        if self.active is None:
+            return "MtmlVirtDeviceState(uuid=%r, error=%r)" % (
+                self.device.uuid,
+                self.error,
+            )
+        return "MtmlVirtDeviceState(uuid=%r, available=%r, active=%d)" % (
+            self.device.uuid,
+            dict((t.id, n) for t, n in zip(self.types, self.available)),
+            len(self.active),
+        )
+
+
+class MtmlVirtDiff(object):
+    """
+    Virtual devices `added` and `removed` between two inventories, each as a list of
+    (virtual device UUID, physical device UUID) sorted by physical device, then UUID.
+    """
+
+    __slots__ = ("added", "removed")
+
+    def __init__(self, added, removed):
+        self.added = added
+        self.removed = removed
+
+    def __bool__(self):
+        return bool(self.added or self.removed)
+
+    def __repr__(self):
+        return "MtmlVirtDiff(added=%r, removed=%r)" % (self.added, self.removed)
+
+
+_EMPTY = frozenset()
+
+
+class MtmlVirtInventory(object):
+    """
+    Virtualization state of a set of physical devices at `timestamp`. `devices` maps
+    physical device UUID to MtmlVirtDeviceState, in device order.
+    """
+
+    def __init__(self, devices, timestamp):
+        self.devices = devices
+        self.timestamp = timestamp
+        self._owners = None
+
+    @property
+    def owners(self):
+        """Active virtual device UUID -> physical device UUID."""
+        owners = self._owners
+        if owners is None:
+            owners = self._owners = {
+                virt: uuid
+                for uuid, state in self.devices.items()
+                if state.active is not None
+                for virt in state.active
+            }
+        return owners
+
+    def diff(self, previous):
+        """
+        MtmlVirtDiff from `previous` (an older MtmlVirtInventory, or None for an empty one)
+        to this one. Devices whose active set is unchanged cost one set comparison. Devices
+        unknown in either inventory are skipped; diff against the inventory last acted on to
+        pick up their changes once they read again.
+        """
+        added, removed = [], []
+        before = previous.devices if previous is not None else {}
+        for uuid, state in self.devices.items():
+            if state.active is None:
+                continue
+            old = before.get(uuid)
+            if old is None:
+                old = _EMPTY
+            elif old.active is None:
+                continue
+            else:
+                old = old.active
+            if old == state.active:
+                continue
+            added += [(virt, uuid) for virt in sorted(state.active - old)]
+            removed += [(virt, uuid) for virt in sorted(old - state.active)]
+        for uuid, state in before.items():
+            if uuid not in self.devices and state.active is not None:
+                removed += [(virt, uuid) for virt in sorted(state.active)]
+        return MtmlVirtDiff(added, removed)
+
+    def __repr__(self):
+        return "MtmlVirtInventory(devices=%d, active=%d)" % (
+            len(self.devices),
+            len(self.owners),
+        )
+
+
+# physical device UUID -> string buffer for its active vGPU UUIDs, grown to the largest
+# count seen. A read takes the buffer out while using it, so concurrent reads of the same
+# device never share one.
+_mtmlVirtUuidBuffers = dict()
+
+
+def _readActive(device, count):
+    buffer = _mtmlVirtUuidBuffers.pop(device.uuid, None)
+    if buffer is None or sizeof(buffer) < MTML_DEVICE_UUID_BUFFER_SIZE * count:
+        buffer = create_string_buffer(MTML_DEVICE_UUID_BUFFER_SIZE * count)
+    active = frozenset(
+        mtmlDeviceGetActiveVirtDeviceUuids(
+            device.handle, MTML_DEVICE_UUID_BUFFER_SIZE, count, buffer
+        )
+    )
+    _mtmlVirtUuidBuffers[device.uuid] = buffer
+    return active
+
+
+def _readState(device, types):
+    handle = device.handle
+    try:
+        count = mtmlDeviceCountActiveVirtDevices(handle)
+        active = _readActive(device, count) if count else _EMPTY
+        available = tuple(
+            mtmlDeviceCountAvailVirtDevices(handle, t.struct) for t in types
+        )
+    except MTMLError as e:
+        return MtmlVirtDeviceState(device, types, None, None, e.value)
+    return MtmlVirtDeviceState(device, types, available, active)
+
+
+def mtmlVirtInventoryGet(devices=None):
+    """One-pass MtmlVirtInventory of `devices` (MtmlDevice list, all devices by default)."""
+    if devices is None:
+        devices = mtmlGetDeviceRegistry().devices
+    states = {}
+    for device in devices:
+        try:
+            types = mtmlVirtTypesGet(device)
+        except MTMLError as e:
+            states[device.uuid] = MtmlVirtDeviceState(device, (), None, None, e.value)
+            continue
+        if types:
+            states[device.uuid] = _readState(device, types)
+        else:
+            states[device.uuid] = MtmlVirtDeviceState(device, types, (), _EMPTY)
+    return MtmlVirtInventory(states, time.time())
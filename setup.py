@@ -1,4 +1,4 @@
-from distutils.core import setup
+from setuptools import setup
 from sys import version
 from sys import exit
 
@@ -46,7 +46,12 @@ setup(name=_package_name,
       description='Python Bindings for the Moore Threads GPU Management Library',
       long_description=long_description,
       long_description_content_type='text/markdown',
-      py_modules=['pymtml', 'example'],
+      py_modules=['pymtml', '_pymtml_nvml', 'pymtml_arrow', 'pymtml_sampler',
+                  'pymtml_storage', 'pymtml_rollup', 'pymtml_sketch', 'pymtml_exporter',
+                  'pymtml_smi', 'pymtml_topology', 'pymtml_affinity',
+                  'pymtml_bandwidth', 'pymtml_collective', 'pymtml_mpc',
+                  'pymtml_virt', 'pymtml_placement', 'example'],
+      entry_points={'console_scripts': ['mtml-smi = pymtml_smi:main']},
       package_data={_package_name: ['Example.txt']},
       license='BSD',
       url='https://developer.mthreads.com',
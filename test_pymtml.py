@@ -280,6 +280,814 @@ class MtmlTestSuite:
             lambda: mtmlDeviceGetP2PStatus(dev1, dev2, MTML_P2P_CAPS_WRITE),
         )
 
+    def test_device_registry(self, devices):
+        print_section("Device Registry")
+
+        registry = mtmlGetDeviceRegistry()
+        print_result("Registered Devices", len(registry))
+        for idx, device in enumerate(devices):
+            entry = registry.byHandle(device)
+            print_result(f"Device {idx}", entry)
+            assert entry.index == idx, "registry index mismatch"
+            assert registry.byIndex(idx) is entry, "byIndex lookup mismatch"
+            assert registry.byUuid(entry.uuid) is entry, "byUuid lookup mismatch"
+            if entry.sbdf:
+                assert registry.bySbdf(entry.sbdf) is entry, "bySbdf lookup mismatch"
+            # a fresh handle to the same device must resolve to an equal entry
+            assert registry.byHandle(mtmlLibraryInitDeviceByIndex(idx)) == entry
+        print_result("Lookups by index/UUID/SBDF/handle", "OK")
+        # a rejected reconfiguration leaves the handles, and so the registry, valid
+        for reject in (
+            lambda: mtmlDeviceSetMpcConfiguration(devices[0], 0xFFFF),
+            lambda: mtmlLibrarySetMpcConfigurationInBatch([devices[0]], [0xFFFF]),
+        ):
+            try:
+                reject()
+            except MTMLError:
+                assert mtmlGetDeviceRegistry() is registry, "registry dropped on error"
+
+    def test_snapshot_polling(self, devices):
+        print_section("Snapshot Polling")
+
+        snapshot = MtmlSnapshot(devices)
+        mtmlPollInto(snapshot)
+        for idx, device in enumerate(devices):
+            entry = snapshot[idx]
+            print_result(f"Device {idx}", entry)
+            if entry.status("memoryTotal") == MTML_SUCCESS:
+                memory = mtmlDeviceInitMemory(device)
+                try:
+                    assert entry.memoryTotal == mtmlMemoryGetTotal(memory)
+                finally:
+                    mtmlDeviceFreeMemory(memory)
+        print_result("Timestamp", snapshot.timestamp)
+
+        # steady-state polls must not leave allocations behind
+        for _ in range(100):
+            mtmlPollInto(snapshot)
+        before = sys.getallocatedblocks()
+        for _ in range(1000):
+            mtmlPollInto(snapshot)
+        leaked = sys.getallocatedblocks() - before
+        print_result("Allocated blocks after 1000 polls", leaked)
+        assert leaked < 16, "mtmlPollInto allocates in steady state"
+        snapshot.close()
+
+    def test_sampler_export(self, devices):
+        print_section("Sampler Zero-copy Export")
+        from pymtml_sampler import MtmlSampler
+
+        sampler = MtmlSampler(devices=devices, capacity=4)
+        for _ in range(6):
+            sampler.sample()
+        window = sampler.window()
+        print_result("Chunks", [len(c) for c in window.chunks])
+        assert len(window) == 4 * len(devices)
+
+        newest = window.chunks[-1]
+        stamps = newest.column("timestamp")
+        print_result("Timestamp column", f"format={memoryview(stamps).format}")
+        ts = sampler.snapshot.buffer.timestamp
+        assert stamps[-1] == ts.tv_sec * 1000000000 + ts.tv_nsec
+        assert list(newest.column("device"))[-len(devices) :] == list(
+            range(len(devices))
+        )
+
+        # a failed read is null in both exports, not the value of the poll before
+        import pymtml_arrow
+
+        capsules = []  # the structs are released with their capsules
+
+        def exported(source, name):
+            schema, array = source.__arrow_c_array__()
+            capsules.extend((schema, array))
+            names = [c.name.decode() for c in schema_of(schema)]
+            capsule = pymtml_arrow._PyCapsule_GetPointer(array, b"arrow_array")
+            batch = pymtml_arrow.ArrowArray.from_address(capsule)
+            return names, batch.children[names.index(name)].contents
+
+        def schema_of(capsule):
+            address = pymtml_arrow._PyCapsule_GetPointer(capsule, b"arrow_schema")
+            schema = pymtml_arrow.ArrowSchema.from_address(address)
+            return [schema.children[i].contents for i in range(schema.n_children)]
+
+        first = mtmlGetDeviceRegistry().byHandle(devices[0])
+        mtmlFaultInject(
+            MtmlFault("mtmlGpuGetTemperature", first, code=MTML_ERROR_NOT_SUPPORTED)
+        )
+        try:
+            sampler.sample()
+        finally:
+            mtmlFaultClear()
+        newest = sampler.window(1).chunks[0]
+        assert newest.valid("temperature") == b"\x00" + b"\x01" * (len(devices) - 1)
+        assert newest.valid("gpuUtil") == b"\x01" * len(devices)
+        for source in (newest, sampler.snapshot):
+            names, temperature = exported(source, "temperature")
+            assert temperature.null_count == 1
+            bitmap = cast(temperature.buffers[0], POINTER(c_uint8))
+            assert not bitmap[0] & 1 and (len(devices) == 1 or bitmap[0] & 2)
+            assert not exported(source, "gpuUtil")[1].buffers[0]
+        # the snapshot batch carries its poll time like the ring does
+        names, stamps = exported(sampler.snapshot, "timestamp")
+        assert names[:2] == ["timestamp", "device"]
+        value = cast(stamps.buffers[1], POINTER(c_int64))[0]
+        ts = sampler.snapshot.buffer.timestamp
+        assert value == ts.tv_sec * 1000000000 + ts.tv_nsec
+        print_result("Failed reads", "exported as null")
+        del capsules[:]
+
+        # a raising listener neither stops the poll nor the listeners after it
+        def broken(sampler, snapshot):
+            raise ValueError("listener bug")
+
+        seen = []
+        sampler.addListener(broken)
+        sampler.addListener(lambda sampler, snapshot: seen.append(sampler.polls))
+        polls = sampler.polls
+        sampler.sample()
+        assert sampler.polls == polls + 1 and seen == [polls + 1]
+        assert sampler.listenerErrors == 1 and sampler.lastListenerError[0] is broken
+        sampler.close()
+
+    def test_prometheus_exporter(self, devices):
+        print_section("Prometheus Exporter")
+        import threading
+        import time
+        import urllib.request
+
+        from pymtml_exporter import CONTENT_TYPE, MtmlPrometheusExporter
+        from pymtml_sampler import MtmlSampler
+
+        sampler = MtmlSampler(devices=devices, capacity=4)
+        exporter = MtmlPrometheusExporter(
+            sampler, port=0, address="127.0.0.1", slowInterval=0.01
+        ).start()
+        sampler.sample()
+        lines = exporter.body.decode().splitlines()
+        families = sorted(
+            {
+                line.split("{")[0].split()[0]
+                for line in lines
+                if not line.startswith("#")
+            }
+        )
+        print_result("Series", len(lines))
+        print_result("Families", ", ".join(families))
+        assert "mtml_exporter_sample_timestamp_seconds 0.000" not in lines
+
+        # with every driver call hung, in the sampler and the slow refresh alike, scrapes
+        # are still answered at once from the body rendered by the last poll
+        body = exporter.body
+        fault = MtmlFault("*", hang=True)
+        mtmlFaultInject(fault)
+        poll = threading.Thread(target=sampler.sample, daemon=True)
+        try:
+            poll.start()
+            url = "http://127.0.0.1:%d/metrics" % exporter.port
+            for _ in range(3):
+                start = time.perf_counter()
+                with urllib.request.urlopen(url, timeout=5) as response:
+                    scraped = response.read()
+                    contentType = response.headers["Content-Type"]
+                elapsed = time.perf_counter() - start
+                assert scraped == body and contentType == CONTENT_TYPE
+                assert elapsed < 0.5, elapsed
+            assert poll.is_alive() and fault.injected
+            print_result("Scrape with hung driver", f"{elapsed * 1000:.1f} ms")
+        finally:
+            mtmlFaultClear()
+            poll.join()
+        exporter.close()
+        sampler.close()
+
+    def test_push_exporter(self, devices):
+        print_section("UDP Push Exporter")
+        import socket
+
+        from pymtml_exporter import MTML_EXPORTER_SNAPSHOT_METRICS, MtmlPushExporter
+        from pymtml_sampler import MtmlSampler
+
+        listener = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        listener.bind(("127.0.0.1", 0))
+        listener.settimeout(1.0)
+        port = listener.getsockname()[1]
+
+        for protocol in MtmlPushExporter.PROTOCOLS:
+            sampler = MtmlSampler(devices=devices, capacity=4)
+            exporter = MtmlPushExporter(
+                sampler, "127.0.0.1", port, protocol=protocol, mtu=512, fullRefresh=3
+            )
+            received = []
+            for _ in range(3):
+                sampler.sample()
+                sent = exporter.datagrams
+                for _ in range(sent - len(received)):
+                    received.append(listener.recv(65535))
+            sizes = [len(d) for d in received]
+            print_result(f"{protocol} datagrams", f"{len(received)} (bytes {sizes})")
+            assert all(size <= 512 for size in sizes)
+            print_result(f"{protocol} sample", received[0].split(b"\n")[0].decode())
+
+            # re-encoding an unchanged snapshot sends nothing until the next full refresh,
+            # which resends every value that was read successfully
+            snapshot = sampler.snapshot
+            exporter.ticks = 0
+            ticks = [exporter.encode(snapshot) for _ in range(4)]
+            counts = [len(t) for t in ticks]
+            print_result(f"{protocol} datagrams per tick", counts)
+            assert counts[0] and counts[1:3] == [0, 0] and ticks[3] == ticks[0]
+            readable = sum(
+                1
+                for metric, _, _ in MTML_EXPORTER_SNAPSHOT_METRICS
+                for dev in snapshot
+                if dev.status(metric) == MTML_SUCCESS
+            )
+            lines = b"\n".join(ticks[0]).split(b"\n")
+            if protocol == "statsd":
+                assert len(lines) == readable
+            else:
+                # measurement,tags fields timestamp; tag values escape their spaces
+                fields = [line.rsplit(b" ", 2)[1] for line in lines]
+                assert sum(len(f.split(b",")) for f in fields) == readable
+            exporter.close()
+            sampler.close()
+        listener.close()
+
+    def test_smi_query_plan(self, devices):
+        print_section("mtml-smi Query Plan")
+        from pymtml_smi import MtmlQueryPlan
+
+        registry = mtmlGetDeviceRegistry()
+        fields = ["index", "uuid", "utilization.gpu", "memory.used", "fan.speed"]
+        plan = MtmlQueryPlan(fields, [registry.byHandle(d) for d in devices])
+        print_result("Header", ", ".join(plan.header()))
+        for _ in range(2):
+            rows = plan.collect()
+        for row in rows:
+            print_result("Row", ", ".join(row))
+        assert len(rows) == len(devices) and all(len(r) == len(fields) for r in rows)
+        plan.close()
+
+        # -i takes indexes, UUIDs and PCI bus ids with or without the domain
+        from pymtml_smi import _selectDevices
+
+        last = registry.byHandle(devices[-1])
+        shortBusId = last.sbdf.split(":", 1)[1]
+        for ids in (str(last.index), last.uuid, last.sbdf, shortBusId):
+            assert _selectDevices(ids) == [last], ids
+        for ids in ("%d" % len(registry.devices), "GPU-missing", "ff:1f.7"):
+            try:
+                _selectDevices(ids)
+                raise AssertionError("selected a missing device: %s" % ids)
+            except ValueError:
+                pass
+        print_result("Selected by bus id", shortBusId)
+
+    def test_smi_dmon(self, devices):
+        print_section("mtml-smi dmon")
+        import contextlib
+        import io
+        import threading
+
+        from pymtml_sampler import MtmlSampler
+        from pymtml_smi import MtmlDeviceMonitor, _dmonParser, dmon
+
+        out = io.StringIO()
+        with contextlib.redirect_stdout(out):
+            assert (
+                dmon(_dmonParser().parse_args(["-s", "pucm", "-d", "0.02", "-c", "3"]))
+                == 0
+            )
+        lines = out.getvalue().splitlines()
+        print_result("Header", lines[0])
+        assert lines[0].split()[:3] == ["#gpu", "pwr", "gtemp"]
+        assert len(lines) == 2 + 3 * len(mtmlGetDeviceRegistry().devices)
+
+        class Broken(object):
+            def write(self, text):
+                raise RuntimeError("broken stdout")
+
+        # a failing listener stops the monitor instead of killing the sampler thread
+        registry = mtmlGetDeviceRegistry()
+        entries = [registry.byHandle(d) for d in devices]
+        sampler = MtmlSampler(interval=0.02, devices=devices, capacity=2)
+        monitor = MtmlDeviceMonitor(sampler, entries, stdout=Broken())
+        sampler.addListener(monitor._onSample)
+        with sampler:
+            monitor.wait()
+            assert isinstance(monitor.error, RuntimeError) and sampler.running
+        monitor.close()
+
+        # a sampler thread that dies ends the wait too
+        def die():
+            raise ValueError("poll failed")
+
+        hook, threading.excepthook = threading.excepthook, lambda args: None
+        sampler = MtmlSampler(interval=0.02, devices=devices, capacity=2)
+        monitor = MtmlDeviceMonitor(sampler, entries, stdout=io.StringIO())
+        sampler.sample = die
+        try:
+            with sampler:
+                monitor.wait()
+        finally:
+            threading.excepthook = hook
+        assert monitor.error is not None
+        monitor.close()
+        print_result("Failures", "stop the monitor")
+
+    def test_topology_matrix(self, devices):
+        print_section("Topology Matrix")
+        import os
+        import tempfile
+
+        from pymtml_topology import mtmlTopologyDiscover, mtmlTopologyGet
+
+        registry = mtmlGetDeviceRegistry()
+        entries = [registry.byHandle(d) for d in devices]
+        cacheDir = tempfile.mkdtemp()
+        topology = mtmlTopologyGet(entries, cacheDir=cacheDir)
+        print(topology.matrix())
+        # the second call is served from the cache file and matches a fresh discovery
+        cached = mtmlTopologyGet(entries, cacheDir=cacheDir)
+        assert cached.toDict() == mtmlTopologyDiscover(entries).toDict()
+        print_result("Cache files", os.listdir(cacheDir))
+        # rows and columns carry device indexes, also for a subset
+        subset = mtmlTopologyGet(entries[1:], cacheDir=False)
+        assert subset.labels() == ["GPU%d" % d.index for d in entries[1:]]
+        assert subset.p2pMatrix().split("\n")[0].split() == subset.labels()
+
+    def test_affinity_pinning(self, devices):
+        print_section("Affinity Pinning")
+        import os
+        import threading
+
+        from pymtml_affinity import (
+            mtmlAffinityCpuSlice,
+            mtmlAffinityGet,
+            mtmlAffinityPin,
+        )
+
+        registry = mtmlGetDeviceRegistry()
+        entries = [registry.byHandle(d) for d in devices]
+        for device in entries:
+            print_result(f"Device {device.index}", mtmlAffinityGet(device))
+        # devices sharing a CPU set split it into disjoint slices covering it, or all get
+        # the whole set when it has fewer CPUs than workers
+        allowed = os.sched_getaffinity(0)
+        groups = {}
+        for device in entries:
+            groups.setdefault(mtmlAffinityGet(device).cpus, []).append(device)
+        for own, group in groups.items():
+            cpus = tuple(c for c in own if c in allowed)
+            slices = [
+                mtmlAffinityCpuSlice(d, workers=2, worker=w, devices=entries)
+                for d in group
+                for w in (0, 1)
+            ]
+            if len(cpus) < len(slices):
+                assert all(s == cpus for s in slices)
+            else:
+                taken = sorted(c for s in slices for c in s)
+                assert taken == sorted(cpus)
+
+        pinned = []
+
+        def pin():
+            before = mtmlAffinityCpuSlice(entries[0], workers=2, worker=1)
+            cpus = mtmlAffinityPin(entries[0], workers=2, worker=0)
+            # the split does not depend on the pinned thread's narrowed mask
+            after = mtmlAffinityCpuSlice(entries[0], workers=2, worker=1)
+            pinned.append((cpus, os.sched_getaffinity(0), before == after))
+
+        thread = threading.Thread(target=pin)
+        thread.start()
+        thread.join()
+        cpus, affinity, stable = pinned[0]
+        print_result("Pinned to", cpus or "(no affinity reported)")
+        assert not cpus or set(cpus) == affinity
+        assert stable
+
+    def test_bandwidth_model(self, devices):
+        print_section("Bandwidth Model")
+        from pymtml_bandwidth import mtmlBandwidthModelGet
+
+        model = mtmlBandwidthModelGet()
+        for a in devices:
+            for b in devices:
+                e = model.estimate(a, b)
+                if e is not None:
+                    print_result(f"{model.slot(a)} -> {model.slot(b)}", e)
+                    assert e.bidirectional >= e.unidirectional >= 0
+        assert mtmlBandwidthModelGet() is model
+
+    def test_collective_orders(self, devices):
+        print_section("Collective Orders")
+        from pymtml_collective import mtmlCollectiveRing, mtmlCollectiveTree
+
+        ring = mtmlCollectiveRing(devices)
+        tree = mtmlCollectiveTree(devices)
+        for plan in (ring, tree):
+            print_result(plan.kind, plan)
+            print_result(
+                "Estimated GB/s",
+                ", ".join(f"{k} {v:.1f}" for k, v in plan.estimates.items()),
+            )
+            assert sorted(plan.order) == sorted(
+                mtmlGetDeviceRegistry().byHandle(d).index for d in devices
+            )
+        assert all(p < k for k, p in enumerate(tree.parents) if p >= 0)
+
+    def test_mpc_planner(self, devices):
+        print_section("MPC Planner")
+        import pymtml
+        from pymtml_mpc import (
+            MtmlMpcDemand,
+            MtmlMpcPlan,
+            MtmlMpcVerifyError,
+            mtmlMpcCatalogGet,
+            mtmlMpcPlan,
+        )
+
+        registry = mtmlGetDeviceRegistry()
+        devices = [registry.byHandle(d) for d in devices]
+        try:
+            catalog = mtmlMpcCatalogGet(devices[0])
+        except MTMLError as e:
+            print_result("MPC Catalog", f"Not supported ({e})")
+            return
+        if not catalog.profiles:
+            print_result("MPC Catalog", "No MPC profiles")
+            return
+        smallest = min(catalog.profiles.values(), key=lambda p: (p[1], p[2]))
+        plan = mtmlMpcPlan([MtmlMpcDemand(smallest[1], smallest[2], count=2)], devices)
+        print_result("Plan", plan)
+        assert plan.complete and len(plan.assignments) == 2
+        assert 0.0 <= plan.fragmentation <= 1.0
+        # verify the current configurations without reconfiguring anything
+        current = MtmlMpcPlan(devices, plan.current, plan.current, [], [], 0.0)
+        assert not current.changes
+        current.apply()
+        if not plan.changes:
+            return
+
+        class Batch(object):
+            """Stand-in library recording batch calls instead of applying them."""
+
+            def __init__(self, library):
+                self.library = library
+                self.calls = []
+
+            def __getattr__(self, name):
+                return getattr(self.library, name)
+
+            def mtmlLibrarySetMpcConfigurationInBatch(self, lib, count, handles, ids):
+                self.calls.append(
+                    [
+                        (cast(handles[i], c_void_p).value, ids[i])
+                        for i in range(count.value)
+                    ]
+                )
+                return MTML_SUCCESS
+
+        # every change goes out in one batch call, as (handle, configuration id) pairs
+        library = pymtml.mtmlLib
+        batch = Batch(library)
+        planned = [(registry.byUuid(uuid).address, id) for uuid, id in plan.changes]
+        mtmlUseLibrary(batch)
+        try:
+            plan.apply(verify=False)
+            print_result("Batch calls", batch.calls)
+            assert batch.calls == [planned]
+            # the devices were left as they are, which verification must catch
+            try:
+                plan.apply()
+            except MtmlMpcVerifyError as e:
+                assert set(e.mismatches) == {uuid for uuid, _ in plan.changes}
+            else:
+                raise AssertionError("unapplied plan passed verification")
+        finally:
+            mtmlUseLibrary(library)
+
+    def test_mpc_inventory(self, devices):
+        print_section("MPC Inventory")
+        from pymtml_mpc import MtmlMpcInventory
+
+        registry = mtmlGetDeviceRegistry()
+        try:
+            inventory = MtmlMpcInventory([registry.byHandle(d) for d in devices])
+        except MTMLError as e:
+            print_result("MPC Inventory", f"Not supported ({e})")
+            return
+        for parent in inventory.parents:
+            instances = inventory.instances[parent.uuid]
+            print_result(parent.uuid, [i.profileName for i in instances])
+            assert len(instances) == mtmlDeviceCountMpcInstances(parent.handle)
+        # unchanged configurations cost one call per parent and reread nothing
+        generation = inventory.generation
+        assert not inventory.refresh() and inventory.generation == generation
+        # a parent without MPC support is unpartitioned, not an error for the others
+        first = registry.byHandle(devices[0])
+        mtmlFaultInject(
+            MtmlFault(
+                "mtmlDeviceGetMpcConfiguration", first, code=MTML_ERROR_NOT_SUPPORTED
+            )
+        )
+        try:
+            partial = MtmlMpcInventory([registry.byHandle(d) for d in devices])
+        finally:
+            mtmlFaultClear()
+        assert partial.instances[first.uuid] == []
+        assert partial.configuration(first) is None
+        assert all(
+            len(partial.instances[p.uuid]) == len(inventory.instances[p.uuid])
+            for p in partial.parents[1:]
+        )
+        handles = inventory.handles
+        if not handles:
+            return
+        snapshot = MtmlSnapshot(handles)
+        try:
+            mtmlPollInto(snapshot)
+            totals = inventory.rollup(snapshot)
+            for uuid in totals:
+                print_result(f"{uuid} memoryUsed", totals[uuid]["memoryUsed"])
+            # instances report their board's power, so the parent's is not multiplied
+            for parent in inventory.parents:
+                slots = [
+                    k
+                    for k, h in enumerate(handles)
+                    if any(h is i.handle for i in inventory.instances[parent.uuid])
+                ]
+                if slots and all(
+                    snapshot[k].status("powerUsage") == MTML_SUCCESS for k in slots
+                ):
+                    power = totals[parent.uuid]["powerUsage"]
+                    assert power == max(snapshot[k].powerUsage for k in slots)
+        finally:
+            snapshot.close()
+
+    def test_virt_inventory(self, devices):
+        print_section("vGPU Inventory")
+        import pymtml_virt
+        from pymtml_virt import mtmlVirtInventoryGet
+
+        registry = mtmlGetDeviceRegistry()
+        inventory = mtmlVirtInventoryGet([registry.byHandle(d) for d in devices])
+        for uuid, state in inventory.devices.items():
+            print_result(uuid, state)
+            if state.types:
+                count = mtmlDeviceCountActiveVirtDevices(state.device.handle)
+                assert len(state.active) == count
+        # against an empty inventory every active device is new; against itself none is
+        everything = inventory.diff(None)
+        assert sorted(everything.added) == sorted(inventory.owners.items())
+        assert not everything.removed and not inventory.diff(inventory)
+        # a failed read leaves the device unknown rather than empty, and caches nothing
+        first = registry.byHandle(devices[0])
+        mtmlFaultInject(
+            MtmlFault(
+                "mtmlDeviceCountActiveVirtDevices", first, code=MTML_ERROR_TIMEOUT
+            ),
+            MtmlFault(
+                "mtmlDeviceCountSupportedVirtTypes", first, code=MTML_ERROR_TIMEOUT
+            ),
+        )
+        try:
+            failed = mtmlVirtInventoryGet([registry.byHandle(d) for d in devices])
+        finally:
+            mtmlFaultClear()
+        state = failed.devices[first.uuid]
+        assert not state.known and state.error == MTML_ERROR_TIMEOUT
+        assert not failed.diff(inventory) and not inventory.diff(failed)
+        assert mtmlVirtInventoryGet([first]).devices[first.uuid].known
+        # repeated reads fill the same per-device UUID buffer instead of allocating one
+        buffers = dict(pymtml_virt._mtmlVirtUuidBuffers)
+        again = mtmlVirtInventoryGet([registry.byHandle(d) for d in devices])
+        assert again.owners == inventory.owners
+        for uuid, buffer in buffers.items():
+            assert pymtml_virt._mtmlVirtUuidBuffers[uuid] is buffer
+        assert len(buffers) == len({uuid for uuid in inventory.owners.values()})
+
+    def test_placement_engine(self, devices):
+        print_section("Placement Engine")
+        from pymtml_mpc import (
+            MtmlMpcCatalog,
+            MtmlMpcInstance,
+            MtmlMpcInventory,
+            mtmlMpcCatalogGet,
+        )
+        from pymtml_placement import (
+            MtmlPlacementBin,
+            MtmlPlacementRequest,
+            _freeConfigurations,
+            mtmlPlacementBins,
+            mtmlPlacementSolve,
+        )
+
+        registry = mtmlGetDeviceRegistry()
+        bins = mtmlPlacementBins([registry.byHandle(d) for d in devices], node="local")
+        # bins survive an export, as they would when shipped from another node
+        assert [b.toDict() for b in bins] == [
+            MtmlPlacementBin.fromDict(b.toDict()).toDict() for b in bins
+        ]
+        # the vGPU framebuffer never exceeds what the driver reports free
+        for bin, device in zip(bins, devices):
+            if bin.vgpuTypes:
+                memory = mtmlDeviceInitMemory(device)
+                free = mtmlMemoryGetTotal(memory) - mtmlMemoryGetUsed(memory)
+                mtmlDeviceFreeMemory(memory)
+                assert bin.framebufferMB <= free >> 20
+        # live MPC instances are subtracted: only configurations holding their profiles
+        # remain, less those instances
+        for bin, device in zip(bins, devices):
+            entry = registry.byHandle(device)
+            if bin.mpcProfiles:
+                live = MtmlMpcInventory([entry]).instances[entry.uuid]
+                assert bin.mpcConfigurations == _freeConfigurations(
+                    mtmlMpcCatalogGet(entry), live
+                )
+        configurations = {1: ("a", (1, 1, 1, 1)), 2: ("b", (2, 2)), 3: ("c", (2, 1, 1))}
+        catalog = MtmlMpcCatalog("GPU-x", 8, 96, {}, configurations)
+        one = MtmlMpcInstance.__new__(MtmlMpcInstance)
+        one.profileId = 1
+        assert _freeConfigurations(catalog, []) == {
+            c: ids for c, (_, ids) in catalog.configurations.items()
+        }
+        assert _freeConfigurations(catalog, [one]) == {1: (1, 1, 1), 3: (2, 1)}
+        assert _freeConfigurations(catalog, [one] * 4) == {}
+
+        requests = []
+        vgpuTypes = sorted({t for b in bins for t in b.vgpuTypes})
+        mpcProfiles = sorted({p for b in bins for p in b.mpcProfiles})
+        if vgpuTypes:
+            requests.append(MtmlPlacementRequest("vgpu", vgpuTypes[0], 2, group="g"))
+        if mpcProfiles:
+            requests.append(MtmlPlacementRequest("mpc", mpcProfiles[0], 2))
+        if not requests:
+            print_result("Placement", "No vGPU types or MPC profiles")
+            return
+        heuristic = mtmlPlacementSolve(requests, bins, mode="heuristic")
+        exact = mtmlPlacementSolve(requests, bins, mode="exact")
+        print_result("Heuristic", heuristic)
+        print_result("Exact", exact)
+        assert exact.exact
+        assert len(exact.unplaced) <= len(heuristic.unplaced)
+        assert 0.0 <= heuristic.fragmentation <= 1.0
+
+    def test_fault_injection(self, devices):
+        print_section("Fault Injection")
+        import time
+
+        snapshot = MtmlSnapshot(devices)
+        try:
+            mtmlPollInto(snapshot)
+            healthy = snapshot[0].status("gpuUtil")
+            # pointers the snapshot bound before the faults were installed are rebound
+            mtmlFaultInject(
+                MtmlFault(
+                    "mtmlGpuGetUtilization", device=devices[0], code=MTML_ERROR_TIMEOUT
+                ),
+                MtmlFault("mtmlDeviceGetPowerUsage", latency=0.02, limit=1),
+            )
+            mtmlPollInto(snapshot)
+            assert snapshot[0].status("gpuUtil") == MTML_ERROR_TIMEOUT
+            if len(devices) > 1:
+                assert snapshot[1].status("gpuUtil") != MTML_ERROR_TIMEOUT
+            try:
+                mtmlGpuGetUtilization(devices[0])
+                raise AssertionError("fault not injected")
+            except MTMLError as e:
+                assert e.value == MTML_ERROR_TIMEOUT
+            print_result("Injected", "MTML_ERROR_TIMEOUT on device 0")
+            mtmlFaultInject(MtmlFault("mtmlDeviceGetName", latency=0.02))
+            start = time.perf_counter()
+            test_error("mtmlDeviceGetName", lambda: mtmlDeviceGetName(devices[0]))
+            assert time.perf_counter() - start >= 0.02
+        finally:
+            mtmlFaultClear()
+        mtmlPollInto(snapshot)
+        assert snapshot[0].status("gpuUtil") == healthy
+        snapshot.close()
+
+    def test_watchdog_quarantine(self, devices):
+        print_section("Call Watchdog")
+        import time
+
+        snapshot = MtmlSnapshot(devices)
+        mtmlWatchdogEnable(timeout=0.05, backoff=0.2)
+        stuck = None
+        try:
+            mtmlPollInto(snapshot)
+            memoryUsed = snapshot[0].memoryUsed
+            mtmlFaultInject(
+                MtmlFault("mtmlGpuGetUtilization", device=devices[0], hang=True)
+            )
+            start = time.perf_counter()
+            mtmlPollInto(snapshot)
+            assert time.perf_counter() - start < 0.5
+            assert snapshot[0].status("gpuUtil") == MTML_ERROR_TIMEOUT
+            if len(devices) > 1:
+                assert snapshot[1].status("gpuUtil") != MTML_ERROR_TIMEOUT
+            (state,) = [s for s in mtmlWatchdogStates().values() if s.quarantined]
+            stuck = state.stuck
+            assert state.timeouts == 1
+            # a quarantined device fails fast, without waiting for another deadline
+            start = time.perf_counter()
+            try:
+                mtmlDeviceGetName(devices[0])
+                raise AssertionError("quarantined call ran")
+            except MTMLError as e:
+                assert e.value == MTML_ERROR_TIMEOUT
+            assert time.perf_counter() - start < 0.05
+            # staying quarantined behind a hung call is not another timeout
+            time.sleep(0.25)
+            mtmlPollInto(snapshot)
+            assert state.quarantined and state.timeouts == 1
+            print_result("Quarantined", state)
+        finally:
+            mtmlFaultClear()
+            mtmlWatchdogDisable()
+        # the released job wrote its private scratch, not the snapshot
+        assert stuck is not None and stuck.done.wait(1.0)
+        assert snapshot[0].status("gpuUtil") == MTML_ERROR_TIMEOUT
+        assert snapshot[0].memoryUsed == memoryUsed
+        mtmlPollInto(snapshot)
+        assert snapshot[0].status("gpuUtil") != MTML_ERROR_TIMEOUT
+        snapshot.close()
+        # a slow library call runs inline past the deadline and quarantines nothing
+        mtmlWatchdogEnable(timeout=0.05, backoff=0.2)
+        try:
+            mtmlFaultInject(MtmlFault("mtmlLibraryCountDevice", latency=0.1))
+            assert mtmlLibraryCountDevice() == len(devices)
+            mtmlFaultClear()
+            assert not mtmlWatchdogStates()
+            mtmlLibraryInitDeviceByIndex(0)
+        finally:
+            mtmlFaultClear()
+            mtmlWatchdogDisable()
+
+    def test_static_snapshot(self):
+        print_section("Static Snapshot")
+        import glob
+        import json
+        import os
+        import tempfile
+
+        from pymtml_topology import mtmlGetStaticSnapshot, mtmlStaticInit
+
+        def restart(*faults, **kwargs):
+            for fault in faults:
+                mtmlFaultInject(fault)
+            try:
+                snapshot = mtmlStaticInit(cacheDir=cacheDir, **kwargs)
+                snapshot.revalidation.join()
+            finally:
+                mtmlFaultClear()
+            return snapshot
+
+        def relink(slot):
+            # as if the file was written while device `slot` had other MtLink states
+            with open(path) as f:
+                data = json.load(f)
+            data["devices"][slot]["mtlinkStates"] = ["stale"]
+            with open(path, "w") as f:
+                json.dump(data, f)
+
+        cacheDir = tempfile.mkdtemp()
+        discovered = mtmlStaticInit(cacheDir=cacheDir)
+        assert discovered.revalidation is None
+        (path,) = glob.glob(os.path.join(cacheDir, "static-*.json"))
+        n = len(discovered.devices)
+        # a restart with the same driver, library and links loads the file and rediscovers
+        # no pair at all
+        pairCalls = MtmlFault("mtmlDeviceGetTopologyLevel")
+        loaded = restart(pairCalls)
+        assert loaded.toDict() == discovered.toDict() and pairCalls.injected == 0
+        assert mtmlGetStaticSnapshot() is loaded
+        # changed links on one device rediscover its attributes and its 2(n - 1) pairs only
+        relink(n - 1)
+        changes = []
+        pairCalls = MtmlFault("mtmlDeviceGetTopologyLevel")
+        relinked = restart(pairCalls, onChange=changes.append)
+        print_result("Pairs rediscovered for one device", pairCalls.injected)
+        assert pairCalls.injected == 2 * (n - 1)
+        assert changes and mtmlGetStaticSnapshot() is changes[0]
+        assert changes[0].toDict() == discovered.toDict()
+        assert mtmlStaticInit(cacheDir=cacheDir, revalidate=False).toDict() == (
+            discovered.toDict()
+        )
+        # a call failing during revalidation neither rewrites the file nor installs the result
+        relink(0)
+        kept = restart(
+            MtmlFault("mtmlDeviceGetSerialNumber", code=MTML_ERROR_TIMEOUT)
+        )
+        assert mtmlGetStaticSnapshot() is kept and relinked is not kept
+        with open(path) as f:
+            assert json.load(f)["devices"][0]["mtlinkStates"] == ["stale"]
+        for attributes in loaded.devices:
+            print_result(attributes["uuid"], attributes["name"])
+
     def test_nvml_wrapper_apis(self, device, device_idx):
         print_section(f"Device {device_idx} - NVML Wrapper APIs")
 
@@ -358,6 +1166,24 @@ class MtmlTestSuite:
             self.test_nvml_wrapper_apis(device, i)
 
         # Multi-device tests
+        self.test_device_registry(devices)
+        self.test_snapshot_polling(devices)
+        self.test_sampler_export(devices)
+        self.test_prometheus_exporter(devices)
+        self.test_push_exporter(devices)
+        self.test_smi_query_plan(devices)
+        self.test_smi_dmon(devices)
+        self.test_topology_matrix(devices)
+        self.test_static_snapshot()
+        self.test_affinity_pinning(devices)
+        self.test_bandwidth_model(devices)
+        self.test_collective_orders(devices)
+        self.test_mpc_planner(devices)
+        self.test_mpc_inventory(devices)
+        self.test_virt_inventory(devices)
+        self.test_placement_engine(devices)
+        self.test_fault_injection(devices)
+        self.test_watchdog_quarantine(devices)
         self.test_topology_apis(devices)
 
         # Note: Don't free devices here - they will be freed when library shuts down
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""
+Tests for pymtml_rollup.py rollup tiers
+Feeds synthetic polls (no device needed) and checks each tier against aggregates computed
+from the raw samples.
+Run with: python test_rollup.py
+"""
+
+import sys
+
+from pymtml_rollup import MtmlRollup
+
+DEVICES = ["GPU-test-0", "GPU-test-1"]
+TIERS = ((1, 120), (10, 30), (60, 5))
+START_NS = 1700000000 * 1000000000
+STEP_NS = 100000000  # 10 Hz
+POLLS = 1800  # 3 minutes
+
+
+def print_section(title):
+    print(f"\n{'='*60}")
+    print(f" {title}")
+    print(f"{'='*60}")
+
+
+def print_result(name, value, indent=2):
+    prefix = " " * indent
+    print(f"{prefix}{name}: {value}")
+
+
+def synthetic_value(poll, device):
+    return (poll * 13 + device * 5) % 97
+
+
+def expected_buckets(resolution, device, polls):
+    buckets = {}
+    for poll in range(polls):
+        timestamp = START_NS + poll * STEP_NS
+        key = timestamp // (resolution * 1000000000) * resolution * 1000000000
+        buckets.setdefault(key, []).append(synthetic_value(poll, device))
+    return buckets
+
+
+def test_rollup_tiers():
+    print_section("Rollup Tiers")
+    rollup = MtmlRollup(tiers=TIERS, metrics=["gpuUtil"], devices=DEVICES)
+    for poll in range(POLLS):
+        values = [synthetic_value(poll, d) for d in range(len(DEVICES))]
+        if poll % 50 == 7:
+            values[1] = None  # failed read
+        rollup.record(START_NS + poll * STEP_NS, {"gpuUtil": values})
+
+    for resolution, retention in TIERS:
+        series = rollup.series(resolution, "gpuUtil", "GPU-test-0")
+        expected = expected_buckets(resolution, 0, POLLS)
+        print_result(f"{resolution:4d}s tier", f"{len(series['timestamp'])} buckets")
+        assert len(series["timestamp"]) <= retention
+        for i, timestamp in enumerate(series["timestamp"]):
+            values = expected[timestamp]
+            if i == len(series["timestamp"]) - 1 and resolution != TIERS[0][0]:
+                # coarser tiers only see closed buckets of the tier below
+                assert series["count"][i] <= len(values)
+                continue
+            assert series["count"][i] == len(values), (resolution, timestamp)
+            assert series["min"][i] == min(values)
+            assert series["max"][i] == max(values)
+            assert abs(series["mean"][i] - sum(values) / len(values)) < 1e-9
+            assert series["last"][i] == values[-1]
+
+    # failed reads are not counted
+    series = rollup.series(1, "gpuUtil", 1)
+    assert sum(series["count"]) == sum(
+        1 for p in range(POLLS - 1200, POLLS) if p % 50 != 7
+    )
+    print_result("Failed reads skipped", "OK")
+
+    # a range query returns only the buckets overlapping it
+    start = START_NS + 30 * 1000000000
+    series = rollup.series(10, "gpuUtil", 0, start=start, end=start + 19 * 1000000000)
+    assert list(series["timestamp"]) == [start, start + 10 * 1000000000]
+    print_result("Range query", "OK")
+
+
+def test_rollup_gaps():
+    print_section("Rollup Gaps")
+    # a pause of exactly one retention reuses the closed bucket's ring slot, and a retention
+    # of one always does: the closed bucket must reach the coarser tier before it is cleared
+    for tiers, seconds, expected in (
+        (((1, 4), (8, 4)), (0, 0, 0, 4, 5), 4),
+        (((1, 1), (2, 3)), (0, 0, 1, 1, 1, 2), 5),
+        # the middle tier's retention of one: its bucket 0 reaches the top when 1 opens
+        (((1, 2), (2, 1), (4, 2)), (0, 0, 1, 2, 4), 3),
+    ):
+        rollup = MtmlRollup(tiers=tiers, metrics=["gpuUtil"], devices=DEVICES[:1])
+        for second in seconds:
+            rollup.record(START_NS + second * 1000000000, {"gpuUtil": [second]})
+        coarsest = tiers[-1][0]
+        series = rollup.series(coarsest, "gpuUtil", 0)
+        width = coarsest * 1000000000
+        assert list(series["count"]) == [expected], (tiers, list(series["count"]))
+        assert series["timestamp"][0] == START_NS // width * width
+    print_result("Closed buckets kept across gaps", "OK")
+
+
+def main():
+    try:
+        test_rollup_tiers()
+        test_rollup_gaps()
+    except AssertionError as e:
+        print(f"\nAssertion Error: {e}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,7 +8,9 @@ This test uses 'import pymtml as pynvml' to simulate how sglang would use NVML A
 Run with: python test_sglang_compat.py
 """
 
+import ctypes
 import sys
+import time
 import traceback
 
 import pymtml as pynvml
@@ -268,6 +270,78 @@ def test_sglang_nvlink_full_connection(physical_device_ids, logger=None):
     return True
 
 
+class _LinksDown(object):
+    """Stand-in library that reports every MtLink of one device as down."""
+
+    def __init__(self, library, device):
+        self.library = library
+        self.address = ctypes.cast(device, ctypes.c_void_p).value
+
+    def __getattr__(self, name):
+        return getattr(self.library, name)
+
+    def mtmlDeviceGetMtLinkState(self, device, link, state):
+        ret = self.library.mtmlDeviceGetMtLinkState(device, link, state)
+        if ctypes.cast(device, ctypes.c_void_p).value == self.address:
+            state._obj.value = pynvml.MTML_MTLINK_STATE_DOWN
+        return ret
+
+
+def test_full_mtlink_matches_sglang(physical_device_ids=None):
+    """
+    mtmlIsFullMtLink must agree with the pairwise sglang check for every prefix, answer from
+    the cached adjacency in microseconds, and notice a link going down. Without arguments it
+    initializes the library itself and checks every device.
+    """
+    print_section("mtmlIsFullMtLink vs sglang Check")
+    standalone = physical_device_ids is None
+    if standalone:
+        pynvml.nvmlInit()
+    try:
+        if standalone:
+            physical_device_ids = list(range(pynvml.nvmlDeviceGetCount()))
+        for n in range(2, len(physical_device_ids) + 1):
+            ids = physical_device_ids[:n]
+            expected = test_sglang_nvlink_full_connection(ids)
+            assert pynvml.mtmlIsFullMtLink(ids) == expected, f"mismatch for {ids}"
+        print_result("Agreement", "OK")
+
+        calls = 1000
+        start = time.perf_counter()
+        for _ in range(calls):
+            pynvml.mtmlIsFullMtLink(physical_device_ids)
+        perCall = (time.perf_counter() - start) / calls * 1e6
+        print_result("Cached check", f"{perCall:.1f} us")
+        assert perCall < 100, f"mtmlIsFullMtLink took {perCall:.1f} us"
+
+        # a link going down drops the adjacency once the revalidation period has passed,
+        # even though nothing else reads the link state
+        before = pynvml.mtmlGetMtLinkAdjacency()
+        if not physical_device_ids or not before.peers[0]:
+            print_result("Invalidation", "skipped (no MtLink up on device 0)")
+            return
+        library = pynvml.mtmlLib
+        period = pynvml.MTML_MTLINK_REVALIDATE_SECONDS
+        pynvml.MTML_MTLINK_REVALIDATE_SECONDS = 0.05
+        pynvml.mtmlMtLinkInvalidate()
+        before = pynvml.mtmlGetMtLinkAdjacency()
+        device = pynvml.mtmlGetDeviceRegistry().byIndex(0).handle
+        pynvml.mtmlUseLibrary(_LinksDown(library, device))
+        try:
+            assert pynvml.mtmlGetMtLinkAdjacency() is before
+            time.sleep(0.1)
+            after = pynvml.mtmlGetMtLinkAdjacency()
+            assert after is not before and not after.peers[0]
+        finally:
+            pynvml.mtmlUseLibrary(library)
+            pynvml.MTML_MTLINK_REVALIDATE_SECONDS = period
+            pynvml.mtmlMtLinkInvalidate()
+        print_result("Invalidation", "OK")
+    finally:
+        if standalone:
+            pynvml.nvmlShutdown()
+
+
 def main():
     print("\n" + "=" * 60)
     print(" MTML sglang Compatibility Test Suite")
@@ -307,6 +381,7 @@ def main():
         # This uses the device indices [0, 1, 2, ...] as physical_device_ids
         physical_device_ids = list(range(device_count))
         test_sglang_nvlink_full_connection(physical_device_ids)
+        test_full_mtlink_matches_sglang(physical_device_ids)
 
         print_section("Test Complete")
         print("\n  All sglang compatibility tests passed!")
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Tests for pymtml_sketch.py quantile sketches
+Checks the relative error bound, merging across devices and windows and the bucket cap on
+synthetic data (no device needed).
+Run with: python test_sketch.py
+"""
+
+import random
+import sys
+
+from pymtml_sketch import MtmlDDSketch, MtmlSketchSet
+
+ACCURACY = 0.01
+QUANTILES = (0.01, 0.25, 0.5, 0.9, 0.99, 0.999)
+
+
+def print_section(title):
+    print(f"\n{'='*60}")
+    print(f" {title}")
+    print(f"{'='*60}")
+
+
+def print_result(name, value, indent=2):
+    prefix = " " * indent
+    print(f"{prefix}{name}: {value}")
+
+
+def exact_quantile(values, q):
+    ordered = sorted(values)
+    return ordered[int(q * (len(ordered) - 1))]
+
+
+def check_accuracy(sketch, values):
+    for q in QUANTILES:
+        expected = exact_quantile(values, q)
+        got = sketch.quantile(q)
+        assert abs(got - expected) <= ACCURACY * abs(expected) + 1e-9, (
+            q,
+            got,
+            expected,
+        )
+
+
+def test_sketch_accuracy():
+    print_section("Sketch Accuracy")
+    rng = random.Random(1)
+    for name, values in (
+        ("utilization", [rng.randint(0, 100) for _ in range(20000)]),
+        ("power (lognormal)", [rng.lognormvariate(5, 1) for _ in range(20000)]),
+        ("signed", [rng.gauss(0, 30) for _ in range(20000)]),
+    ):
+        sketch = MtmlDDSketch(ACCURACY)
+        for v in values:
+            sketch.add(v)
+        check_accuracy(sketch, values)
+        buckets = len(sketch._positive.counts) + len(sketch._negative.counts)
+        print_result(f"{name:18s}", f"OK ({buckets} buckets for {len(values)} values)")
+
+
+def test_sketch_merge():
+    print_section("Sketch Merge")
+    rng = random.Random(2)
+    parts = [[rng.expovariate(0.05) for _ in range(5000)] for _ in range(4)]
+    merged = MtmlDDSketch(ACCURACY)
+    for part in parts:
+        sketch = MtmlDDSketch(ACCURACY)
+        for v in part:
+            sketch.add(v)
+        merged.merge(sketch)
+    check_accuracy(merged, [v for part in parts for v in part])
+    print_result("Merged quantiles", "OK")
+
+    # a sketch set merges across devices and windows
+    sketches = MtmlSketchSet(
+        metrics=["gpuUtil"], window=1, windows=10, devices=["GPU-a", "GPU-b"]
+    )
+    all_values = []
+    for poll in range(100):  # 10 s at 10 Hz
+        values = [rng.randint(0, 100), rng.randint(0, 100)]
+        all_values.extend(values)
+        sketches.record(poll * 100000000, {"gpuUtil": values})
+    assert sketches.merged("gpuUtil").count == 200
+    assert sketches.merged("gpuUtil", devices=["GPU-b"], end=999999999).count == 10
+    check_accuracy(sketches.merged("gpuUtil"), all_values)
+    print_result("Sketch set", "OK")
+
+
+def test_sketch_bucket_cap():
+    print_section("Sketch Bucket Cap")
+    sketch = MtmlDDSketch(ACCURACY, maxBuckets=64)
+    values = [1.5**i for i in range(200)]  # spans far more than 64 buckets
+    for v in values:
+        sketch.add(v)
+    assert len(sketch._positive.counts) <= 64
+    # the highest quantiles keep their accuracy, only the lowest buckets collapse
+    expected = exact_quantile(values, 0.99)
+    assert abs(sketch.quantile(0.99) - expected) <= ACCURACY * expected
+    print_result("Buckets", len(sketch._positive.counts))
+
+
+def main():
+    try:
+        test_sketch_accuracy()
+        test_sketch_merge()
+        test_sketch_bucket_cap()
+    except AssertionError as e:
+        print(f"\nAssertion Error: {e}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""
+Startup latency budget for pymtml.py
+Checks that importing pymtml stays cheap (the nvml layer and error subclasses are built lazily)
+and, when libmtml.so is available, that init and the first query stay within budget.
+Run with: python test_startup.py
+
+Wall-clock budgets depend on the machine, so under pytest only the lazy-import check is
+enforced unless PYMTML_STARTUP_BUDGETS=1 is set; running the script enforces them.
+"""
+
+import os
+import sys
+
+from bench_pymtml import measure_startup
+
+IMPORT_BUDGET_MS = 50
+INIT_BUDGET_MS = 200
+FIRST_QUERY_BUDGET_MS = 20
+
+
+def print_section(title):
+    print(f"\n{'='*60}")
+    print(f" {title}")
+    print(f"{'='*60}")
+
+
+def print_result(name, value, indent=2):
+    prefix = " " * indent
+    print(f"{prefix}{name}: {value}")
+
+
+def test_startup_budget(enforce=None):
+    print_section("Startup Budget")
+    if enforce is None:
+        enforce = os.environ.get("PYMTML_STARTUP_BUDGETS") == "1"
+    result = measure_startup(repeats=5)
+
+    assert not result["eager"], f"lazy sections imported eagerly: {result['eager']}"
+    print_result("Lazy sections", "OK")
+
+    for key, budget in (
+        ("import", IMPORT_BUDGET_MS),
+        ("init", INIT_BUDGET_MS),
+        ("first_query", FIRST_QUERY_BUDGET_MS),
+    ):
+        if key not in result:
+            print_result(key, "skipped (library not available)")
+            continue
+        elapsed = result[key] * 1000
+        print_result(key, f"{elapsed:.2f} ms (budget {budget} ms)")
+        if enforce:
+            assert elapsed <= budget, f"{key} took {elapsed:.2f} ms, budget {budget} ms"
+
+
+def main():
+    try:
+        test_startup_budget(enforce=True)
+    except AssertionError as e:
+        print(f"\nAssertion Error: {e}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+Tests for pymtml_storage.py columnar telemetry files
+Writes synthetic polls (no device needed), then checks round-trips, chunk skipping, failed
+reads and recovery from a truncated tail.
+Run with: python test_storage.py
+"""
+
+import os
+import sys
+import tempfile
+
+from pymtml_sampler import MTML_SAMPLER_COLUMNS
+from pymtml_storage import MtmlTelemetryReader, MtmlTelemetryWriter
+
+DEVICES = ["GPU-test-0", "GPU-test-1"]
+POLLS = 300
+POLLS_PER_CHUNK = 50
+INTERVAL_NS = 100000000
+
+
+def print_section(title):
+    print(f"\n{'='*60}")
+    print(f" {title}")
+    print(f"{'='*60}")
+
+
+def print_result(name, value, indent=2):
+    prefix = " " * indent
+    print(f"{prefix}{name}: {value}")
+
+
+def synthetic_polls(first=0, polls=POLLS):
+    """Rows in sampler order: poll-major, one row per device."""
+    columns = {name: [] for name, _, _ in MTML_SAMPLER_COLUMNS}
+    for poll in range(first, first + polls):
+        for slot in range(len(DEVICES)):
+            row = {
+                "timestamp": 1700000000000000000 + poll * INTERVAL_NS,
+                "device": slot,
+                "gpuUtil": (poll * 7 + slot) % 101,
+                "temperature": 40 + slot - (poll % 3),
+                "memoryTotal": 48 << 30,
+                "memoryUsed": (poll * 4096 + slot) << 10,
+            }
+            for name in columns:
+                columns[name].append(row.get(name, poll % 5))
+    return columns
+
+
+def poll_major(result):
+    """Query rows as poll-major lists, the order the polls were appended in."""
+    order = sorted(
+        range(len(result["timestamp"])),
+        key=lambda i: (result["timestamp"][i], result["device"][i]),
+    )
+    return {name: [column[i] for i in order] for name, column in result.items()}
+
+
+def test_storage_roundtrip():
+    print_section("Storage Round-trip")
+    path = os.path.join(tempfile.mkdtemp(), "telemetry.mtts")
+    expected = synthetic_polls()
+    with MtmlTelemetryWriter(
+        path, devices=DEVICES, pollsPerChunk=POLLS_PER_CHUNK
+    ) as writer:
+        writer.append(expected)
+
+    rows = POLLS * len(DEVICES)
+    size = os.path.getsize(path)
+    print_result("File size", f"{size} bytes ({size / rows:.1f} bytes/row)")
+
+    chunks = POLLS // POLLS_PER_CHUNK * len(DEVICES)
+    with MtmlTelemetryReader(path) as reader:
+        assert len(reader.chunks) == chunks
+        result = poll_major(reader.query())
+        for name in expected:
+            assert result[name] == expected[name], f"{name} differs"
+        assert set(result["valid"]) == {(1 << len(reader.metrics)) - 1}
+        print_result("Columns", "OK")
+
+        # one device's rows live in its own chunks; the others are not decoded
+        result = reader.query(devices=["GPU-test-0"])
+        assert list(result["timestamp"]) == expected["timestamp"][:: len(DEVICES)]
+        assert reader.lastScan == (chunks // len(DEVICES), chunks - chunks // 2)
+        assert reader.lastScan[1] > 0
+
+        # a time range inside one chunk decodes that chunk only
+        start = 1700000000000000000 + 120 * INTERVAL_NS
+        result = reader.query(
+            start=start, end=start + 9 * INTERVAL_NS, devices=["GPU-test-1"]
+        )
+        print_result(
+            "Range query", f"{len(result['timestamp'])} rows, scan {reader.lastScan}"
+        )
+        assert len(result["timestamp"]) == 10
+        assert set(result["device"]) == {1}
+        assert reader.lastScan == (1, chunks - 1)
+
+        # no chunk has a temperature above 41, so nothing is decoded
+        assert len(reader.query(where={"temperature": (50, None)})["timestamp"]) == 0
+        assert reader.lastScan[0] == 0
+
+
+def test_storage_failed_reads():
+    print_section("Storage Failed Reads")
+    path = os.path.join(tempfile.mkdtemp(), "telemetry.mtts")
+    polls = synthetic_polls(polls=POLLS_PER_CHUNK)
+    with MtmlTelemetryWriter(path, devices=DEVICES, pollsPerChunk=POLLS_PER_CHUNK) as w:
+        metrics = w.schema.metrics
+        full = (1 << len(metrics)) - 1
+        temperature = 1 << metrics.index("temperature")
+        # device 1's temperature read fails on every poll and keeps a stale 99
+        for row in range(1, len(polls["timestamp"]), len(DEVICES)):
+            polls["temperature"][row] = 99
+        polls["valid"] = [
+            full if row % len(DEVICES) == 0 else full & ~temperature
+            for row in range(len(polls["timestamp"]))
+        ]
+        w.append(polls)
+
+    with MtmlTelemetryReader(path) as reader:
+        rows = reader.query(devices=[1])
+        assert all(not v & temperature for v in rows["valid"])
+        # the stale value is stored, but never matches a filter on the failed metric
+        assert len(reader.query(where={"temperature": (90, None)})["timestamp"]) == 0
+        matched = reader.query(where={"gpuUtil": (0, None)})
+        assert len(matched["timestamp"]) == len(polls["timestamp"])
+        print_result("Failed reads", "flagged in valid")
+
+
+def test_storage_truncated_tail():
+    print_section("Storage Truncated Tail")
+    path = os.path.join(tempfile.mkdtemp(), "telemetry.mtts")
+    with MtmlTelemetryWriter(path, devices=DEVICES, pollsPerChunk=POLLS_PER_CHUNK) as w:
+        w.append(synthetic_polls(polls=100))
+    with open(path, "ab") as f:
+        f.write(b"MTCK\x07")  # a chunk cut short by a crash
+
+    with MtmlTelemetryReader(path) as reader:
+        assert len(reader.chunks) == 2 * len(DEVICES)
+
+    # reopening truncates the partial chunk and appends after the last good one
+    with MtmlTelemetryWriter(path, devices=DEVICES, pollsPerChunk=POLLS_PER_CHUNK) as w:
+        w.append(synthetic_polls(first=100, polls=50))
+    with MtmlTelemetryReader(path) as reader:
+        result = poll_major(reader.query())
+        assert result["timestamp"] == synthetic_polls(polls=150)["timestamp"]
+        print_result("Recovered chunks", len(reader.chunks))
+
+
+def main():
+    try:
+        test_storage_roundtrip()
+        test_storage_failed_reads()
+        test_storage_truncated_tail()
+    except AssertionError as e:
+        print(f"\nAssertion Error: {e}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())